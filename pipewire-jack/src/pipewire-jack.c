@@ -486,6 +486,7 @@ struct client {
 
 	uint32_t max_frames;
 	uint32_t max_align;
+	uint64_t spin_time;
 	mix_func mix_function;
 
 	jack_position_t jack_position;
@@ -1998,13 +1999,13 @@ static inline int check_sample_rate(struct client *c, struct spa_io_position *po
 	return c->sample_rate == sample_rate;
 }
 
+static inline uint32_t cycle_awake(struct client *c);
+
 static inline uint32_t cycle_run(struct client *c)
 {
 	uint64_t cmd;
 	int fd = c->socket_source->fd;
-	struct spa_io_position *pos = c->rt.position;
 	struct pw_node_activation *activation = c->activation;
-	struct pw_node_activation *driver = c->rt.driver_activation;
 
 	while (true) {
 		if (SPA_UNLIKELY(read(fd, &cmd, sizeof(cmd)) != sizeof(cmd))) {
@@ -2023,6 +2024,14 @@ static inline uint32_t cycle_run(struct client *c)
 		activation->xrun_delay = 0;
 		activation->max_delay = SPA_MAX(activation->max_delay, 0u);
 	}
+	return cycle_awake(c);
+}
+
+static inline uint32_t cycle_awake(struct client *c)
+{
+	struct spa_io_position *pos = c->rt.position;
+	struct pw_node_activation *activation = c->activation;
+	struct pw_node_activation *driver = c->rt.driver_activation;
 
 	if (!SPA_ATOMIC_CAS(activation->status,
 				PW_NODE_ACTIVATION_TRIGGERED,
@@ -2072,6 +2081,12 @@ static inline uint32_t cycle_wait(struct client *c)
 	int res;
 	uint32_t nframes;
 
+	if (SPA_UNLIKELY(c->spin_time > 0) &&
+	    pw_node_activation_spin(c->activation, c->rt.position,
+			c->l->system, c->spin_time) &&
+	    (nframes = cycle_awake(c)) > 0)
+		return nframes;
+
 	do {
 		res = pw_data_loop_wait(c->loop, -1);
 		if (SPA_UNLIKELY(res <= 0)) {
@@ -2102,6 +2117,8 @@ static void trigger_link_v1(struct link *l, uint64_t nsec)
 
 			pw_log_trace_fp("%p: signal %p %p", c, l, state);
 
+			if (pw_node_activation_wake(a))
+				return;
 			if (SPA_UNLIKELY(write(l->signalfd, &cmd, sizeof(cmd)) != sizeof(cmd)))
 				pw_log_warn("%p: write failed %m", c);
 		}
@@ -2181,6 +2198,16 @@ static inline void cycle_signal(struct client *c, int status)
 	signal_sync(c);
 }
 
+static inline void cycle_process(struct client *c, uint32_t buffer_frames)
+{
+	int status = -EBUSY;
+
+	if (buffer_frames > 0)
+		status = do_rt_callback_res(c, process_callback, buffer_frames, c->process_arg);
+
+	cycle_signal(c, status);
+}
+
 static void
 on_rtsocket_condition(void *data, int fd, uint32_t mask)
 {
@@ -2197,15 +2224,15 @@ on_rtsocket_condition(void *data, int fd, uint32_t mask)
 			c->thread_callback(c->thread_arg);
 		}
 	} else if (SPA_LIKELY(mask & SPA_IO_IN)) {
-		uint32_t buffer_frames;
-		int status = -EBUSY;
-
-		buffer_frames = cycle_run(c);
+		uint32_t buffer_frames = cycle_run(c);
 
-		if (buffer_frames > 0)
-			status = do_rt_callback_res(c, process_callback, buffer_frames, c->process_arg);
+		cycle_process(c, buffer_frames);
 
-		cycle_signal(c, status);
+		/* spin once for the next trigger, then go back to the loop */
+		if (SPA_UNLIKELY(c->spin_time > 0) &&
+		    pw_node_activation_spin(c->activation, c->rt.position,
+				c->l->system, c->spin_time))
+			cycle_process(c, cycle_awake(c));
 	}
 }
 
@@ -4482,6 +4509,8 @@ jack_client_t * jack_client_open (const char *client_name,
 	client->fill_aliases = pw_properties_get_bool(client->props, "jack.fill-aliases", false);
 	client->writable_input = pw_properties_get_bool(client->props, "jack.writable-input", true);
 	client->async = pw_properties_get_bool(client->props, PW_KEY_NODE_ASYNC, false);
+	client->spin_time = pw_properties_get_uint64(client->props, PW_KEY_NODE_SPIN_TIME, 0) *
+		SPA_NSEC_PER_USEC;
 	client->flag_midi2 = pw_properties_get_bool(client->props, "jack.flag-midi2", false);
 
 	client->self_connect_mode = SELF_CONNECT_ALLOW;
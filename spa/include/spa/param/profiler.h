@@ -80,6 +80,11 @@ enum spa_profiler {
 							  *      Double : clock rate_diff,
 							  *      Long : clock next_nsec,
 							  *      Long : xrun duration)) */
+	SPA_PROFILER_followerSlack,			/**< critical path information of the follower
+							  *  (Struct(
+							  *      Int : id,
+							  *      Int : id of the node that triggered the follower,
+							  *      Long : slack in nsec, 0 when on the critical path)) */
 	SPA_PROFILER_START_CUSTOM	= 0x1000000,
 };
 
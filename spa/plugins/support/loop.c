@@ -103,6 +103,16 @@ struct impl {
 
 	struct spa_source *wakeup;
 
+	/* all timer sources share one timerfd, the armed timers are kept in a
+	 * min-heap sorted on their expiration time */
+	pthread_mutex_t timer_lock;
+	struct spa_source *timer;
+	uint64_t timer_armed;
+	struct source_impl **timers;
+	uint32_t n_timers;
+	uint32_t max_timers;
+	uint32_t n_timer_sources;
+
 	uint32_t count;
 	uint32_t flush_count;
 	uint32_t remove_count;
@@ -140,6 +150,11 @@ struct source_impl {
 
 	struct spa_source *fallback;
 
+	uint32_t timer_idx;
+	uint64_t timer_next;
+	uint64_t timer_interval;
+	uint64_t expirations;
+
 	bool close;
 	bool enabled;
 };
@@ -1053,26 +1068,144 @@ static int loop_signal_event(void *object, struct spa_source *source)
 	return res;
 }
 
+static inline void timer_swap(struct impl *impl, uint32_t a, uint32_t b)
+{
+	struct source_impl *t = impl->timers[a];
+	impl->timers[a] = impl->timers[b];
+	impl->timers[b] = t;
+	impl->timers[a]->timer_idx = a;
+	impl->timers[b]->timer_idx = b;
+}
+
+static void timer_sift_up(struct impl *impl, uint32_t idx)
+{
+	while (idx > 0) {
+		uint32_t parent = (idx - 1) / 2;
+		if (impl->timers[parent]->timer_next <= impl->timers[idx]->timer_next)
+			break;
+		timer_swap(impl, parent, idx);
+		idx = parent;
+	}
+}
+
+static void timer_sift_down(struct impl *impl, uint32_t idx)
+{
+	while (true) {
+		uint32_t l = 2 * idx + 1, r = l + 1, min = idx;
+		if (l < impl->n_timers &&
+		    impl->timers[l]->timer_next < impl->timers[min]->timer_next)
+			min = l;
+		if (r < impl->n_timers &&
+		    impl->timers[r]->timer_next < impl->timers[min]->timer_next)
+			min = r;
+		if (min == idx)
+			break;
+		timer_swap(impl, idx, min);
+		idx = min;
+	}
+}
+
+static void timer_insert(struct impl *impl, struct source_impl *s)
+{
+	/* the heap is sized for all timer sources in loop_add_timer */
+	spa_assert(impl->n_timers < impl->max_timers);
+	s->timer_idx = impl->n_timers++;
+	impl->timers[s->timer_idx] = s;
+	timer_sift_up(impl, s->timer_idx);
+}
+
+static void timer_remove(struct impl *impl, struct source_impl *s)
+{
+	uint32_t idx = s->timer_idx;
+
+	s->timer_idx = SPA_IDX_INVALID;
+	if (idx != --impl->n_timers) {
+		impl->timers[idx] = impl->timers[impl->n_timers];
+		impl->timers[idx]->timer_idx = idx;
+		timer_sift_down(impl, idx);
+		timer_sift_up(impl, idx);
+	}
+}
+
+/* arm the timerfd for the first timer to expire, call with timer_lock */
+static int timer_rearm(struct impl *impl)
+{
+	struct itimerspec its;
+	uint64_t next = impl->n_timers > 0 ? impl->timers[0]->timer_next : 0;
+	int res;
+
+	if (next == impl->timer_armed)
+		return 0;
+
+	spa_zero(its);
+	its.it_value.tv_sec = next / SPA_NSEC_PER_SEC;
+	its.it_value.tv_nsec = next % SPA_NSEC_PER_SEC;
+	if (SPA_UNLIKELY((res = spa_system_timerfd_settime(impl->system, impl->timer->fd,
+				SPA_FD_TIMER_ABSTIME, &its, NULL)) < 0))
+		return res;
+
+	impl->timer_armed = next;
+	return 0;
+}
+
 static void source_timer_func(struct spa_source *source)
 {
 	struct source_impl *s = SPA_CONTAINER_OF(source, struct source_impl, source);
-	uint64_t expirations = 0;
+	s->func.timer(source->data, s->expirations);
+}
+
+static void source_timers_func(struct spa_source *source)
+{
+	struct source_impl *s = SPA_CONTAINER_OF(source, struct source_impl, source);
+	struct impl *impl = s->impl;
+	uint64_t expirations = 0, now;
+	uint32_t count;
 	int res;
 
-	if (SPA_UNLIKELY((res = spa_system_timerfd_read(s->impl->system,
+	if (SPA_UNLIKELY((res = spa_system_timerfd_read(impl->system,
 				source->fd, &expirations)) < 0)) {
 		if (res != -EAGAIN)
-			spa_log_warn(s->impl->log, "%p: failed to read timer fd:%d: %s",
+			spa_log_warn(impl->log, "%p: failed to read timer fd:%d: %s",
 					source, source->fd, spa_strerror(res));
 		return;
 	}
-	s->func.timer(source->data, expirations);
+	now = get_time_ns(impl->system);
+
+	pthread_mutex_lock(&impl->timer_lock);
+	impl->timer_armed = 0;
+
+	/* timers that are rearmed in the past from the callback are
+	 * dispatched in the next iteration */
+	for (count = impl->n_timers; count > 0 && impl->n_timers > 0; count--) {
+		struct source_impl *t = impl->timers[0];
+
+		if (t->timer_next > now)
+			break;
+
+		if (t->timer_interval > 0) {
+			t->expirations = 1 + (now - t->timer_next) / t->timer_interval;
+			t->timer_next += t->expirations * t->timer_interval;
+			timer_sift_down(impl, 0);
+		} else {
+			t->expirations = 1;
+			timer_remove(impl, t);
+		}
+		pthread_mutex_unlock(&impl->timer_lock);
+
+		t->source.rmask = SPA_IO_IN;
+		t->source.func(&t->source);
+		t->source.rmask = 0;
+
+		pthread_mutex_lock(&impl->timer_lock);
+	}
+	if ((res = timer_rearm(impl)) < 0)
+		spa_log_warn(impl->log, "%p: failed to arm timer fd:%d: %s",
+				impl, source->fd, spa_strerror(res));
+	pthread_mutex_unlock(&impl->timer_lock);
 }
 
-static struct spa_source *loop_add_timer(void *object,
-					 spa_source_timer_func_t func, void *data)
+static struct spa_source *add_timers_source(struct impl *impl)
 {
-	struct impl *impl = object;
 	struct source_impl *source;
 	int res;
 
@@ -1084,12 +1217,11 @@ static struct spa_source *loop_add_timer(void *object,
 			SPA_FD_CLOEXEC | SPA_FD_NONBLOCK)) < 0)
 		goto error_exit_free;
 
-	source->source.func = source_timer_func;
-	source->source.data = data;
+	source->source.func = source_timers_func;
+	source->source.data = impl;
 	source->source.fd = res;
 	source->source.mask = SPA_IO_IN;
 	source->close = true;
-	source->func.timer = func;
 
 	if ((res = loop_add_source(impl, &source->source)) < 0)
 		goto error_exit_close;
@@ -1099,40 +1231,99 @@ static struct spa_source *loop_add_timer(void *object,
 error_exit_close:
 	spa_system_close(impl->system, source->source.fd);
 error_exit_free:
+	spa_list_remove(&source->link);
 	free(source);
 	errno = -res;
 error_exit:
 	return NULL;
 }
 
+static struct spa_source *loop_add_timer(void *object,
+					 spa_source_timer_func_t func, void *data)
+{
+	struct impl *impl = object;
+	struct source_impl *source;
+	int res = 0;
+
+	pthread_mutex_lock(&impl->timer_lock);
+	if (impl->timer == NULL &&
+	    (impl->timer = add_timers_source(impl)) == NULL) {
+		res = -errno;
+		goto error_exit;
+	}
+	if (impl->n_timer_sources >= impl->max_timers) {
+		uint32_t max = SPA_MAX(impl->max_timers * 2, 16u);
+		struct source_impl **timers;
+
+		timers = reallocarray(impl->timers, max, sizeof(struct source_impl *));
+		if (timers == NULL) {
+			res = -errno;
+			goto error_exit;
+		}
+		impl->timers = timers;
+		impl->max_timers = max;
+	}
+
+	source = get_source(impl);
+	if (source == NULL) {
+		res = -errno;
+		goto error_exit;
+	}
+
+	source->source.func = source_timer_func;
+	source->source.data = data;
+	source->source.fd = -1;
+	source->source.mask = SPA_IO_IN;
+	source->source.loop = &impl->loop;
+	source->func.timer = func;
+	source->timer_idx = SPA_IDX_INVALID;
+	impl->n_timer_sources++;
+	pthread_mutex_unlock(&impl->timer_lock);
+
+	return &source->source;
+
+error_exit:
+	pthread_mutex_unlock(&impl->timer_lock);
+	errno = -res;
+	return NULL;
+}
+
 static int
 loop_update_timer(void *object, struct spa_source *source,
 		  struct timespec *value, struct timespec *interval, bool absolute)
 {
 	struct source_impl *s = SPA_CONTAINER_OF(source, struct source_impl, source);
-	struct itimerspec its;
-	int flags = 0, res;
+	struct impl *impl = s->impl;
+	uint64_t next = 0;
+	int res;
 
 	spa_assert(s->impl == object);
 	spa_assert(source->func == source_timer_func);
 
-	spa_zero(its);
 	if (SPA_LIKELY(value)) {
-		its.it_value = *value;
+		next = SPA_TIMESPEC_TO_NSEC(value);
 	} else if (interval) {
 		// timer initially fires after one interval
-		its.it_value = *interval;
+		next = SPA_TIMESPEC_TO_NSEC(interval);
 		absolute = false;
 	}
-	if (SPA_UNLIKELY(interval))
-		its.it_interval = *interval;
-	if (SPA_LIKELY(absolute))
-		flags |= SPA_FD_TIMER_ABSTIME;
-
-	if (SPA_UNLIKELY((res = spa_system_timerfd_settime(s->impl->system, source->fd, flags, &its, NULL)) < 0))
-		return res;
+	/* like timerfd, a 0 value disarms the timer */
+	if (next > 0 && !absolute)
+		next += get_time_ns(impl->system);
+
+	pthread_mutex_lock(&impl->timer_lock);
+	if (s->timer_idx != SPA_IDX_INVALID)
+		timer_remove(impl, s);
+
+	s->timer_interval = interval ? SPA_TIMESPEC_TO_NSEC(interval) : 0;
+	if (next > 0) {
+		s->timer_next = next;
+		timer_insert(impl, s);
+	}
+	res = timer_rearm(impl);
+	pthread_mutex_unlock(&impl->timer_lock);
 
-	return 0;
+	return res;
 }
 
 static void source_signal_func(struct spa_source *source)
@@ -1194,10 +1385,24 @@ static void loop_destroy_source(void *object, struct spa_source *source)
 
 	spa_log_trace(s->impl->log, "%p ", s);
 
-	if (s->fallback)
+	if (source->func == source_timer_func) {
+		struct impl *impl = s->impl;
+
+		pthread_mutex_lock(&impl->timer_lock);
+		if (s->timer_idx != SPA_IDX_INVALID) {
+			timer_remove(impl, s);
+			if (impl->timer != NULL)
+				timer_rearm(impl);
+		}
+		impl->n_timer_sources--;
+		pthread_mutex_unlock(&impl->timer_lock);
+	} else if (s->fallback) {
 		loop_destroy_source(s->impl, s->fallback);
-	else
+	} else {
+		if (source == s->impl->timer)
+			s->impl->timer = NULL;
 		remove_from_poll(s->impl, source);
+	}
 
 	if (source->fd != -1 && s->close) {
 		spa_system_close(s->impl->system, source->fd);
@@ -1313,7 +1518,10 @@ static int impl_clear(struct spa_handle *handle)
 
 	spa_system_close(impl->system, impl->poll_fd);
 
+	free(impl->timers);
+
 	pthread_cond_destroy(&impl->cond);
+	pthread_mutex_destroy(&impl->timer_lock);
 	pthread_mutex_destroy(&impl->lock);
 
 	return 0;
@@ -1387,6 +1595,7 @@ impl_init(const struct spa_handle_factory *factory,
 		CHECK(pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT),
 					error_exit_free_attr)
 	CHECK(pthread_mutex_init(&impl->lock, &attr), error_exit_free_attr);
+	CHECK(pthread_mutex_init(&impl->timer_lock, &attr), error_exit_free_lock);
 	pthread_mutexattr_destroy(&attr);
 
 	CHECK(pthread_condattr_init(&cattr), error_exit_free_mutex);
@@ -1434,6 +1643,10 @@ error_exit_free_poll:
 error_exit_free_cond:
 	pthread_cond_destroy(&impl->cond);
 error_exit_free_mutex:
+	pthread_mutex_destroy(&impl->timer_lock);
+	pthread_mutex_destroy(&impl->lock);
+	goto error_exit;
+error_exit_free_lock:
 	pthread_mutex_destroy(&impl->lock);
 error_exit_free_attr:
 	pthread_mutexattr_destroy(&attr);
@@ -0,0 +1,1089 @@
+/* Spa */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+
+#include <linux/io_uring.h>
+
+#include <spa/support/log.h>
+#include <spa/support/system.h>
+#include <spa/support/plugin.h>
+#include <spa/utils/atomic.h>
+#include <spa/utils/list.h>
+#include <spa/utils/names.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+#include <spa/utils/type.h>
+
+SPA_LOG_TOPIC_DEFINE_STATIC(log_topic, "spa.uring-system");
+
+#undef SPA_LOG_TOPIC_DEFAULT
+#define SPA_LOG_TOPIC_DEFAULT &log_topic
+
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#  define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
+#define DEFAULT_ENTRIES		256u
+#define DEFAULT_READ_AHEAD	true
+
+#define POLL_MASK	(EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLERR | EPOLLHUP | EPOLLRDHUP)
+
+#define FD_TYPE_OTHER	0
+#define FD_TYPE_EVENT	1
+#define FD_TYPE_TIMER	2
+
+#define FD_CHUNK	1024u
+#define MAX_FD_CHUNKS	1024u
+
+/* what we know about the fds we created */
+struct fd_info {
+	uint8_t type;
+	bool semaphore;
+	uint64_t value;		/* read ahead by a ring, 0 when there is none.
+				 * Only accessed with atomic operations */
+};
+
+struct ring;
+
+/* an fd that is added to a pollfd */
+struct watch {
+	struct spa_list link;
+	struct ring *ring;
+	int fd;
+	uint32_t events;
+	void *data;
+	uint64_t value;		/* buffer for the read ahead */
+	unsigned int armed:1;	/* a request is in flight */
+	unsigned int read:1;	/* the armed request is a read */
+	unsigned int discard:1;	/* the value that was read is stale */
+	unsigned int removed:1;
+	unsigned int listed:1;	/* in the rearm or removed list */
+};
+
+/* a pollfd, the fd is the io_uring fd */
+struct ring {
+	struct spa_list link;
+	int fd;
+
+	uint32_t sq_entries;
+	uint32_t *sq_head;
+	uint32_t *sq_tail;
+	uint32_t *sq_mask;
+	uint32_t *sq_array;
+	uint32_t sq_local;		/* tail of the filled entries */
+	uint32_t to_submit;		/* published but not yet submitted */
+
+	uint32_t *cq_head;
+	uint32_t *cq_tail;
+	uint32_t *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	struct io_uring_sqe *sqes;
+	void *sq_ptr;
+	size_t sq_size;
+	void *cq_ptr;
+	size_t cq_size;
+	size_t sqes_size;
+
+	struct watch **watches;		/* indexed by fd */
+	uint32_t n_watches;
+	struct spa_list rearm_list;	/* watches to arm before the next wait */
+	struct spa_list removed_list;	/* removed watches with a request in flight */
+};
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_system system;
+        struct spa_log *log;
+
+	uint32_t entries;
+	bool read_ahead;
+
+	pthread_mutex_t lock;
+	struct spa_list rings;
+	/* indexed by fd. The chunks are added with the lock but never moved
+	 * or freed so that the read ahead values can be taken without it */
+	struct fd_info *fds[MAX_FD_CHUNKS];
+};
+
+static int sys_io_uring_setup(uint32_t entries, struct io_uring_params *p)
+{
+	return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+		uint32_t flags, void *arg, size_t argsz)
+{
+	return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, arg, argsz);
+}
+
+static void *grow_array(void *array, uint32_t *n_items, uint32_t index, size_t size)
+{
+	uint32_t n = SPA_MAX(*n_items, 64u);
+	void *a;
+
+	if (index < *n_items)
+		return array;
+
+	while (n <= index)
+		n *= 2;
+	if ((a = reallocarray(array, n, size)) == NULL)
+		return NULL;
+	memset(SPA_PTROFF(a, *n_items * size, void), 0, (n - *n_items) * size);
+	*n_items = n;
+	return a;
+}
+
+/* create is only allowed with the lock */
+static struct fd_info *get_fd_info(struct impl *impl, int fd, bool create)
+{
+	struct fd_info *chunk;
+	uint32_t index;
+
+	if (fd < 0 || (index = (uint32_t)fd / FD_CHUNK) >= MAX_FD_CHUNKS)
+		return NULL;
+
+	chunk = __atomic_load_n(&impl->fds[index], __ATOMIC_ACQUIRE);
+	if (chunk == NULL) {
+		if (!create ||
+		    (chunk = calloc(FD_CHUNK, sizeof(struct fd_info))) == NULL)
+			return NULL;
+		__atomic_store_n(&impl->fds[index], chunk, __ATOMIC_RELEASE);
+	}
+	return &chunk[fd % FD_CHUNK];
+}
+
+static struct ring *find_ring(struct impl *impl, int pfd)
+{
+	struct ring *r;
+	spa_list_for_each(r, &impl->rings, link)
+		if (r->fd == pfd)
+			return r;
+	return NULL;
+}
+
+static inline struct watch *find_watch(struct ring *r, int fd)
+{
+	if (fd < 0 || (uint32_t)fd >= r->n_watches)
+		return NULL;
+	return r->watches[fd];
+}
+
+/* submit the published entries, call with the lock */
+static int ring_flush(struct ring *r)
+{
+	uint32_t to_submit = r->to_submit;
+	int res;
+
+	if (to_submit == 0)
+		return 0;
+	r->to_submit = 0;
+	if ((res = sys_io_uring_enter(r->fd, to_submit, 0, 0, NULL, 0)) < 0)
+		return -errno;
+	return 0;
+}
+
+static struct io_uring_sqe *ring_get_sqe(struct ring *r)
+{
+	struct io_uring_sqe *sqe;
+	uint32_t idx;
+
+	if (r->sq_local - SPA_ATOMIC_LOAD(*r->sq_head) >= r->sq_entries) {
+		/* full, submit what we have and try again */
+		ring_flush(r);
+		if (r->sq_local - SPA_ATOMIC_LOAD(*r->sq_head) >= r->sq_entries)
+			return NULL;
+	}
+	idx = r->sq_local & *r->sq_mask;
+	sqe = &r->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	r->sq_array[idx] = idx;
+	return sqe;
+}
+
+static void ring_commit_sqe(struct ring *r)
+{
+	r->sq_local++;
+	__atomic_store_n(r->sq_tail, r->sq_local, __ATOMIC_RELEASE);
+	r->to_submit++;
+}
+
+static int watch_cancel(struct ring *r, struct watch *w)
+{
+	struct io_uring_sqe *sqe;
+
+	if ((sqe = ring_get_sqe(r)) == NULL)
+		return -EBUSY;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t)(uintptr_t)w;
+	sqe->user_data = 0;
+	ring_commit_sqe(r);
+	return 0;
+}
+
+/* arm the watch. Returns 1 when the watch has a value ready and does not
+ * need to wait, call with the lock */
+static int watch_arm(struct impl *impl, struct ring *r, struct watch *w)
+{
+	struct io_uring_sqe *sqe;
+	struct fd_info *fi;
+	uint32_t events = w->events & POLL_MASK;
+
+	if (events == 0 || w->armed)
+		return 0;
+
+	fi = get_fd_info(impl, w->fd, false);
+
+	/* the events and timers we created are read ahead, the value is
+	 * then returned from the next eventfd_read or timerfd_read without
+	 * a syscall */
+	w->read = impl->read_ahead && fi != NULL &&
+		fi->type != FD_TYPE_OTHER && events == EPOLLIN;
+	if (w->read && SPA_ATOMIC_LOAD(fi->value) != 0)
+		return 1;
+
+	if ((sqe = ring_get_sqe(r)) == NULL)
+		return -EBUSY;
+
+	if (w->read) {
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = w->fd;
+		sqe->addr = (uint64_t)(uintptr_t)&w->value;
+		sqe->len = sizeof(w->value);
+		sqe->off = (uint64_t)-1;
+		w->discard = false;
+	} else {
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = w->fd;
+		sqe->poll32_events = events;
+	}
+	sqe->user_data = (uint64_t)(uintptr_t)w;
+	ring_commit_sqe(r);
+	w->armed = true;
+	return 0;
+}
+
+static void watch_free(struct watch *w)
+{
+	if (w->listed)
+		spa_list_remove(&w->link);
+	free(w);
+}
+
+static void watch_pending(struct ring *r, struct watch *w)
+{
+	if (!w->listed) {
+		spa_list_append(&r->rearm_list, &w->link);
+		w->listed = true;
+	}
+}
+
+/* remove the watch from the ring, call with the lock */
+static int watch_remove(struct ring *r, struct watch *w)
+{
+	int res;
+
+	r->watches[w->fd] = NULL;
+	w->removed = true;
+	if (!w->armed) {
+		watch_free(w);
+		return 0;
+	}
+	/* keep it around until the cancel completes */
+	if (w->listed)
+		spa_list_remove(&w->link);
+	spa_list_append(&r->removed_list, &w->link);
+	w->listed = true;
+	if ((res = watch_cancel(r, w)) < 0)
+		return res;
+	return ring_flush(r);
+}
+
+static void fd_info_add_value(struct fd_info *fi, uint64_t value)
+{
+	if (fi->type == FD_TYPE_EVENT && fi->semaphore)
+		value = 1;
+	__atomic_add_fetch(&fi->value, value, __ATOMIC_SEQ_CST);
+}
+
+/* arm all watches that completed in the previous wait, call with the lock */
+static int ring_rearm(struct impl *impl, struct ring *r,
+		struct spa_poll_event *ev, int n_ev, int *n)
+{
+	struct watch *w, *t;
+	int res;
+
+	spa_list_for_each_safe(w, t, &r->rearm_list, link) {
+		if ((res = watch_arm(impl, r, w)) < 0)
+			return res;
+		if (res == 1) {
+			/* value still pending, report it again like epoll does */
+			if (*n < n_ev) {
+				ev[*n].events = EPOLLIN;
+				ev[*n].data = w->data;
+				(*n)++;
+			}
+			continue;
+		}
+		spa_list_remove(&w->link);
+		w->listed = false;
+	}
+	return 0;
+}
+
+/* collect the completions, call with the lock */
+static int ring_reap(struct impl *impl, struct ring *r,
+		struct spa_poll_event *ev, int n_ev, int n)
+{
+	uint32_t head = *r->cq_head, tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail && n < n_ev) {
+		struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+		struct watch *w = (struct watch *)(uintptr_t)cqe->user_data;
+		uint32_t events = 0;
+
+		head++;
+
+		if (w == NULL)
+			continue;
+
+		w->armed = false;
+
+		if (w->read && cqe->res == sizeof(w->value)) {
+			/* the value was consumed from the fd, keep it for the
+			 * next read, also when the watch was removed */
+			struct fd_info *fi = get_fd_info(impl, w->fd, false);
+			if (fi != NULL && !w->discard) {
+				fd_info_add_value(fi, w->value);
+				events = EPOLLIN;
+			}
+		} else if (cqe->res > 0) {
+			events = cqe->res;
+		} else if (cqe->res != -ECANCELED) {
+			events = EPOLLERR;
+		}
+		if (w->removed) {
+			watch_free(w);
+			continue;
+		}
+		if (events != 0) {
+			ev[n].events = events;
+			ev[n].data = w->data;
+			n++;
+		}
+		watch_pending(r, w);
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+/* mark the reads of fd that completed but were not collected yet as
+ * stale, call with the lock */
+static void ring_discard(struct ring *r, int fd)
+{
+	uint32_t head = *r->cq_head, tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+		struct watch *w = (struct watch *)(uintptr_t)cqe->user_data;
+		if (w != NULL && w->fd == fd && w->read)
+			w->discard = true;
+	}
+}
+
+static void ring_free(struct ring *r)
+{
+	struct watch *w;
+	uint32_t i;
+
+	for (i = 0; i < r->n_watches; i++)
+		if (r->watches[i])
+			watch_free(r->watches[i]);
+	free(r->watches);
+	spa_list_consume(w, &r->removed_list, link)
+		watch_free(w);
+
+	if (r->sqes)
+		munmap(r->sqes, r->sqes_size);
+	if (r->cq_ptr && r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_size);
+	if (r->sq_ptr)
+		munmap(r->sq_ptr, r->sq_size);
+	if (r->fd >= 0)
+		close(r->fd);
+	free(r);
+}
+
+static struct ring *ring_new(struct impl *impl)
+{
+	struct io_uring_params p;
+	struct ring *r;
+	int res;
+
+	if ((r = calloc(1, sizeof(*r))) == NULL)
+		return NULL;
+
+	spa_list_init(&r->rearm_list);
+	spa_list_init(&r->removed_list);
+
+	spa_zero(p);
+	p.flags = IORING_SETUP_CLAMP;
+	if ((r->fd = sys_io_uring_setup(impl->entries, &p)) < 0)
+		goto error;
+
+	if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+		spa_log_error(impl->log, "%p: io_uring features %08x not supported",
+				impl, p.features);
+		errno = ENOTSUP;
+		goto error;
+	}
+
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sq_size = r->cq_size = SPA_MAX(r->sq_size, r->cq_size);
+
+	r->sq_ptr = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED) {
+		r->sq_ptr = NULL;
+		goto error;
+	}
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		r->cq_ptr = r->sq_ptr;
+	} else {
+		r->cq_ptr = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+		if (r->cq_ptr == MAP_FAILED) {
+			r->cq_ptr = NULL;
+			goto error;
+		}
+	}
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED) {
+		r->sqes = NULL;
+		goto error;
+	}
+
+	r->sq_entries = p.sq_entries;
+	r->sq_head = SPA_PTROFF(r->sq_ptr, p.sq_off.head, uint32_t);
+	r->sq_tail = SPA_PTROFF(r->sq_ptr, p.sq_off.tail, uint32_t);
+	r->sq_mask = SPA_PTROFF(r->sq_ptr, p.sq_off.ring_mask, uint32_t);
+	r->sq_array = SPA_PTROFF(r->sq_ptr, p.sq_off.array, uint32_t);
+	r->sq_local = *r->sq_tail;
+
+	r->cq_head = SPA_PTROFF(r->cq_ptr, p.cq_off.head, uint32_t);
+	r->cq_tail = SPA_PTROFF(r->cq_ptr, p.cq_off.tail, uint32_t);
+	r->cq_mask = SPA_PTROFF(r->cq_ptr, p.cq_off.ring_mask, uint32_t);
+	r->cqes = SPA_PTROFF(r->cq_ptr, p.cq_off.cqes, struct io_uring_cqe);
+
+	spa_log_debug(impl->log, "%p: new ring fd:%d sq:%u cq:%u", impl, r->fd,
+			p.sq_entries, p.cq_entries);
+	return r;
+
+error:
+	res = -errno;
+	spa_log_error(impl->log, "%p: can't create io_uring: %s", impl, spa_strerror(res));
+	ring_free(r);
+	errno = -res;
+	return NULL;
+}
+
+static ssize_t impl_read(void *object, int fd, void *buf, size_t count)
+{
+	ssize_t res = read(fd, buf, count);
+	return res < 0 ? -errno : res;
+}
+
+static ssize_t impl_write(void *object, int fd, const void *buf, size_t count)
+{
+	ssize_t res = write(fd, buf, count);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_ioctl(void *object, int fd, unsigned long request, ...)
+{
+	int res;
+	va_list ap;
+	long arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, long);
+	res = ioctl(fd, request, arg);
+	va_end(ap);
+
+	return res < 0 ? -errno : res;
+}
+
+static int impl_close(void *object, int fd)
+{
+	struct impl *impl = object;
+	struct fd_info *fi;
+	struct ring *r;
+	int res;
+
+	pthread_mutex_lock(&impl->lock);
+	if ((r = find_ring(impl, fd)) != NULL) {
+		spa_list_remove(&r->link);
+		pthread_mutex_unlock(&impl->lock);
+		ring_free(r);
+		spa_log_debug(impl->log, "%p: close ring fd:%d", impl, fd);
+		return 0;
+	}
+	/* closed fds are removed from epoll, do the same */
+	spa_list_for_each(r, &impl->rings, link) {
+		struct watch *w = find_watch(r, fd);
+		if (w != NULL) {
+			/* the fd can be reused, drop what is still read */
+			w->discard = true;
+			watch_remove(r, w);
+		}
+	}
+	if ((fi = get_fd_info(impl, fd, false)) != NULL) {
+		fi->type = FD_TYPE_OTHER;
+		fi->semaphore = false;
+		SPA_ATOMIC_STORE(fi->value, 0);
+	}
+	pthread_mutex_unlock(&impl->lock);
+
+	res = close(fd);
+	spa_log_debug(impl->log, "%p: close fd:%d", impl, fd);
+	return res < 0 ? -errno : res;
+}
+
+/* clock */
+static int impl_clock_gettime(void *object,
+			int clockid, struct timespec *value)
+{
+	int res = clock_gettime(clockid, value);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_clock_getres(void *object,
+			int clockid, struct timespec *res)
+{
+	int r = clock_getres(clockid, res);
+	return r < 0 ? -errno : r;
+}
+
+/* poll */
+static int impl_pollfd_create(void *object, int flags)
+{
+	struct impl *impl = object;
+	struct ring *r;
+
+	/* the io_uring fd is always close-on-exec */
+	if ((r = ring_new(impl)) == NULL)
+		return -errno;
+
+	pthread_mutex_lock(&impl->lock);
+	spa_list_append(&impl->rings, &r->link);
+	pthread_mutex_unlock(&impl->lock);
+
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, r->fd);
+	return r->fd;
+}
+
+static int impl_pollfd_add(void *object, int pfd, int fd, uint32_t events, void *data)
+{
+	struct impl *impl = object;
+	struct watch **watches, *w;
+	struct ring *r;
+	int res;
+
+	pthread_mutex_lock(&impl->lock);
+	if ((r = find_ring(impl, pfd)) == NULL) {
+		res = -EBADF;
+		goto done;
+	}
+	if (fd < 0) {
+		res = -EBADF;
+		goto done;
+	}
+	if (find_watch(r, fd) != NULL) {
+		res = -EEXIST;
+		goto done;
+	}
+	if ((watches = grow_array(r->watches, &r->n_watches, fd, sizeof(struct watch *))) == NULL) {
+		res = -errno;
+		goto done;
+	}
+	r->watches = watches;
+
+	if ((w = calloc(1, sizeof(*w))) == NULL) {
+		res = -errno;
+		goto done;
+	}
+	w->ring = r;
+	w->fd = fd;
+	w->events = events;
+	w->data = data;
+	r->watches[fd] = w;
+
+	/* arm now, the ring might be waiting in another thread. When there
+	 * is a value ready or no space, it is done before the next wait */
+	if (watch_arm(impl, r, w) != 0)
+		watch_pending(r, w);
+	res = ring_flush(r);
+done:
+	pthread_mutex_unlock(&impl->lock);
+	return res;
+}
+
+static int impl_pollfd_mod(void *object, int pfd, int fd, uint32_t events, void *data)
+{
+	struct impl *impl = object;
+	struct watch *w;
+	struct ring *r;
+	int res = 0;
+
+	pthread_mutex_lock(&impl->lock);
+	if ((r = find_ring(impl, pfd)) == NULL) {
+		res = -EBADF;
+		goto done;
+	}
+	if ((w = find_watch(r, fd)) == NULL) {
+		res = -ENOENT;
+		goto done;
+	}
+	w->data = data;
+	if (w->events == events)
+		goto done;
+	w->events = events;
+
+	if (w->armed) {
+		/* the cancel completion wakes up the ring, which will then
+		 * arm the watch again with the new events */
+		if ((res = watch_cancel(r, w)) < 0)
+			goto done;
+	} else {
+		if (w->listed) {
+			spa_list_remove(&w->link);
+			w->listed = false;
+		}
+		if (watch_arm(impl, r, w) != 0)
+			watch_pending(r, w);
+	}
+	res = ring_flush(r);
+done:
+	pthread_mutex_unlock(&impl->lock);
+	return res;
+}
+
+static int impl_pollfd_del(void *object, int pfd, int fd)
+{
+	struct impl *impl = object;
+	struct watch *w;
+	struct ring *r;
+	int res = 0;
+
+	pthread_mutex_lock(&impl->lock);
+	if ((r = find_ring(impl, pfd)) == NULL) {
+		res = -EBADF;
+		goto done;
+	}
+	if ((w = find_watch(r, fd)) == NULL) {
+		res = -ENOENT;
+		goto done;
+	}
+	res = watch_remove(r, w);
+done:
+	pthread_mutex_unlock(&impl->lock);
+	return res;
+}
+
+static int impl_pollfd_wait(void *object, int pfd,
+		struct spa_poll_event *ev, int n_ev, int timeout)
+{
+	struct impl *impl = object;
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	struct ring *r;
+	uint32_t to_submit, flags;
+	int n = 0, res;
+
+	pthread_mutex_lock(&impl->lock);
+	if ((r = find_ring(impl, pfd)) == NULL) {
+		pthread_mutex_unlock(&impl->lock);
+		return -EBADF;
+	}
+	while (true) {
+		/* arm the watches that fired in the previous iteration, those
+		 * are submitted together with the wait */
+		if ((res = ring_rearm(impl, r, ev, n_ev, &n)) < 0)
+			break;
+		n = ring_reap(impl, r, ev, n_ev, n);
+
+		to_submit = r->to_submit;
+		r->to_submit = 0;
+		pthread_mutex_unlock(&impl->lock);
+
+		spa_zero(arg);
+		flags = IORING_ENTER_EXT_ARG;
+		if (n == 0 && timeout != 0) {
+			flags |= IORING_ENTER_GETEVENTS;
+			if (timeout > 0) {
+				ts.tv_sec = timeout / SPA_MSEC_PER_SEC;
+				ts.tv_nsec = (timeout % SPA_MSEC_PER_SEC) * SPA_NSEC_PER_MSEC;
+				arg.ts = (uint64_t)(uintptr_t)&ts;
+			}
+		}
+		res = 0;
+		if ((flags & IORING_ENTER_GETEVENTS) || to_submit > 0) {
+			if (sys_io_uring_enter(r->fd, to_submit,
+					flags & IORING_ENTER_GETEVENTS ? 1 : 0,
+					flags, &arg, sizeof(arg)) < 0)
+				res = -errno;
+		}
+
+		pthread_mutex_lock(&impl->lock);
+		if (res < 0 && res != -ETIME && res != -EINTR)
+			break;
+
+		if (n == 0)
+			n = ring_reap(impl, r, ev, n_ev, n);
+
+		/* we only got completions of cancelled requests, wait again */
+		if (n > 0 || timeout == 0 || res < 0)
+			break;
+	}
+	pthread_mutex_unlock(&impl->lock);
+
+	if (n == 0 && res < 0 && res != -ETIME)
+		return res;
+	return n;
+}
+
+/* timers */
+static int impl_timerfd_create(void *object, int clockid, int flags)
+{
+	struct impl *impl = object;
+	struct fd_info *fi;
+	int fl = 0, res;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= TFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= TFD_NONBLOCK;
+	if ((res = timerfd_create(clockid, fl)) < 0)
+		return -errno;
+
+	pthread_mutex_lock(&impl->lock);
+	if ((fi = get_fd_info(impl, res, true)) != NULL)
+		fi->type = FD_TYPE_TIMER;
+	pthread_mutex_unlock(&impl->lock);
+
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+	return res;
+}
+
+static int impl_timerfd_settime(void *object,
+			int fd, int flags,
+			const struct itimerspec *new_value,
+			struct itimerspec *old_value)
+{
+	struct impl *impl = object;
+	struct fd_info *fi;
+	int fl = 0, res;
+
+	/* like with a timerfd, expirations that were read ahead are
+	 * discarded when the timer is set. Reads that are still in flight
+	 * will complete with the expirations of the new setting. */
+	pthread_mutex_lock(&impl->lock);
+	if ((fi = get_fd_info(impl, fd, false)) != NULL && fi->type == FD_TYPE_TIMER) {
+		struct ring *r;
+		SPA_ATOMIC_STORE(fi->value, 0);
+		spa_list_for_each(r, &impl->rings, link)
+			ring_discard(r, fd);
+	}
+	pthread_mutex_unlock(&impl->lock);
+
+	if (flags & SPA_FD_TIMER_ABSTIME)
+		fl |= TFD_TIMER_ABSTIME;
+	if (flags & SPA_FD_TIMER_CANCEL_ON_SET)
+		fl |= TFD_TIMER_CANCEL_ON_SET;
+	res = timerfd_settime(fd, fl, new_value, old_value);
+	return res < 0 ? -errno : res;
+}
+
+static int impl_timerfd_gettime(void *object,
+			int fd, struct itimerspec *curr_value)
+{
+	int res = timerfd_gettime(fd, curr_value);
+	return res < 0 ? -errno : res;
+}
+
+/* take the value that was read ahead. This is called for every wakeup of a
+ * data loop so it does not take the lock */
+static bool take_value(struct impl *impl, int fd, uint64_t *value)
+{
+	struct fd_info *fi;
+	uint64_t v;
+
+	if ((fi = get_fd_info(impl, fd, false)) == NULL)
+		return false;
+
+	if (fi->type == FD_TYPE_EVENT && fi->semaphore) {
+		v = SPA_ATOMIC_LOAD(fi->value);
+		do {
+			if (v == 0)
+				return false;
+		} while (!__atomic_compare_exchange_n(&fi->value, &v, v - 1,
+					false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+		*value = 1;
+	} else {
+		if ((v = SPA_ATOMIC_XCHG(fi->value, 0)) == 0)
+			return false;
+		*value = v;
+	}
+	return true;
+}
+
+static int impl_timerfd_read(void *object, int fd, uint64_t *expirations)
+{
+	if (take_value(object, fd, expirations))
+		return 0;
+	if (read(fd, expirations, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+/* events */
+static int impl_eventfd_create(void *object, int flags)
+{
+	struct impl *impl = object;
+	struct fd_info *fi;
+	int fl = 0, res;
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= EFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= EFD_NONBLOCK;
+	if (flags & SPA_FD_EVENT_SEMAPHORE)
+		fl |= EFD_SEMAPHORE;
+	if ((res = eventfd(0, fl)) < 0)
+		return -errno;
+
+	pthread_mutex_lock(&impl->lock);
+	if ((fi = get_fd_info(impl, res, true)) != NULL) {
+		fi->type = FD_TYPE_EVENT;
+		fi->semaphore = SPA_FLAG_IS_SET(flags, SPA_FD_EVENT_SEMAPHORE);
+	}
+	pthread_mutex_unlock(&impl->lock);
+
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+	return res;
+}
+
+static int impl_eventfd_write(void *object, int fd, uint64_t count)
+{
+	if (write(fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+static int impl_eventfd_read(void *object, int fd, uint64_t *count)
+{
+	if (take_value(object, fd, count))
+		return 0;
+	if (read(fd, count, sizeof(uint64_t)) != sizeof(uint64_t))
+		return -errno;
+	return 0;
+}
+
+/* signals */
+static int impl_signalfd_create(void *object, int signal, int flags)
+{
+	struct impl *impl = object;
+	sigset_t mask;
+	int res, fl = 0;
+
+	if (flags & SPA_FD_CLOEXEC)
+		fl |= SFD_CLOEXEC;
+	if (flags & SPA_FD_NONBLOCK)
+		fl |= SFD_NONBLOCK;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, signal);
+	res = signalfd(-1, &mask, fl);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	spa_log_debug(impl->log, "%p: new fd:%d", impl, res);
+
+	return res < 0 ? -errno : res;
+}
+
+static int impl_signalfd_read(void *object, int fd, int *signal)
+{
+	struct signalfd_siginfo signal_info;
+	int len;
+
+	len = read(fd, &signal_info, sizeof signal_info);
+	if (!(len == -1 && errno == EAGAIN) && len != sizeof signal_info)
+		return -errno;
+
+	*signal = signal_info.ssi_signo;
+
+	return 0;
+}
+
+static const struct spa_system_methods impl_system = {
+	SPA_VERSION_SYSTEM_METHODS,
+	.read = impl_read,
+	.write = impl_write,
+	.ioctl = impl_ioctl,
+	.close = impl_close,
+	.clock_gettime = impl_clock_gettime,
+	.clock_getres = impl_clock_getres,
+	.pollfd_create = impl_pollfd_create,
+	.pollfd_add = impl_pollfd_add,
+	.pollfd_mod = impl_pollfd_mod,
+	.pollfd_del = impl_pollfd_del,
+	.pollfd_wait = impl_pollfd_wait,
+	.timerfd_create = impl_timerfd_create,
+	.timerfd_settime = impl_timerfd_settime,
+	.timerfd_gettime = impl_timerfd_gettime,
+	.timerfd_read = impl_timerfd_read,
+	.eventfd_create = impl_eventfd_create,
+	.eventfd_write = impl_eventfd_write,
+	.eventfd_read = impl_eventfd_read,
+	.signalfd_create = impl_signalfd_create,
+	.signalfd_read = impl_signalfd_read,
+};
+
+static int impl_get_interface(struct spa_handle *handle, const char *type, void **interface)
+{
+	struct impl *impl;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+
+	if (spa_streq(type, SPA_TYPE_INTERFACE_System))
+		*interface = &impl->system;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *impl;
+	struct ring *r;
+	uint32_t i;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	impl = (struct impl *) handle;
+
+	spa_list_consume(r, &impl->rings, link) {
+		spa_list_remove(&r->link);
+		ring_free(r);
+	}
+	for (i = 0; i < MAX_FD_CHUNKS; i++)
+		free(impl->fds[i]);
+	pthread_mutex_destroy(&impl->lock);
+	return 0;
+}
+
+static size_t
+impl_get_size(const struct spa_handle_factory *factory,
+	      const struct spa_dict *params)
+{
+	return sizeof(struct impl);
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *impl;
+	const char *str;
+	int res;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	impl = (struct impl *) handle;
+	impl->system.iface = SPA_INTERFACE_INIT(
+			SPA_TYPE_INTERFACE_System,
+			SPA_VERSION_SYSTEM,
+			&impl_system, impl);
+
+	impl->log = spa_support_find(support, n_support, SPA_TYPE_INTERFACE_Log);
+	spa_log_topic_init(impl->log, &log_topic);
+
+	impl->entries = DEFAULT_ENTRIES;
+	impl->read_ahead = DEFAULT_READ_AHEAD;
+	if (info) {
+		if ((str = spa_dict_lookup(info, "uring.entries")) != NULL)
+			spa_atou32(str, &impl->entries, 0);
+		if ((str = spa_dict_lookup(info, "uring.read-ahead")) != NULL)
+			impl->read_ahead = spa_atob(str);
+	}
+
+	if ((res = pthread_mutex_init(&impl->lock, NULL)) != 0)
+		return -res;
+	spa_list_init(&impl->rings);
+
+	spa_log_debug(impl->log, "%p: initialized entries:%u read-ahead:%d", impl,
+			impl->entries, impl->read_ahead);
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE_INTERFACE_System,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info,
+			 uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	if (*index >= SPA_N_ELEMENTS(impl_interfaces))
+		return 0;
+
+	*info = &impl_interfaces[(*index)++];
+	return 1;
+}
+
+const struct spa_handle_factory spa_support_uring_system_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	SPA_NAME_SUPPORT_SYSTEM,
+	NULL,
+	impl_get_size,
+	impl_init,
+	impl_enum_interface_info
+};
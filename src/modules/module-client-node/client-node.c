@@ -34,6 +34,7 @@ PW_LOG_TOPIC_EXTERN(mod_topic);
 #define AREA_SLOT	(sizeof(struct spa_io_async_buffers))
 #define AREA_SIZE	(4096u / AREA_SLOT)
 #define MAX_AREAS	32
+#define PARAM_RING_SIZE	(64u * 1024u)
 
 #define CHECK_FREE_PORT(impl,d,p)	(p <= pw_map_get_size(&impl->ports[d]) && !CHECK_PORT(impl,d,p))
 #define CHECK_PORT(impl,d,p)		(pw_map_lookup(&impl->ports[d], p) != NULL)
@@ -115,6 +116,10 @@ struct impl {
 	struct pw_array io_areas;
 
 	struct pw_memblock *activation;
+	struct pw_memblock *param_ring;
+	uint32_t param_dropped;
+
+	unsigned int started:1;
 
 	struct spa_hook node_listener;
 	struct spa_hook resource_listener;
@@ -370,16 +375,63 @@ static int impl_node_enum_params(void *object, int seq,
 	return found ? 0 : -ENOENT;
 }
 
+/* Write the param in the param ring. The messages are aligned to 16 bytes and
+ * don't wrap around so that the client can use the params in place. */
+static int write_param_ring(struct impl *impl, uint32_t id, uint32_t flags,
+		const struct spa_pod *param)
+{
+	struct pw_node_param_ring *r = impl->param_ring->map->ptr;
+	struct pw_node_param_msg msg, skip_msg;
+	uint32_t index, offs, size, skip;
+	int32_t filled;
+
+	msg = (struct pw_node_param_msg) { id, flags, SPA_POD_SIZE(param), 0 };
+	size = sizeof(msg) + SPA_ROUND_UP_N(msg.size, sizeof(msg));
+
+	filled = spa_ringbuffer_get_write_index(&r->ring, &index);
+	offs = index & (PARAM_RING_SIZE - 1);
+	skip = offs + size > PARAM_RING_SIZE ? PARAM_RING_SIZE - offs : 0;
+
+	if (filled < 0 || filled + skip + size > PARAM_RING_SIZE)
+		return -ENOSPC;
+
+	if (skip > 0) {
+		skip_msg = (struct pw_node_param_msg) { SPA_ID_INVALID, 0, skip - sizeof(msg), 0 };
+		memcpy(SPA_PTROFF(r, sizeof(*r) + offs, void), &skip_msg, sizeof(skip_msg));
+		offs = 0;
+	}
+	memcpy(SPA_PTROFF(r, sizeof(*r) + offs, void), &msg, sizeof(msg));
+	memcpy(SPA_PTROFF(r, sizeof(*r) + offs + sizeof(msg), void), param, msg.size);
+
+	spa_ringbuffer_write_update(&r->ring, index + skip + size);
+	return 0;
+}
+
 static int impl_node_set_param(void *object, uint32_t id, uint32_t flags,
 			       const struct spa_pod *param)
 {
 	struct impl *impl = object;
+	int res;
 
 	spa_return_val_if_fail(impl != NULL, -EINVAL);
 
 	if (impl->resource == NULL)
 		return param == NULL ? 0 : -EIO;
 
+	/* the client sets the props of a running node from the data loop */
+	if (id == SPA_PARAM_Props && param != NULL && impl->param_ring != NULL &&
+	    impl->started && impl->this.node->info.state == PW_NODE_STATE_RUNNING) {
+		if ((res = write_param_ring(impl, id, flags, param)) < 0) {
+			if (impl->param_dropped++ == 0)
+				pw_log_warn("%p: can't write param in ring: %s", impl,
+						spa_strerror(res));
+		} else if (impl->param_dropped > 0) {
+			pw_log_warn("%p: dropped %u params", impl, impl->param_dropped);
+			impl->param_dropped = 0;
+		}
+		return res;
+	}
+
 	return pw_client_node_resource_set_param(impl->resource, id, flags, param);
 }
 
@@ -424,6 +476,7 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 {
 	struct impl *impl = object;
 	uint32_t id;
+	int res;
 
 	spa_return_val_if_fail(impl != NULL, -EINVAL);
 	spa_return_val_if_fail(command != NULL, -EINVAL);
@@ -435,6 +488,17 @@ static int impl_node_send_command(void *object, const struct spa_command *comman
 	if (impl->resource == NULL)
 		return -EIO;
 
+	switch (id) {
+	case SPA_NODE_COMMAND_Start:
+		res = pw_client_node_resource_command(impl->resource, command);
+		impl->started = res >= 0;
+		return res;
+	case SPA_NODE_COMMAND_Pause:
+	case SPA_NODE_COMMAND_Suspend:
+		/* the client sets the params in the ring when it stops */
+		impl->started = false;
+		break;
+	}
 	return pw_client_node_resource_command(impl->resource, command);
 }
 
@@ -1326,12 +1390,40 @@ static void node_peer_removed(void *data, struct pw_impl_node *peer)
 	pw_memblock_unref(m);
 }
 
+static int add_param_ring(struct impl *impl)
+{
+	struct pw_memblock *mem;
+	struct pw_node_param_ring *r;
+	size_t size;
+
+	size = sizeof(struct pw_node_param_ring) + PARAM_RING_SIZE;
+
+	mem = pw_mempool_alloc(impl->client_pool,
+			PW_MEMBLOCK_FLAG_READWRITE |
+			PW_MEMBLOCK_FLAG_SEAL |
+			PW_MEMBLOCK_FLAG_MAP,
+			SPA_DATA_MemFd, size);
+	if (mem == NULL)
+		return -errno;
+
+	r = mem->map->ptr;
+	spa_ringbuffer_init(&r->ring);
+	r->size = PARAM_RING_SIZE;
+	impl->param_ring = mem;
+
+	pw_log_debug("%p: param ring mem_id:%u size:%zu", impl, mem->id, size);
+
+	return pw_client_node_resource_set_io(impl->resource,
+			PW_CLIENT_NODE_IO_PARAM_RING, mem->id, 0, size);
+}
+
 void pw_impl_client_node_registered(struct pw_impl_client_node *this, struct pw_global *global)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 	struct pw_impl_node *node = this->node;
 	struct pw_impl_client *client = impl->client;
 	uint32_t node_id = global->id;
+	int res;
 
 	pw_log_debug("%p: %d", &impl->node, node_id);
 
@@ -1354,6 +1446,11 @@ void pw_impl_client_node_registered(struct pw_impl_client_node *this, struct pw_
 					  0,
 					  sizeof(struct pw_node_activation));
 
+	if (impl->resource->version >= 7 &&
+	    pw_properties_get_bool(node->properties, PW_KEY_NODE_PARAM_MAILBOX, false) &&
+	    (res = add_param_ring(impl)) < 0)
+		pw_log_warn("%p: can't add param ring: %s", &impl->node, spa_strerror(res));
+
 	if (impl->bind_node_id) {
 		pw_global_bind(global, client, PW_PERM_ALL,
 				impl->bind_node_version, impl->bind_node_id);
@@ -1425,6 +1522,8 @@ static void node_free(void *data)
 
 	if (impl->activation)
 		pw_memblock_free(impl->activation);
+	if (impl->param_ring)
+		pw_memblock_unref(impl->param_ring);
 
 	pw_array_for_each(area, &impl->io_areas) {
 		if (*area)
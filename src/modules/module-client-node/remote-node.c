@@ -118,7 +118,9 @@ static void clean_transport(struct node_data *data)
 		clear_link(data, l);
 
 	while ((mm = pw_mempool_find_tag(data->pool, tag, sizeof(uint32_t))) != NULL) {
-		if (mm->tag[1] == SPA_ID_INVALID)
+		if (mm->tag[1] == SPA_ID_INVALID && mm->tag[2] == PW_CLIENT_NODE_IO_PARAM_RING)
+			pw_impl_node_set_param_ring(node, NULL, 0);
+		else if (mm->tag[1] == SPA_ID_INVALID)
 			spa_node_set_io(node->node, mm->tag[2], NULL, 0);
 
 		pw_memmap_free(mm);
@@ -430,7 +432,10 @@ client_node_set_io(void *_data,
 	pw_log_debug("node %p: set io %s %p", proxy,
 			spa_debug_type_find_name(spa_type_io, id), ptr);
 
-	res =  pw_impl_node_set_io(node, id, ptr, size);
+	if (id == PW_CLIENT_NODE_IO_PARAM_RING)
+		res = pw_impl_node_set_param_ring(node, ptr, size);
+	else
+		res =  pw_impl_node_set_io(node, id, ptr, size);
 
 	pw_memmap_free(old);
 exit:
@@ -82,6 +82,8 @@ PW_LOG_TOPIC(mod_topic, "mod." NAME);
 #define TMP_BUFFER		(16 * 1024)
 #define DATA_BUFFER		(32 * 1024)
 #define FLUSH_BUFFER		(8 * 1024)
+#define MAX_FOLLOWERS		128u
+#define MAX_EDGES		512u
 
 int pw_protocol_native_ext_profiler_init(struct pw_context *context);
 
@@ -102,6 +104,20 @@ static const struct spa_dict_item module_props[] = {
 	{ PW_KEY_MODULE_VERSION, PACKAGE_VERSION },
 };
 
+struct follower {
+	uint32_t id;
+	uint32_t trigger;
+	uint64_t signal;
+	uint64_t finish;
+	int64_t slack;
+};
+
+/* a node that triggers another node, from a link */
+struct edge {
+	uint32_t output;
+	uint32_t input;
+};
+
 struct node {
 	struct spa_list link;
 	struct impl *impl;
@@ -116,6 +132,14 @@ struct node {
 
 	uint64_t last_profile_time;
 
+	uint32_t n_followers;
+	struct follower followers[MAX_FOLLOWERS];
+	uint32_t order[MAX_FOLLOWERS];
+
+	/* updated from the main thread with an invoke */
+	uint32_t n_edges;
+	struct edge edges[MAX_EDGES];
+
 	unsigned enabled:1;
 };
 
@@ -140,6 +164,10 @@ struct impl {
 	uint8_t *flush;
 	size_t flush_size;
 
+	uint32_t n_edges;
+	struct edge edges[MAX_EDGES];
+	unsigned int edges_changed:1;
+
 	uint32_t interval;
 };
 
@@ -150,6 +178,53 @@ struct resource_data {
 	struct spa_hook resource_listener;
 };
 
+static int do_update_edges(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct node *n = user_data;
+	n->n_edges = size / sizeof(struct edge);
+	memcpy(n->edges, data, size);
+	return 0;
+}
+
+/* Collect the links that make a node wait for another node in the same cycle
+ * and hand them to the data threads of the drivers. */
+static void update_edges(struct impl *impl)
+{
+	struct pw_impl_link *l;
+	struct node *n;
+	uint32_t i;
+
+	impl->n_edges = 0;
+	spa_list_for_each(l, &impl->context->link_list, link) {
+		struct edge e;
+
+		if (l->async || l->feedback || l->output == NULL || l->input == NULL)
+			continue;
+
+		e.output = l->output->node->info.id;
+		e.input = l->input->node->info.id;
+
+		for (i = 0; i < impl->n_edges; i++) {
+			if (impl->edges[i].output == e.output &&
+			    impl->edges[i].input == e.input)
+				break;
+		}
+		if (i < impl->n_edges)
+			continue;
+		if (impl->n_edges == MAX_EDGES) {
+			pw_log_warn("%p: too many links, slack is not accurate", impl);
+			break;
+		}
+		impl->edges[impl->n_edges++] = e;
+	}
+	spa_list_for_each(n, &impl->node_list, link) {
+		pw_loop_invoke(n->node->data_loop, do_update_edges, 0,
+				impl->edges, impl->n_edges * sizeof(struct edge), true, n);
+	}
+	impl->edges_changed = false;
+}
+
 static void do_flush_event(void *data, uint64_t count)
 {
 	struct impl *impl = data;
@@ -158,6 +233,9 @@ static void do_flush_event(void *data, uint64_t count)
 	uint32_t total = 0;
 	struct spa_pod_struct *p;
 
+	if (impl->edges_changed)
+		update_edges(impl);
+
 	p = (struct spa_pod_struct *)impl->flush;
 
 	spa_list_for_each(n, &impl->node_list, link) {
@@ -204,6 +282,76 @@ static void update_denom(struct spa_fraction *frac, uint32_t denom)
 	frac->denom = denom;
 }
 
+static uint32_t find_follower(struct node *n, uint32_t id)
+{
+	uint32_t i;
+	for (i = 0; i < n->n_followers; i++) {
+		if (n->followers[i].id == id)
+			return i;
+	}
+	return SPA_ID_INVALID;
+}
+
+/* Calculate the critical path of the cycle from the timestamps and the links
+ * between the followers.
+ *
+ * A follower is triggered when the last of the followers it is linked to
+ * finished. That one is reported as the trigger, followers without linked
+ * inputs in this cycle were started by the driver.
+ *
+ * The slack of a follower is how much later it could have finished without
+ * moving the end of the cycle. Followers that don't trigger other followers
+ * have the time until the end of the cycle. The others have, for every
+ * follower they trigger, the time until it was triggered plus its slack, and
+ * keep the smallest. A follower finishes before the followers it triggers,
+ * so we handle them from the last finished to the first. The critical path
+ * has a slack of 0. */
+static void calc_critical_path(struct node *n, uint32_t driver_id)
+{
+	struct follower *f = n->followers;
+	uint32_t i, j, k, n_followers = n->n_followers, *order = n->order;
+	uint64_t end = 0;
+
+	for (i = 0; i < n_followers; i++) {
+		f[i].trigger = SPA_ID_INVALID;
+		end = SPA_MAX(end, f[i].finish);
+
+		/* insert sorted on finish time, last finished first */
+		for (j = i; j > 0 && f[order[j - 1]].finish < f[i].finish; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+	for (k = 0; k < n_followers; k++) {
+		int64_t slack = INT64_MAX;
+		bool has_targets = false;
+
+		i = order[k];
+		for (j = 0; j < n->n_edges; j++) {
+			struct edge *e = &n->edges[j];
+			uint32_t t;
+
+			if (e->output == f[i].id) {
+				if ((t = find_follower(n, e->input)) == SPA_ID_INVALID ||
+				    f[t].signal < f[i].finish)
+					continue;
+				slack = SPA_MIN(slack, (int64_t)(f[t].signal - f[i].finish) + f[t].slack);
+				has_targets = true;
+			} else if (e->input == f[i].id) {
+				if ((t = find_follower(n, e->output)) == SPA_ID_INVALID ||
+				    f[t].finish > f[i].signal)
+					continue;
+				if (f[i].trigger == SPA_ID_INVALID ||
+				    f[t].finish > f[f[i].trigger].finish)
+					f[i].trigger = t;
+			}
+		}
+		f[i].slack = has_targets ? slack : (int64_t)(end - f[i].finish);
+	}
+	for (i = 0; i < n_followers; i++)
+		f[i].trigger = f[i].trigger == SPA_ID_INVALID ?
+			driver_id : f[f[i].trigger].id;
+}
+
 static void context_do_profile(void *data)
 {
 	struct node *n = data;
@@ -216,7 +364,7 @@ static void context_do_profile(void *data)
 	struct spa_io_position *pos = &a->position;
 	struct pw_node_target *t;
 	int32_t filled;
-	uint32_t idx, avail;
+	uint32_t i, idx, avail;
 
 	if (SPA_FLAG_IS_SET(pos->clock.flags, SPA_IO_CLOCK_FLAG_FREEWHEEL))
 		return;
@@ -226,6 +374,26 @@ static void context_do_profile(void *data)
 
 	n->last_profile_time = a->signal_time;
 
+	n->n_followers = 0;
+	spa_list_for_each(t, &node->rt.target_list, link) {
+		struct pw_node_activation *ta = t->activation;
+		struct follower *f;
+
+		/* skip async followers, they finished in the previous cycle, and
+		 * the followers that did not run in this cycle */
+		if (t->id == id || (t->node && t->node->async) ||
+		    ta->signal_time < a->signal_time || ta->finish_time < ta->signal_time)
+			continue;
+		if (n->n_followers == MAX_FOLLOWERS)
+			break;
+
+		f = &n->followers[n->n_followers++];
+		f->id = t->id;
+		f->signal = ta->signal_time;
+		f->finish = ta->finish_time;
+	}
+	calc_critical_path(n, id);
+
 	spa_pod_builder_init(&b, n->tmp, sizeof(n->tmp));
 	spa_pod_builder_push_object(&b, &f[0],
 			SPA_TYPE_OBJECT_Profiler, 0);
@@ -321,6 +489,13 @@ static void context_do_profile(void *data)
 				SPA_POD_Long(tpos->clock.xrun));
 		}
 	}
+	for (i = 0; i < n->n_followers; i++) {
+		spa_pod_builder_prop(&b, SPA_PROFILER_followerSlack, 0);
+		spa_pod_builder_add_struct(&b,
+			SPA_POD_Int(n->followers[i].id),
+			SPA_POD_Int(n->followers[i].trigger),
+			SPA_POD_Long(n->followers[i].slack));
+	}
 	spa_pod_builder_pop(&b, &f[0]);
 
 	if (b.state.offset > sizeof(n->tmp))
@@ -386,6 +561,7 @@ static void context_driver_added(void *data, struct pw_impl_node *node)
 	spa_list_append(&impl->node_list, &n->link);
 	spa_ringbuffer_init(&n->buffer);
 
+	impl->edges_changed = true;
 	if (impl->busy > 0)
 		enable_node_profiling(n, true);
 }
@@ -414,8 +590,17 @@ static void context_driver_removed(void *data, struct pw_impl_node *node)
 	free(n);
 }
 
+static void context_global_changed(void *data, struct pw_global *global)
+{
+	struct impl *impl = data;
+	if (pw_global_is_type(global, PW_TYPE_INTERFACE_Link))
+		impl->edges_changed = true;
+}
+
 static const struct pw_context_events context_events = {
 	PW_VERSION_CONTEXT_EVENTS,
+	.global_added = context_global_changed,
+	.global_removed = context_global_changed,
 	.driver_added = context_driver_added,
 	.driver_removed = context_driver_removed,
 };
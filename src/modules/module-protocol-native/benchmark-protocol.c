@@ -0,0 +1,471 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+#include <spa/param/audio/format.h>
+#include <spa/param/props.h>
+#include <spa/pod/builder.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+#define NODE_NAME	"benchmark-node"
+#define MAX_CLIENTS	16
+#define N_FORMATS	64
+#define N_FACTORIES	1000
+#define N_VOLUMES	64
+
+struct bench_node {
+	struct spa_node node;
+	struct spa_hook_list hooks;
+	struct spa_node_info info;
+	struct spa_param_info params[2];
+	uint64_t n_set;
+};
+
+struct data;
+
+struct client {
+	struct data *data;
+	struct pw_core *core;
+	struct spa_hook core_listener;
+	struct pw_registry *registry;
+	struct spa_hook registry_listener;
+	struct pw_node *node;
+	struct spa_hook node_listener;
+	int pending;
+	uint32_t todo;
+};
+
+struct data {
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct client clients[MAX_CLIENTS];
+	uint32_t n_clients;
+	uint32_t n_busy;
+	void (*step) (struct client *c);
+
+	uint64_t count;
+	uint64_t bytes;
+};
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static struct spa_pod *build_format(struct spa_pod_builder *b, uint32_t index)
+{
+	static const uint32_t formats[] = {
+		SPA_AUDIO_FORMAT_F32P, SPA_AUDIO_FORMAT_F32, SPA_AUDIO_FORMAT_F32_OE,
+		SPA_AUDIO_FORMAT_F64P, SPA_AUDIO_FORMAT_F64, SPA_AUDIO_FORMAT_F64_OE,
+		SPA_AUDIO_FORMAT_S32P, SPA_AUDIO_FORMAT_S32, SPA_AUDIO_FORMAT_S32_OE,
+		SPA_AUDIO_FORMAT_S24_32P, SPA_AUDIO_FORMAT_S24_32, SPA_AUDIO_FORMAT_S24_32_OE,
+		SPA_AUDIO_FORMAT_S24P, SPA_AUDIO_FORMAT_S24, SPA_AUDIO_FORMAT_S24_OE,
+		SPA_AUDIO_FORMAT_S16P, SPA_AUDIO_FORMAT_S16, SPA_AUDIO_FORMAT_S16_OE,
+		SPA_AUDIO_FORMAT_U8P, SPA_AUDIO_FORMAT_U8,
+	};
+	struct spa_pod_frame f[2];
+	uint32_t i, channels = index + 1, position[SPA_AUDIO_MAX_CHANNELS];
+
+	spa_pod_builder_push_object(b, &f[0], SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+	spa_pod_builder_add(b,
+			SPA_FORMAT_mediaType,      SPA_POD_Id(SPA_MEDIA_TYPE_audio),
+			SPA_FORMAT_mediaSubtype,   SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+			0);
+	spa_pod_builder_prop(b, SPA_FORMAT_AUDIO_format, 0);
+	spa_pod_builder_push_choice(b, &f[1], SPA_CHOICE_Enum, 0);
+	spa_pod_builder_id(b, formats[0]);
+	for (i = 0; i < SPA_N_ELEMENTS(formats); i++)
+		spa_pod_builder_id(b, formats[i]);
+	spa_pod_builder_pop(b, &f[1]);
+	spa_pod_builder_add(b,
+			SPA_FORMAT_AUDIO_rate,     SPA_POD_CHOICE_RANGE_Int(48000, 1, INT32_MAX),
+			SPA_FORMAT_AUDIO_channels, SPA_POD_Int(channels),
+			0);
+	for (i = 0; i < channels; i++)
+		position[i] = SPA_AUDIO_CHANNEL_START_Aux + i;
+	spa_pod_builder_prop(b, SPA_FORMAT_AUDIO_position, 0);
+	spa_pod_builder_array(b, sizeof(uint32_t), SPA_TYPE_Id, channels, position);
+
+	return spa_pod_builder_pop(b, &f[0]);
+}
+
+static int node_add_listener(void *object, struct spa_hook *listener,
+		const struct spa_node_events *events, void *data)
+{
+	struct bench_node *n = object;
+	struct spa_hook_list save;
+
+	spa_hook_list_isolate(&n->hooks, &save, listener, events, data);
+	spa_node_emit_info(&n->hooks, &n->info);
+	spa_hook_list_join(&n->hooks, &save);
+	return 0;
+}
+
+static int node_set_callbacks(void *object, const struct spa_node_callbacks *callbacks,
+		void *data)
+{
+	return 0;
+}
+
+static int node_sync(void *object, int seq)
+{
+	struct bench_node *n = object;
+	spa_node_emit_result(&n->hooks, seq, 0, 0, NULL);
+	return 0;
+}
+
+static int node_enum_params(void *object, int seq, uint32_t id,
+		uint32_t start, uint32_t num, const struct spa_pod *filter)
+{
+	struct bench_node *n = object;
+	struct spa_result_node_params result;
+	struct spa_pod_builder b;
+	uint8_t buffer[4096];
+	uint32_t count = 0;
+
+	if (id != SPA_PARAM_EnumFormat)
+		return -ENOENT;
+
+	result.id = id;
+	result.next = start;
+	while (result.next < N_FORMATS && count < num) {
+		result.index = result.next++;
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		result.param = build_format(&b, result.index);
+		spa_node_emit_result(&n->hooks, seq, 0, SPA_RESULT_TYPE_NODE_PARAMS, &result);
+		count++;
+	}
+	return 0;
+}
+
+static int node_set_param(void *object, uint32_t id, uint32_t flags,
+		const struct spa_pod *param)
+{
+	struct bench_node *n = object;
+	if (id != SPA_PARAM_Props)
+		return -ENOENT;
+	n->n_set++;
+	return 0;
+}
+
+static int node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int node_send_command(void *object, const struct spa_command *command)
+{
+	return 0;
+}
+
+static const struct spa_node_methods node_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = node_add_listener,
+	.set_callbacks = node_set_callbacks,
+	.sync = node_sync,
+	.enum_params = node_enum_params,
+	.set_param = node_set_param,
+	.set_io = node_set_io,
+	.send_command = node_send_command,
+};
+
+static void check_access(void *data, struct pw_impl_client *client)
+{
+	struct pw_permission permissions[1] = {
+		PW_PERMISSION_INIT(PW_ID_ANY, PW_PERM_ALL),
+	};
+	pw_impl_client_update_permissions(client, 1, permissions);
+}
+
+static const struct pw_context_events context_events = {
+	PW_VERSION_CONTEXT_EVENTS,
+	.check_access = check_access,
+};
+
+static void core_done(void *data, uint32_t id, int seq)
+{
+	struct client *c = data;
+	struct data *d = c->data;
+
+	if (id != PW_ID_CORE || seq != c->pending)
+		return;
+
+	if (--c->todo > 0)
+		d->step(c);
+	else if (--d->n_busy == 0)
+		pw_main_loop_quit(d->loop);
+}
+
+static const struct pw_core_events core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = core_done,
+};
+
+static void node_param(void *data, int seq, uint32_t id, uint32_t index, uint32_t next,
+		const struct spa_pod *param)
+{
+	struct client *c = data;
+	c->data->count++;
+	c->data->bytes += SPA_POD_SIZE(param);
+}
+
+static const struct pw_node_events node_events = {
+	PW_VERSION_NODE_EVENTS,
+	.param = node_param,
+};
+
+static void registry_global(void *data, uint32_t id, uint32_t permissions,
+		const char *type, uint32_t version, const struct spa_dict *props)
+{
+	struct client *c = data;
+	const struct spa_dict_item *it;
+
+	c->data->count++;
+	spa_dict_for_each(it, props)
+		c->data->bytes += strlen(it->key) + strlen(it->value) + 2;
+
+	if (c->node == NULL && spa_streq(type, PW_TYPE_INTERFACE_Node) &&
+	    spa_streq(spa_dict_lookup(props, PW_KEY_NODE_NAME), NODE_NAME)) {
+		c->node = pw_registry_bind(c->registry, id, type, PW_VERSION_NODE, 0);
+		pw_node_add_listener(c->node, &c->node_listener, &node_events, c);
+	}
+}
+
+static const struct pw_registry_events registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = registry_global,
+};
+
+static void registry_destroy(struct client *c)
+{
+	if (c->registry == NULL)
+		return;
+	spa_hook_remove(&c->registry_listener);
+	pw_proxy_destroy((struct pw_proxy*)c->registry);
+	c->registry = NULL;
+}
+
+static void step_sync(struct client *c)
+{
+	c->data->count++;
+	c->pending = pw_core_sync(c->core, PW_ID_CORE, 0);
+}
+
+static void step_registry(struct client *c)
+{
+	registry_destroy(c);
+	c->registry = pw_core_get_registry(c->core, PW_VERSION_REGISTRY, 0);
+	pw_registry_add_listener(c->registry, &c->registry_listener, &registry_events, c);
+	c->pending = pw_core_sync(c->core, PW_ID_CORE, 0);
+}
+
+static void step_enum_params(struct client *c)
+{
+	pw_node_enum_params(c->node, 0, SPA_PARAM_EnumFormat, 0, UINT32_MAX, NULL);
+	c->pending = pw_core_sync(c->core, PW_ID_CORE, 0);
+}
+
+static void step_set_param(struct client *c)
+{
+	struct spa_pod_builder b;
+	struct spa_pod *param;
+	uint8_t buffer[1024];
+	float volumes[N_VOLUMES];
+	uint32_t i;
+
+	for (i = 0; i < N_VOLUMES; i++)
+		volumes[i] = 1.0f / (i + 1);
+
+	for (i = 0; i < 64; i++) {
+		spa_pod_builder_init(&b, buffer, sizeof(buffer));
+		param = spa_pod_builder_add_object(&b,
+				SPA_TYPE_OBJECT_Props, SPA_PARAM_Props,
+				SPA_PROP_channelVolumes, SPA_POD_Array(sizeof(float),
+					SPA_TYPE_Float, N_VOLUMES, volumes));
+		pw_node_set_param(c->node, SPA_PARAM_Props, 0, param);
+		c->data->count++;
+		c->data->bytes += SPA_POD_SIZE(param);
+	}
+	c->pending = pw_core_sync(c->core, PW_ID_CORE, 0);
+}
+
+static void run(struct data *d, const char *name, void (*step) (struct client *c),
+		uint32_t n_clients, uint32_t repeat)
+{
+	uint64_t t1, t2, elapsed;
+	uint32_t i;
+
+	d->step = step;
+	d->count = d->bytes = 0;
+	d->n_busy = n_clients;
+
+	t1 = get_time();
+	for (i = 0; i < n_clients; i++) {
+		d->clients[i].todo = repeat;
+		step(&d->clients[i]);
+	}
+	pw_main_loop_run(d->loop);
+	t2 = get_time();
+
+	elapsed = SPA_MAX(t2 - t1, 1u);
+	fprintf(stderr, "%s %u clients: elapsed %"PRIu64" count %"PRIu64" = %"PRIu64"/sec "
+			"%"PRIu64" bytes/sec, round trip %"PRIu64" nsec\n",
+			name, n_clients, elapsed, d->count,
+			d->count * (uint64_t)SPA_NSEC_PER_SEC / elapsed,
+			d->bytes * (uint64_t)SPA_NSEC_PER_SEC / elapsed,
+			elapsed / repeat);
+}
+
+static void connect_clients(struct data *d, uint32_t n_clients)
+{
+	struct spa_dict_item items[2];
+	uint32_t i;
+
+	items[0] = SPA_DICT_ITEM_INIT(PW_REGISTRY_FILTER_TYPES, PW_TYPE_INTERFACE_Node);
+	items[1] = SPA_DICT_ITEM_INIT(PW_KEY_NODE_NAME, NODE_NAME);
+
+	for (i = d->n_clients; i < n_clients; i++) {
+		struct client *c = &d->clients[i];
+
+		c->data = d;
+		c->core = pw_context_connect(d->context,
+				pw_properties_new(
+					PW_KEY_REMOTE_NAME, "benchmark-protocol",
+					NULL), 0);
+		if (c->core == NULL) {
+			fprintf(stderr, "can't connect: %m\n");
+			exit(EXIT_FAILURE);
+		}
+		pw_core_add_listener(c->core, &c->core_listener, &core_events, c);
+
+		c->registry = pw_core_get_registry_filtered(c->core, PW_VERSION_REGISTRY,
+				&SPA_DICT_INIT(items, 2), 0);
+		pw_registry_add_listener(c->registry, &c->registry_listener, &registry_events, c);
+	}
+	run(d, "connect", step_sync, n_clients, 1);
+
+	for (i = d->n_clients; i < n_clients; i++) {
+		registry_destroy(&d->clients[i]);
+		if (d->clients[i].node == NULL) {
+			fprintf(stderr, "node not found\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	d->n_clients = n_clients;
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t n_clients[] = { 1, 4, MAX_CLIENTS };
+	struct data data = { 0, };
+	struct pw_thread_loop *server_loop;
+	struct pw_context *server;
+	struct pw_impl_node *node;
+	struct bench_node impl = { 0, };
+	struct spa_hook context_listener;
+	char runtime_dir[] = "/tmp/pw-benchmark-XXXXXX";
+	uint32_t i, j;
+
+	pw_init(&argc, &argv);
+
+	if (mkdtemp(runtime_dir) == NULL) {
+		fprintf(stderr, "can't create runtime dir: %m\n");
+		return EXIT_FAILURE;
+	}
+	setenv("PIPEWIRE_RUNTIME_DIR", runtime_dir, 1);
+
+	server_loop = pw_thread_loop_new("benchmark-server", NULL);
+	server = pw_context_new(pw_thread_loop_get_loop(server_loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				PW_KEY_CORE_NAME, "benchmark-protocol",
+				PW_KEY_CORE_DAEMON, "true",
+				"support.dbus", "false",
+				NULL), 0);
+	if (server == NULL ||
+	    pw_context_load_module(server, "libpipewire-module-protocol-native", NULL, NULL) == NULL) {
+		fprintf(stderr, "can't create server: %m\n");
+		return EXIT_FAILURE;
+	}
+	pw_context_add_listener(server, &context_listener, &context_events, NULL);
+
+	for (i = 0; i < N_FACTORIES; i++) {
+		struct pw_impl_factory *factory;
+		factory = pw_context_create_factory(server, "benchmark-factory",
+				PW_TYPE_INTERFACE_Node, PW_VERSION_NODE,
+				pw_properties_new(
+					PW_KEY_MODULE_ID, "1",
+					PW_KEY_FACTORY_USAGE, "A factory for the benchmark",
+					NULL), 0);
+		pw_impl_factory_register(factory, NULL);
+	}
+
+	impl.node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE, &node_methods, &impl);
+	spa_hook_list_init(&impl.hooks);
+	impl.params[0] = SPA_PARAM_INFO(SPA_PARAM_EnumFormat, SPA_PARAM_INFO_READ);
+	impl.params[1] = SPA_PARAM_INFO(SPA_PARAM_Props, SPA_PARAM_INFO_READWRITE);
+	impl.info = SPA_NODE_INFO_INIT();
+	impl.info.change_mask = SPA_NODE_CHANGE_MASK_PARAMS;
+	impl.info.params = impl.params;
+	impl.info.n_params = SPA_N_ELEMENTS(impl.params);
+
+	node = pw_context_create_node(server,
+			pw_properties_new(
+				PW_KEY_NODE_NAME, NODE_NAME,
+				NULL), 0);
+	pw_impl_node_set_implementation(node, &impl.node);
+	pw_impl_node_register(node, NULL);
+
+	pw_thread_loop_start(server_loop);
+
+	data.loop = pw_main_loop_new(NULL);
+	data.context = pw_context_new(pw_main_loop_get_loop(data.loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				"support.dbus", "false",
+				NULL), 0);
+	pw_context_load_module(data.context, "libpipewire-module-protocol-native", NULL, NULL);
+
+	for (i = 0; i < SPA_N_ELEMENTS(n_clients); i++) {
+		connect_clients(&data, n_clients[i]);
+
+		run(&data, "sync", step_sync, n_clients[i], 10000);
+		run(&data, "registry", step_registry, n_clients[i], 20);
+		for (j = 0; j < data.n_clients; j++)
+			registry_destroy(&data.clients[j]);
+		run(&data, "enum_params", step_enum_params, n_clients[i], 200);
+		run(&data, "set_param", step_set_param, n_clients[i], 200);
+	}
+
+	for (i = 0; i < data.n_clients; i++) {
+		spa_hook_remove(&data.clients[i].node_listener);
+		pw_proxy_destroy((struct pw_proxy*)data.clients[i].node);
+		pw_core_disconnect(data.clients[i].core);
+	}
+	pw_context_destroy(data.context);
+	pw_main_loop_destroy(data.loop);
+
+	pw_thread_loop_stop(server_loop);
+	pw_context_destroy(server);
+	pw_thread_loop_destroy(server_loop);
+
+	rmdir(runtime_dir);
+
+	pw_deinit();
+
+	return 0;
+}
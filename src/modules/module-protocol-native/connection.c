@@ -28,6 +28,7 @@ PW_LOG_TOPIC_EXTERN(mod_topic_connection);
 #include "defs.h"
 
 #define MAX_BUFFER_SIZE (1024 * 32)
+#define FLUSH_WATERMARK (MAX_BUFFER_SIZE * 4)
 #define MAX_FDS 1024u
 #define MAX_FDS_MSG 28
 
@@ -139,7 +140,10 @@ static void *connection_ensure_size(struct pw_protocol_native_connection *conn,
 		void *np;
 		size_t ns;
 
-		ns = SPA_ROUND_UP_N(buf->buffer_size + size, MAX_BUFFER_SIZE);
+		/* grow exponentially so that large bursts of messages don't
+		 * realloc for each message */
+		ns = SPA_ROUND_UP_N(SPA_MAX(buf->buffer_size + size, buf->buffer_maxsize * 2),
+				MAX_BUFFER_SIZE);
 		np = realloc(buf->buffer_data, ns);
 		if (np == NULL) {
 			res = -errno;
@@ -159,6 +163,19 @@ static void *connection_ensure_size(struct pw_protocol_native_connection *conn,
 	return (uint8_t *) buf->buffer_data + buf->buffer_size;
 }
 
+/* the out buffer has the unsent data from offset to buffer_size, the
+ * message that is being built follows it */
+static void *out_ensure_size(struct pw_protocol_native_connection *conn, struct buffer *buf, size_t size)
+{
+	if (buf->buffer_size + size > buf->buffer_maxsize && buf->offset > 0) {
+		size_t end = SPA_MIN(buf->buffer_size + size, buf->buffer_maxsize);
+		memmove(buf->buffer_data, buf->buffer_data + buf->offset, end - buf->offset);
+		buf->buffer_size -= buf->offset;
+		buf->offset = 0;
+	}
+	return connection_ensure_size(conn, buf, size);
+}
+
 static void handle_connection_error(struct pw_protocol_native_connection *conn, int res)
 {
 	if (res == EPIPE || res == ECONNRESET)
@@ -645,7 +662,7 @@ static inline void *begin_write(struct pw_protocol_native_connection *conn, uint
 	uint32_t *p;
 	struct buffer *buf = &impl->out;
 	/* header and size for payload */
-	if ((p = connection_ensure_size(conn, buf, impl->hdr_size + size)) == NULL)
+	if ((p = out_ensure_size(conn, buf, impl->hdr_size + size)) == NULL)
 		return NULL;
 
 	return SPA_PTROFF(p, impl->hdr_size, void);
@@ -702,7 +719,7 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 	struct buffer *buf = &impl->out;
 	int res;
 
-	if ((p = connection_ensure_size(conn, buf, impl->hdr_size + size)) == NULL)
+	if ((p = out_ensure_size(conn, buf, impl->hdr_size + size)) == NULL)
 		return -errno;
 
 	p[0] = buf->msg.id;
@@ -731,6 +748,11 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 	buf->seq = (buf->seq + 1) & SPA_ASYNC_SEQ_MASK;
 	res = SPA_RESULT_RETURN_ASYNC(buf->msg.seq);
 
+	/* don't let large bursts pile up, write out what we have and let the
+	 * other side start reading. Errors are reported by the next flush. */
+	if (buf->buffer_size - buf->offset >= FLUSH_WATERMARK)
+		pw_protocol_native_connection_flush(conn);
+
 	spa_hook_list_call(&conn->listener_list,
 			struct pw_protocol_native_connection_events, need_flush, 0);
 
@@ -764,8 +786,8 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 	size_t size;
 
 	buf = &impl->out;
-	data = buf->buffer_data;
-	size = buf->buffer_size;
+	data = buf->buffer_data + buf->offset;
+	size = buf->buffer_size - buf->offset;
 	fds = buf->fds;
 	n_fds = buf->n_fds;
 	to_close = 0;
@@ -825,9 +847,12 @@ int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *co
 	res = 0;
 
 exit:
+	/* keep the unsent data in place, it is moved when the buffer needs
+	 * to make room for new messages */
 	if (size > 0)
-		memmove(buf->buffer_data, data, size);
-	buf->buffer_size = size;
+		buf->offset = buf->buffer_size - size;
+	else
+		buf->buffer_size = buf->offset = 0;
 	for (i = 0; i < to_close; i++) {
 		pw_log_debug("%p: close fd:%d", conn, buf->fds[i]);
 		close(buf->fds[i]);
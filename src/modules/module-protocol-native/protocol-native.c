@@ -7,9 +7,11 @@
 
 #include <spa/pod/builder.h>
 #include <spa/pod/parser.h>
+#include <spa/utils/atomic.h>
 #include <spa/utils/result.h>
 
 #include <pipewire/impl.h>
+#include <pipewire/private.h>
 #include <pipewire/extensions/protocol-native.h>
 #include <pipewire/extensions/security-context.h>
 
@@ -121,6 +123,27 @@ static inline void push_item(struct spa_pod_builder *b, const struct spa_dict_it
 	spa_pod_builder_string(b, str);
 }
 
+/* like push_dict but removed keys, with a NULL value, are sent as None */
+static void push_delta_dict(struct spa_pod_builder *b, const struct spa_dict *dict)
+{
+	uint32_t i, n_items;
+	struct spa_pod_frame f;
+
+	n_items = dict ? dict->n_items : 0;
+
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_builder_int(b, n_items);
+	for (i = 0; i < n_items; i++) {
+		if (dict->items[i].value == NULL) {
+			spa_pod_builder_string(b, dict->items[i].key);
+			spa_pod_builder_none(b);
+		} else {
+			push_item(b, &dict->items[i]);
+		}
+	}
+	spa_pod_builder_pop(b, &f);
+}
+
 static void push_dict(struct spa_pod_builder *b, const struct spa_dict *dict)
 {
 	uint32_t i, n_items;
@@ -135,6 +158,38 @@ static void push_dict(struct spa_pod_builder *b, const struct spa_dict *dict)
 	spa_pod_builder_pop(b, &f);
 }
 
+static struct pw_registry * core_method_marshal_get_registry_filtered(void *object,
+		uint32_t version, const struct spa_dict *filter, size_t user_data_size)
+{
+	struct pw_proxy *proxy = object;
+	struct spa_pod_builder *b;
+	struct spa_pod_frame f;
+	struct pw_proxy *res;
+	uint32_t new_id;
+
+	res = pw_proxy_new(object, PW_TYPE_INTERFACE_Registry, version, user_data_size);
+	if (res == NULL)
+		return NULL;
+
+	new_id = pw_proxy_get_id(res);
+
+	b = pw_protocol_native_begin_proxy(proxy, PW_CORE_METHOD_GET_REGISTRY, NULL);
+
+	/* the filter is appended to the GetRegistry message, older servers
+	 * ignore it and list all globals */
+	spa_pod_builder_push_struct(b, &f);
+	spa_pod_builder_add(b,
+			SPA_POD_Int(version),
+			SPA_POD_Int(new_id),
+			NULL);
+	push_dict(b, filter);
+	spa_pod_builder_pop(b, &f);
+
+	pw_protocol_native_end_proxy(proxy, b);
+
+	return (struct pw_registry *) res;
+}
+
 static inline int parse_item(struct spa_pod_parser *prs, struct spa_dict_item *item)
 {
 	int res;
@@ -665,15 +720,25 @@ static int core_method_demarshal_get_registry(void *object, const struct pw_prot
 {
 	struct pw_resource *resource = object;
 	struct spa_pod_parser prs;
+	struct spa_pod_frame f[2];
 	int32_t version, new_id;
+	struct spa_dict filter = SPA_DICT_INIT(NULL, 0);
 
 	spa_pod_parser_init(&prs, msg->data, msg->size);
-	if (spa_pod_parser_get_struct(&prs,
+	if (spa_pod_parser_push_struct(&prs, &f[0]) < 0 ||
+	    spa_pod_parser_get(&prs,
 				SPA_POD_Int(&version),
-				SPA_POD_Int(&new_id)) < 0)
+				SPA_POD_Int(&new_id), NULL) < 0)
 		return -EINVAL;
 
-	return pw_resource_notify(resource, struct pw_core_methods, get_registry, 0, version, new_id);
+	if (spa_pod_parser_current(&prs) == NULL)
+		return pw_resource_notify(resource, struct pw_core_methods, get_registry, 0,
+				version, new_id);
+
+	parse_dict_struct(&prs, &f[1], &filter);
+
+	return pw_resource_notify(resource, struct pw_core_methods, get_registry_filtered, 1,
+			version, &filter, new_id);
 }
 
 static int core_method_demarshal_create_object(void *object, const struct pw_protocol_native_message *msg)
@@ -775,6 +840,24 @@ static void registry_marshal_global_remove(void *data, uint32_t id)
 	pw_protocol_native_end_resource(resource, b);
 }
 
+static void registry_marshal_snapshot(void *data, uint32_t mem_id, uint32_t offset,
+		uint32_t size, uint64_t serial, uint32_t permissions)
+{
+	struct pw_resource *resource = data;
+	struct spa_pod_builder *b;
+
+	b = pw_protocol_native_begin_resource(resource, PW_REGISTRY_EVENT_SNAPSHOT, NULL);
+
+	spa_pod_builder_add_struct(b,
+			SPA_POD_Int(mem_id),
+			SPA_POD_Int(offset),
+			SPA_POD_Int(size),
+			SPA_POD_Long(serial),
+			SPA_POD_Int(permissions));
+
+	pw_protocol_native_end_resource(resource, b);
+}
+
 static int registry_demarshal_bind(void *object, const struct pw_protocol_native_message *msg)
 {
 	struct pw_resource *resource = object;
@@ -1140,7 +1223,10 @@ static void node_marshal_info(void *data, const struct pw_node_info *info)
 			    SPA_POD_Id(info->state),
 			    SPA_POD_String(info->error),
 			    NULL);
-	push_dict(b, info->change_mask & PW_NODE_CHANGE_MASK_PROPS ? info->props : NULL);
+	if (resource->version >= 4)
+		push_delta_dict(b, info->change_mask & PW_NODE_CHANGE_MASK_PROPS ? info->props : NULL);
+	else
+		push_dict(b, info->change_mask & PW_NODE_CHANGE_MASK_PROPS ? info->props : NULL);
 	push_params(b, info->n_params, info->params);
 	spa_pod_builder_pop(b, &f);
 
@@ -1171,6 +1257,17 @@ static int node_demarshal_info(void *data, const struct pw_protocol_native_messa
 	parse_dict_struct(&prs, &f[1], &props);
 	parse_params_struct(&prs, &f[1], info.params, info.n_params);
 
+	/* since version 4 we only receive the changed properties, merge them
+	 * so that the listeners see all properties */
+	if (proxy->version >= 4 &&
+	    (info.change_mask & PW_NODE_CHANGE_MASK_PROPS)) {
+		if (proxy->info_props == NULL &&
+		    (proxy->info_props = pw_properties_new(NULL, NULL)) == NULL)
+			return -errno;
+		pw_properties_update(proxy->info_props, &props);
+		info.props = &proxy->info_props->dict;
+	}
+
 	return pw_proxy_notify(proxy, struct pw_node_events, info, 0, &info);
 }
 
@@ -1838,6 +1935,69 @@ static int registry_demarshal_global_remove(void *data, const struct pw_protocol
 	return pw_proxy_notify(proxy, struct pw_registry_events, global_remove, 0, id);
 }
 
+static int registry_demarshal_snapshot_global(struct pw_proxy *proxy,
+		struct spa_pod_parser *prs, uint32_t permissions)
+{
+	struct spa_pod_frame f[2];
+	uint32_t id, mask, version;
+	char *type;
+	struct spa_dict props = SPA_DICT_INIT(NULL, 0);
+
+	if (spa_pod_parser_push_struct(prs, &f[0]) < 0 ||
+	    spa_pod_parser_get(prs,
+			SPA_POD_Int(&id),
+			SPA_POD_Int(&mask),
+			SPA_POD_String(&type),
+			SPA_POD_Int(&version), NULL) < 0)
+		return -EINVAL;
+
+	parse_dict_struct(prs, &f[1], &props);
+	spa_pod_parser_pop(prs, &f[0]);
+
+	return pw_proxy_notify(proxy, struct pw_registry_events,
+			global, 0, id, permissions & mask, type, version, &props);
+}
+
+static int registry_demarshal_snapshot(void *data, const struct pw_protocol_native_message *msg)
+{
+	struct pw_proxy *proxy = data;
+	struct spa_pod_parser prs;
+	struct pw_memmap *mm;
+	uint32_t mem_id, offset, size, permissions;
+	int64_t serial;
+	int res = 0;
+
+	spa_pod_parser_init(&prs, msg->data, msg->size);
+	if (spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&mem_id),
+				SPA_POD_Int(&offset),
+				SPA_POD_Int(&size),
+				SPA_POD_Long(&serial),
+				SPA_POD_Int(&permissions)) < 0)
+		return -EINVAL;
+
+	mm = pw_mempool_map_id(pw_core_get_mempool(proxy->core), mem_id,
+			PW_MEMMAP_FLAG_READ, offset, size, NULL);
+	if (mm == NULL)
+		return -errno;
+
+	pw_log_debug("%p: snapshot mem:%u size:%u serial:%" PRIi64, proxy,
+			mem_id, size, serial);
+
+	/* the listeners can destroy the registry */
+	pw_proxy_ref(proxy);
+	spa_pod_parser_init(&prs, mm->ptr, size);
+	while (spa_pod_parser_current(&prs) != NULL && !proxy->destroyed) {
+		if ((res = registry_demarshal_snapshot_global(proxy, &prs,
+						permissions)) < 0)
+			break;
+	}
+	pw_proxy_unref(proxy);
+
+	pw_memmap_free(mm);
+	return res;
+}
+
 static void * registry_marshal_bind(void *object, uint32_t id,
 				  const char *type, uint32_t version, size_t user_data_size)
 {
@@ -1943,6 +2103,7 @@ static const struct pw_core_methods pw_protocol_native_core_method_marshal = {
 	.get_registry = &core_method_marshal_get_registry,
 	.create_object = &core_method_marshal_create_object,
 	.destroy = &core_method_marshal_destroy,
+	.get_registry_filtered = &core_method_marshal_get_registry_filtered,
 };
 
 static const struct pw_protocol_native_demarshal pw_protocol_native_core_method_demarshal[PW_CORE_METHOD_NUM] = {
@@ -2014,13 +2175,15 @@ static const struct pw_registry_events pw_protocol_native_registry_event_marshal
 	PW_VERSION_REGISTRY_EVENTS,
 	.global = &registry_marshal_global,
 	.global_remove = &registry_marshal_global_remove,
+	.snapshot = &registry_marshal_snapshot,
 };
 
 static const struct pw_protocol_native_demarshal
 pw_protocol_native_registry_event_demarshal[PW_REGISTRY_EVENT_NUM] =
 {
 	[PW_REGISTRY_EVENT_GLOBAL] = { &registry_demarshal_global, 0, },
-	[PW_REGISTRY_EVENT_GLOBAL_REMOVE] = { &registry_demarshal_global_remove, 0, }
+	[PW_REGISTRY_EVENT_GLOBAL_REMOVE] = { &registry_demarshal_global_remove, 0, },
+	[PW_REGISTRY_EVENT_SNAPSHOT] = { &registry_demarshal_snapshot, 0, },
 };
 
 static const struct pw_protocol_marshal pw_protocol_native_registry_marshal = {
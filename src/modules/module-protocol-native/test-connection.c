@@ -165,6 +165,50 @@ static void test_reentering(struct pw_protocol_native_connection *in,
 	}
 }
 
+static void test_large(struct pw_protocol_native_connection *in,
+		struct pw_protocol_native_connection *out)
+{
+	const struct pw_protocol_native_message *msg;
+	struct spa_pod_builder *b;
+	struct spa_pod_parser prs;
+	static uint8_t data[4000];
+	const void *val;
+	uint32_t i, j, len, v_int, n_msgs = 1000;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i;
+
+	/* more than fits in the socket, some of it is written while the
+	 * messages are added and the rest is kept until the next flush */
+	for (i = 0; i < n_msgs; i++) {
+		b = pw_protocol_native_connection_begin(out, 1, 6, NULL);
+		spa_assert_se(b != NULL);
+		spa_pod_builder_add_struct(b,
+				SPA_POD_Int(i),
+				SPA_POD_Bytes(data, sizeof(data) - i));
+		spa_assert_se(pw_protocol_native_connection_end(out, b) >= 0);
+	}
+
+	for (i = 0; i < n_msgs; i++) {
+		int res = pw_protocol_native_connection_flush(out);
+		spa_assert_se(res == 0 || res == -EAGAIN);
+
+		spa_assert_se(pw_protocol_native_connection_get_next(in, &msg) == 1);
+		spa_assert_se(msg->id == 1);
+		spa_assert_se(msg->opcode == 6);
+
+		spa_pod_parser_init(&prs, msg->data, msg->size);
+		spa_assert_se(spa_pod_parser_get_struct(&prs,
+				SPA_POD_Int(&v_int),
+				SPA_POD_Bytes(&val, &len)) >= 0);
+		spa_assert_se(v_int == i);
+		spa_assert_se(len == sizeof(data) - i);
+		for (j = 0; j < len; j++)
+			spa_assert_se(((const uint8_t*)val)[j] == data[j]);
+	}
+	spa_assert_se(pw_protocol_native_connection_flush(out) == 0);
+}
+
 int main(int argc, char *argv[])
 {
 	struct pw_main_loop *loop;
@@ -195,6 +239,7 @@ int main(int argc, char *argv[])
 	test_create(out);
 	test_read_write(in, out);
 	test_reentering(in, out);
+	test_large(in, out);
 
 	pw_protocol_native_connection_destroy(in);
 	pw_protocol_native_connection_destroy(out);
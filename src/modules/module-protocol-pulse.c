@@ -67,6 +67,10 @@
  *     ]
  *     #server.dbus-name       = "org.pulseaudio.Server"
  *     #pulse.allow-module-loading = true
+ *     #pulse.enable-shm       = true
+ *     #pulse.enable-memfd     = true
+ *     #pulse.enable-posix-shm = false
+ *     #pulse.io-thread        = true
  *     #pulse.min.req          = 256/48000     # 5.3ms
  *     #pulse.default.req      = 960/48000     # 20 milliseconds
  *     #pulse.min.frag         = 256/48000     # 5.3ms
@@ -137,6 +141,28 @@
  * By default, clients are allowed to load and unload modules. You can disable this
  * feature with this option.
  *
+ *\code{.unparsed}
+ *     pulse.enable-shm = true
+ *     pulse.enable-memfd = true
+ *     pulse.enable-posix-shm = false
+ *\endcode
+ *
+ * Local clients of the same user can pass their audio data in shared memory
+ * instead of writing it to the socket. The data in sealed memfd segments is
+ * used in place, other segments are copied. POSIX shared memory is opened by a
+ * name that other processes can guess and is only used for clients without
+ * memfd support when pulse.enable-posix-shm is set. These options disable
+ * shared memory or only the memfd segments, or enable POSIX shared memory.
+ *
+ *\code{.unparsed}
+ *     pulse.io-thread = true
+ *\endcode
+ *
+ * Client sockets and stream data are handled in a separate thread so that a busy
+ * main loop does not delay the audio or the latency queries of the clients. The
+ * other requests are still handled in the main loop. Set this to false to handle
+ * everything in the main loop.
+ *
  * ### Playback buffering options
  *
  *\code{.unparsed}
@@ -2,15 +2,24 @@
 /* SPDX-FileCopyrightText: Copyright © 2020 Wim Taymans */
 /* SPDX-License-Identifier: MIT */
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
 
 #include <spa/utils/defs.h>
 #include <spa/utils/hook.h>
 #include <spa/utils/list.h>
+#include <spa/utils/result.h>
+#include <spa/utils/string.h>
 #include <pipewire/core.h>
 #include <pipewire/log.h>
 #include <pipewire/loop.h>
@@ -26,6 +35,7 @@
 #include "message.h"
 #include "operation.h"
 #include "pending-sample.h"
+#include "sample-play.h"
 #include "server.h"
 #include "stream.h"
 
@@ -44,11 +54,14 @@ struct client *client_new(struct server *server)
 	client->server = server;
 	client->impl = server->impl;
 	client->connect_tag = SPA_ID_INVALID;
+	client->uid = (uid_t) -1;
+	client->info_serial = 1;
 
 	pw_map_init(&client->streams, 16, 16);
 	spa_list_init(&client->out_messages);
 	spa_list_init(&client->operations);
 	spa_list_init(&client->pending_samples);
+	spa_list_init(&client->sample_mixers);
 	spa_hook_list_init(&client->listener_list);
 
 	spa_list_append(&server->clients, &client->link);
@@ -107,14 +120,17 @@ void client_disconnect(struct client *client)
 	/* the client must be detached from the server to disconnect */
 	spa_assert(client->server == NULL);
 
+	/* stop the I/O first, the streams can then be freed without the
+	 * io thread touching them */
+	pw_loop_lock(impl->io_loop);
 	client->disconnect = true;
-
-	pw_map_for_each(&client->streams, client_free_stream, client);
-
 	if (client->source) {
-		pw_loop_destroy_source(impl->main_loop, client->source);
+		pw_loop_destroy_source(impl->io_loop, client->source);
 		client->source = NULL;
 	}
+	pw_loop_unlock(impl->io_loop);
+
+	pw_map_for_each(&client->streams, client_free_stream, client);
 
 	if (client->manager) {
 		pw_manager_destroy(client->manager);
@@ -126,8 +142,10 @@ void client_free(struct client *client)
 {
 	struct impl *impl = client->impl;
 	struct pending_sample *p;
+	struct sample_mixer *sm;
 	struct message *msg;
 	struct operation *o;
+	uint32_t i;
 
 	pw_log_debug("client %p: free", client);
 
@@ -140,6 +158,9 @@ void client_free(struct client *client)
 	spa_list_consume(p, &client->pending_samples, link)
 		pending_sample_free(p);
 
+	spa_list_consume(sm, &client->sample_mixers, link)
+		sample_mixer_destroy(sm);
+
 	if (client->message)
 		message_free(client->message, false, false);
 
@@ -149,6 +170,15 @@ void client_free(struct client *client)
 	spa_list_consume(o, &client->operations, link)
 		operation_free(o);
 
+	client_close_fds(client);
+	for (i = 0; i < client->n_shm_segments; i++) {
+		struct shm_segment *seg = &client->shm_segments[i];
+		if (seg->data != NULL)
+			munmap(seg->data, seg->size);
+		if (seg->fd >= 0)
+			close(seg->fd);
+	}
+
 	if (client->core)
 		pw_core_disconnect(client->core);
 
@@ -188,12 +218,13 @@ int client_queue_message(struct client *client, struct message *msg)
 	if (msg == NULL)
 		return -EINVAL;
 
-	if (client->disconnect) {
+	pw_loop_lock(impl->io_loop);
+	if (client->disconnect || client->source == NULL) {
 		res = -ENOTCONN;
 		goto error;
 	}
 
-	if (msg->length == 0) {
+	if (msg->length == 0 && msg->type != MESSAGE_TYPE_SHM_RELEASE) {
 		res = 0;
 		goto error;
 	} else if (msg->length > msg->allocated) {
@@ -207,18 +238,57 @@ int client_queue_message(struct client *client, struct message *msg)
 	uint32_t mask = client->source->mask;
 	if (!SPA_FLAG_IS_SET(mask, SPA_IO_OUT)) {
 		SPA_FLAG_SET(mask, SPA_IO_OUT);
-		pw_loop_update_io(impl->main_loop, client->source, mask);
+		pw_loop_update_io(impl->io_loop, client->source, mask);
 	}
 
 	client->new_msg_since_last_flush = true;
+	pw_loop_unlock(impl->io_loop);
 
 	return 0;
 
 error:
 	message_free(msg, false, false);
+	pw_loop_unlock(impl->io_loop);
 	return res;
 }
 
+static ssize_t send_data(struct client *client, struct message *m, const void *data, size_t size)
+{
+#ifdef SCM_CREDENTIALS
+	if (m->type == MESSAGE_TYPE_CREDENTIALS && client->out_index == 0) {
+		/* libpulse only uses SHM when the server runs as the same user */
+		union {
+			struct cmsghdr hdr;
+			uint8_t buf[CMSG_SPACE(sizeof(struct ucred))];
+		} ctrl;
+		struct iovec iov = {
+			.iov_base = (void *) data,
+			.iov_len = size,
+		};
+		struct msghdr msg = {
+			.msg_iov = &iov,
+			.msg_iovlen = 1,
+			.msg_control = &ctrl,
+			.msg_controllen = sizeof(ctrl),
+		};
+		struct ucred ucred = {
+			.pid = getpid(),
+			.uid = getuid(),
+			.gid = getgid(),
+		};
+
+		spa_zero(ctrl);
+		ctrl.hdr.cmsg_level = SOL_SOCKET;
+		ctrl.hdr.cmsg_type = SCM_CREDENTIALS;
+		ctrl.hdr.cmsg_len = CMSG_LEN(sizeof(ucred));
+		memcpy(CMSG_DATA(&ctrl.hdr), &ucred, sizeof(ucred));
+
+		return sendmsg(client->source->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+	}
+#endif
+	return send(client->source->fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
 static int client_try_flush_messages(struct client *client)
 {
 	pw_log_trace("client %p: flushing", client);
@@ -238,6 +308,11 @@ static int client_try_flush_messages(struct client *client)
 			desc.offset_lo = 0;
 			desc.flags = 0;
 
+			if (m->type == MESSAGE_TYPE_SHM_RELEASE) {
+				desc.offset_hi = htonl(m->u.shm_release.block_id);
+				desc.flags = htonl(FLAG_SHMRELEASE);
+			}
+
 			data = SPA_PTROFF(&desc, client->out_index, void);
 			size = sizeof(desc) - client->out_index;
 		} else if (client->out_index < m->length + sizeof(desc)) {
@@ -246,6 +321,7 @@ static int client_try_flush_messages(struct client *client)
 			size = m->length - idx;
 		} else {
 			if (m->channel == SPA_ID_INVALID &&
+			    m->type != MESSAGE_TYPE_SHM_RELEASE &&
 			    pw_log_topic_custom_enabled(SPA_LOG_LEVEL_INFO, pulse_conn))
 				message_dump(SPA_LOG_LEVEL_INFO, ">>", m);
 			message_free(m, true, false);
@@ -254,7 +330,7 @@ static int client_try_flush_messages(struct client *client)
 		}
 
 		while (true) {
-			ssize_t sent = send(client->source->fd, data, size, MSG_NOSIGNAL | MSG_DONTWAIT);
+			ssize_t sent = send_data(client, m, data, size);
 			if (sent < 0) {
 				int res = -errno;
 				if (res == -EINTR)
@@ -278,7 +354,7 @@ int client_flush_messages(struct client *client)
 
 		if (SPA_FLAG_IS_SET(mask, SPA_IO_OUT)) {
 			SPA_FLAG_CLEAR(mask, SPA_IO_OUT);
-			pw_loop_update_io(client->impl->main_loop, client->source, mask);
+			pw_loop_update_io(client->impl->io_loop, client->source, mask);
 		}
 	} else {
 		if (res != -EAGAIN && res != -EWOULDBLOCK)
@@ -379,7 +455,10 @@ int client_queue_subscribe_event(struct client *client, uint32_t facility, uint3
 			subscription_event_type_to_string(type), type,
 			index);
 
-	if (client_prune_subscribe_events(client, facility, type, index))
+	pw_loop_lock(client->impl->io_loop);
+	bool drop = client_prune_subscribe_events(client, facility, type, index);
+	pw_loop_unlock(client->impl->io_loop);
+	if (drop)
 		return 0;
 
 	struct message *reply = message_alloc(client->impl, -1, 0);
@@ -401,3 +480,190 @@ int client_queue_subscribe_event(struct client *client, uint32_t facility, uint3
 
 	return client_queue_message(client, reply);
 }
+
+int client_queue_shm_release(struct client *client, uint32_t block_id)
+{
+	struct message *msg;
+
+	if (client->disconnect)
+		return -ENOTCONN;
+
+	msg = message_alloc(client->impl, -1, 0);
+	if (msg == NULL)
+		return -errno;
+
+	msg->type = MESSAGE_TYPE_SHM_RELEASE;
+	msg->u.shm_release.block_id = block_id;
+
+	return client_queue_message(client, msg);
+}
+
+int client_take_fd(struct client *client)
+{
+	int fd;
+
+	if (client->n_recv_fds == 0)
+		return -EBADF;
+
+	fd = client->recv_fds[0];
+	client->n_recv_fds--;
+	memmove(&client->recv_fds[0], &client->recv_fds[1],
+			client->n_recv_fds * sizeof(int));
+	return fd;
+}
+
+void client_close_fds(struct client *client)
+{
+	while (client->n_recv_fds > 0)
+		close(client->recv_fds[--client->n_recv_fds]);
+}
+
+static struct shm_segment *find_shm(struct client *client, uint32_t id, bool memfd)
+{
+	uint32_t i;
+
+	for (i = 0; i < client->n_shm_segments; i++) {
+		struct shm_segment *seg = &client->shm_segments[i];
+		if (seg->id == id && seg->memfd == memfd)
+			return seg;
+	}
+	return NULL;
+}
+
+static bool shm_can_map(int fd)
+{
+#ifdef F_GET_SEALS
+	/* the client can shrink the memory while we read from it, which would
+	 * make us crash with SIGBUS when it is mapped */
+	int seals = fcntl(fd, F_GET_SEALS);
+	return seals >= 0 && SPA_FLAG_IS_SET(seals, F_SEAL_SHRINK);
+#else
+	return false;
+#endif
+}
+
+int client_add_shm(struct client *client, uint32_t id, bool memfd, int fd)
+{
+	struct shm_segment *seg;
+	struct stat st;
+	char name[64];
+	void *data = NULL;
+	int res;
+
+	if (fd < 0) {
+		/* POSIX segments are not passed to us but opened by name */
+		spa_scnprintf(name, sizeof(name), "/dev/shm/pulse-shm-%u", id);
+		if ((fd = open(name, O_RDONLY | O_CLOEXEC)) < 0)
+			return -errno;
+	}
+
+	if (find_shm(client, id, memfd) != NULL) {
+		res = -EEXIST;
+		goto error;
+	}
+	if (client->n_shm_segments >= MAX_SHM_SEGMENTS) {
+		res = -ENOSPC;
+		goto error;
+	}
+	if (fstat(fd, &st) < 0) {
+		res = -errno;
+		goto error;
+	}
+	if (st.st_size <= 0 || st.st_size > MAX_SHM_SIZE) {
+		res = -EINVAL;
+		goto error;
+	}
+
+	/* sealed memfds are used in place, other memory is read with pread() */
+	if (memfd && shm_can_map(fd)) {
+		data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			res = -errno;
+			goto error;
+		}
+		close(fd);
+		fd = -1;
+	}
+
+	seg = &client->shm_segments[client->n_shm_segments++];
+	seg->id = id;
+	seg->memfd = memfd;
+	seg->fd = fd;
+	seg->data = data;
+	seg->size = st.st_size;
+
+	pw_log_debug("client %p: added %s segment %u size:%zu mapped:%d", client,
+			memfd ? "memfd" : "shm", id, seg->size, data != NULL);
+	return 0;
+error:
+	close(fd);
+	return res;
+}
+
+static int shm_read(struct shm_segment *seg, void *data, uint32_t offset, uint32_t size)
+{
+	uint32_t done = 0;
+	ssize_t r;
+
+	while (done < size) {
+		r = pread(seg->fd, SPA_PTROFF(data, done, void), size - done,
+				(off_t) offset + done);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		/* the client truncated the memory */
+		if (r == 0)
+			return -EIO;
+		done += r;
+	}
+	return 0;
+}
+
+/** Get \a size bytes at \a offset of a SHM segment. The data is used in place
+ * when the segment is mapped, else it is read into \a copy, which needs to be
+ * freed by the caller. */
+const void *client_get_shm(struct client *client, uint32_t id, bool memfd,
+		uint32_t offset, uint32_t size, struct message **copy)
+{
+	struct shm_segment *seg;
+	struct message *msg;
+	int res;
+
+	*copy = NULL;
+
+	if ((seg = find_shm(client, id, memfd)) == NULL) {
+		/* memfd segments need to be registered first, POSIX segments
+		 * are attached when they are first used */
+		if (memfd || !client->impl->defs.enable_posix_shm) {
+			pw_log_warn("client %p [%s]: unknown %s segment %u",
+					client, client->name, memfd ? "memfd" : "shm", id);
+			return NULL;
+		}
+		if ((res = client_add_shm(client, id, false, -1)) < 0) {
+			pw_log_warn("client %p [%s]: can't attach shm segment %u: %s",
+					client, client->name, id, spa_strerror(res));
+			return NULL;
+		}
+		seg = find_shm(client, id, memfd);
+	}
+	if ((uint64_t) offset + size > seg->size || size > FRAME_SIZE_MAX_ALLOW) {
+		pw_log_warn("client %p [%s]: invalid block %u+%u in segment %u of size %zu",
+				client, client->name, offset, size, id, seg->size);
+		return NULL;
+	}
+	if (seg->data != NULL)
+		return SPA_PTROFF(seg->data, offset, void);
+
+	if ((msg = message_alloc(client->impl, -1, size)) == NULL)
+		return NULL;
+	if ((res = shm_read(seg, msg->data, offset, size)) < 0) {
+		pw_log_warn("client %p [%s]: can't read block %u+%u in segment %u: %s",
+				client, client->name, offset, size, id, spa_strerror(res));
+		message_free(msg, false, false);
+		return NULL;
+	}
+	*copy = msg;
+	return msg->data;
+}
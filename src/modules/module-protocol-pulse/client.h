@@ -7,11 +7,15 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include <sys/types.h>
 
 #include <spa/utils/list.h>
+#include <spa/utils/atomic.h>
 #include <spa/utils/hook.h>
 #include <pipewire/map.h>
 
+#include "defs.h"
+
 struct impl;
 struct server;
 struct message;
@@ -30,6 +34,14 @@ struct descriptor {
 	uint32_t flags;
 };
 
+struct shm_segment {
+	uint32_t id;
+	bool memfd;
+	int fd;			/**< fd to read from when not mapped or -1 */
+	void *data;		/**< mapping of sealed memory or NULL */
+	size_t size;
+};
+
 struct client {
 	struct spa_list link;
 	struct impl *impl;
@@ -38,7 +50,8 @@ struct client {
 	int ref;
 	const char *name; /* owned by `client::props` */
 
-	struct spa_source *source;
+	struct spa_source *source;		/**< on impl::io_loop */
+	uid_t uid;
 
 	uint32_t version;
 
@@ -49,6 +62,7 @@ struct client {
 	struct pw_core *core;
 	struct pw_manager *manager;
 	struct spa_hook manager_listener;
+	uint64_t info_serial;			/**< serial of the valid cached info replies, 0 is invalid */
 
 	uint32_t subscribed;
 
@@ -76,16 +90,28 @@ struct client {
 	struct descriptor desc;
 	struct message *message;
 
+	int recv_fds[MAX_RECV_FDS];
+	uint32_t n_recv_fds;
+
+	struct shm_segment shm_segments[MAX_SHM_SEGMENTS];
+	uint32_t n_shm_segments;
+
 	struct pw_map streams;
 	struct spa_list out_messages;
 
 	struct spa_list operations;
 
 	struct spa_list pending_samples;
+	struct spa_list sample_mixers;
+
+	/* written from the io thread */
+	bool new_msg_since_last_flush;
+	bool packet_pending;			/**< a packet is handled on the main loop */
 
 	unsigned int disconnect:1;
-	unsigned int new_msg_since_last_flush:1;
 	unsigned int authenticated:1;
+	unsigned int shm:1;			/**< client can send SHM memblocks */
+	unsigned int memfd:1;			/**< client can send memfd memblocks */
 
 	struct pw_manager_object *prev_default_sink;
 	struct pw_manager_object *prev_default_source;
@@ -109,12 +135,19 @@ void client_free(struct client *client);
 int client_queue_message(struct client *client, struct message *msg);
 int client_flush_messages(struct client *client);
 int client_queue_subscribe_event(struct client *client, uint32_t facility, uint32_t type, uint32_t index);
+int client_queue_shm_release(struct client *client, uint32_t block_id);
+
+int client_take_fd(struct client *client);
+void client_close_fds(struct client *client);
+int client_add_shm(struct client *client, uint32_t id, bool memfd, int fd);
+const void *client_get_shm(struct client *client, uint32_t id, bool memfd,
+		uint32_t offset, uint32_t size, struct message **copy);
 
 void client_update_routes(struct client *client, const char *key, const char *value);
 
 static inline void client_unref(struct client *client)
 {
-	if (--client->ref == 0)
+	if (SPA_ATOMIC_DEC(client->ref) == 0)
 		client_free(client);
 }
 
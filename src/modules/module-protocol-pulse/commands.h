@@ -175,6 +175,7 @@ enum pulseaudio_command {
 enum command_access_flag {
 	COMMAND_ACCESS_WITHOUT_AUTH    = (1 << 0),
 	COMMAND_ACCESS_WITHOUT_MANAGER = (1 << 1),
+	COMMAND_IO_THREAD              = (1 << 2),	/**< handled in the io thread */
 };
 
 struct command {
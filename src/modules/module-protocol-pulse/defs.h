@@ -15,6 +15,18 @@
 #define FLAG_SEEKMASK			0x000000FFLU
 #define FLAG_SHMWRITABLE		0x00800000LU
 
+/* the payload of a FLAG_SHMDATA frame */
+#define SHM_INFO_BLOCKID	0
+#define SHM_INFO_SHMID		1
+#define SHM_INFO_INDEX		2
+#define SHM_INFO_LENGTH		3
+#define SHM_INFO_MAX		4
+#define SHM_INFO_SIZE		(SHM_INFO_MAX * sizeof(uint32_t))
+
+#define MAX_SHM_SEGMENTS	16
+#define MAX_SHM_SIZE		(1024u*1024*1024) /* 1GB */
+#define MAX_RECV_FDS		2
+
 #define SEEK_RELATIVE		0
 #define SEEK_ABSOLUTE		1
 #define SEEK_RELATIVE_ON_READ	2
@@ -23,6 +35,8 @@
 #define FRAME_SIZE_MAX_ALLOW (1024*1024*16)
 
 #define PROTOCOL_FLAG_MASK	0xffff0000u
+#define PROTOCOL_FLAG_SHM	0x80000000u
+#define PROTOCOL_FLAG_MEMFD	0x40000000u
 #define PROTOCOL_VERSION_MASK	0x0000ffffu
 #define PROTOCOL_VERSION	35
 
@@ -40,6 +54,7 @@
 #define MODULE_FLAG		(1u << 29)
 
 #define STREAM_CREATE_TIMEOUT	(35 * SPA_NSEC_PER_SEC)
+#define SAMPLE_MIXER_IDLE_TIMEOUT	(5 * SPA_NSEC_PER_SEC)
 
 #define DEFAULT_SINK		"@DEFAULT_SINK@"
 #define DEFAULT_SOURCE		"@DEFAULT_SOURCE@"
@@ -26,6 +26,10 @@ struct pw_properties;
 
 struct defs {
 	bool allow_module_loading;
+	bool enable_shm;
+	bool enable_memfd;
+	bool enable_posix_shm;
+	bool io_thread;
 	struct spa_fraction min_req;
 	struct spa_fraction default_req;
 	struct spa_fraction min_frag;
@@ -48,6 +52,8 @@ struct stats {
 
 struct impl {
 	struct pw_loop *main_loop;
+	struct pw_thread_loop *io_thread;	/**< handles client I/O and stream data */
+	struct pw_loop *io_loop;		/**< loop of io_thread or main_loop */
 	struct pw_context *context;
 	struct spa_hook context_listener;
 
@@ -389,14 +389,19 @@ static int ensure_size(struct message *m, uint32_t size)
 	alloc = SPA_ROUND_UP_N(SPA_MAX(m->allocated + size, 4096u), 4096u);
 	diff = alloc - m->allocated;
 	if ((data = realloc(m->data, alloc)) == NULL) {
+		int res = -errno;
 		free(m->data);
 		m->data = NULL;
+		pw_loop_lock(m->impl->io_loop);
 		m->impl->stat.allocated -= m->allocated;
+		pw_loop_unlock(m->impl->io_loop);
 		m->allocated = 0;
-		return -errno;
+		return res;
 	}
+	pw_loop_lock(m->impl->io_loop);
 	m->impl->stat.allocated += diff;
 	m->impl->stat.accumulated += diff;
+	pw_loop_unlock(m->impl->io_loop);
 	m->data = data;
 	m->allocated = alloc;
 	return size;
@@ -651,6 +656,22 @@ int message_put(struct message *m, ...)
 	return 0;
 }
 
+/* append data that was already serialized with message_put() */
+int message_put_data(struct message *m, const void *data, uint32_t size)
+{
+	if (m == NULL)
+		return -EINVAL;
+
+	if (ensure_size(m, size) > 0)
+		memcpy(m->data + m->length, data, size);
+	m->length += size;
+
+	if (m->length > m->allocated)
+		return -ENOMEM;
+
+	return 0;
+}
+
 int message_dump(enum spa_log_level level, const char *prefix, struct message *m)
 {
 	int res;
@@ -828,6 +849,8 @@ struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size
 {
 	struct message *msg;
 
+	/* messages are allocated and freed from the main loop and the io thread */
+	pw_loop_lock(impl->io_loop);
 	if (!spa_list_is_empty(&impl->free_messages)) {
 		msg = spa_list_first(&impl->free_messages, struct message, link);
 		spa_list_remove(&msg->link);
@@ -835,14 +858,17 @@ struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size
 
 		spa_assert(msg->impl == impl);
 	} else {
-		if ((msg = calloc(1, sizeof(*msg))) == NULL)
+		if ((msg = calloc(1, sizeof(*msg))) == NULL) {
+			pw_loop_unlock(impl->io_loop);
 			return NULL;
+		}
 
 		pw_log_trace("new message %p size:%d", msg, size);
 		msg->impl = impl;
 		msg->impl->stat.n_allocated++;
 		msg->impl->stat.n_accumulated++;
 	}
+	pw_loop_unlock(impl->io_loop);
 
 	if (ensure_size(msg, size) < 0) {
 		message_free(msg, false, true);
@@ -859,6 +885,9 @@ struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size
 
 void message_free(struct message *msg, bool dequeue, bool destroy)
 {
+	struct impl *impl = msg->impl;
+
+	pw_loop_lock(impl->io_loop);
 	if (dequeue)
 		spa_list_remove(&msg->link);
 
@@ -876,4 +905,5 @@ void message_free(struct message *msg, bool dequeue, bool destroy)
 		spa_list_append(&msg->impl->free_messages, &msg->link);
 		msg->length = 0;
 	}
+	pw_loop_unlock(impl->io_loop);
 }
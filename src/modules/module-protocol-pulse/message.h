@@ -16,6 +16,8 @@ struct impl;
 enum message_type {
 	MESSAGE_TYPE_UNSPECIFIED,
 	MESSAGE_TYPE_SUBSCRIPTION_EVENT,
+	MESSAGE_TYPE_SHM_RELEASE,	/**< empty frame releasing a SHM block of the client */
+	MESSAGE_TYPE_CREDENTIALS,	/**< sent with the credentials of the server */
 };
 
 struct message {
@@ -33,6 +35,9 @@ struct message {
 			uint32_t event;
 			uint32_t index;
 		} subscription_event;
+		struct {
+			uint32_t block_id;
+		} shm_release;
 	} u;
 };
 
@@ -62,6 +67,7 @@ struct message *message_alloc(struct impl *impl, uint32_t channel, uint32_t size
 void message_free(struct message *msg, bool dequeue, bool destroy);
 int message_get(struct message *m, ...);
 int message_put(struct message *m, ...);
+int message_put_data(struct message *m, const void *data, uint32_t size);
 int message_dump(enum spa_log_level level, const char *prefix, struct message *m);
 
 #endif /* PULSE_SERVER_MESSAGE_H */
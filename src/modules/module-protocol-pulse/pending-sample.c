@@ -106,7 +106,8 @@ static const struct client_events client_events = {
 int pending_sample_new(struct client *client, struct sample *sample, struct pw_properties *props, uint32_t tag)
 {
 	struct pending_sample *ps;
-	struct sample_play *p = sample_play_new(client->core, sample, props, sizeof(*ps));
+	struct sample_play *p = sample_play_new(client->core, &client->sample_mixers,
+			sample, props, sizeof(*ps));
 	if (!p)
 		return -errno;
 
@@ -117,7 +118,7 @@ int pending_sample_new(struct client *client, struct sample *sample, struct pw_p
 	sample_play_add_listener(p, &ps->listener, &sample_play_events, ps);
 	client_add_listener(client, &ps->client_listener, &client_events, ps);
 	spa_list_append(&client->pending_samples, &ps->link);
-	client->ref++;
+	SPA_ATOMIC_INC(client->ref);
 
 	return 0;
 }
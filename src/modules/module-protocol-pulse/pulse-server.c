@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
 
 #include <pipewire/log.h>
@@ -57,6 +58,10 @@
 #include "volume.h"
 
 #define DEFAULT_ALLOW_MODULE_LOADING 	"true"
+#define DEFAULT_ENABLE_SHM	"true"
+#define DEFAULT_ENABLE_MEMFD	"true"
+#define DEFAULT_ENABLE_POSIX_SHM	"false"
+#define DEFAULT_IO_THREAD	"true"
 #define DEFAULT_MIN_REQ		"256/48000"
 #define DEFAULT_DEFAULT_REQ	"960/48000"
 #define DEFAULT_MIN_FRAG	"256/48000"
@@ -84,6 +89,78 @@ struct temporary_move_data {
 	uint8_t used:1;
 };
 
+/* serialized introspection reply of an object, valid while the serial
+ * matches client::info_serial */
+struct info_cache {
+	uint64_t serial;
+	uint32_t size;
+	uint8_t data[];
+};
+
+#define INFO_CACHE_CLIENT		"info_cache.client"
+#define INFO_CACHE_MODULE		"info_cache.module"
+#define INFO_CACHE_CARD			"info_cache.card"
+#define INFO_CACHE_SINK			"info_cache.sink"
+#define INFO_CACHE_SOURCE		"info_cache.source"
+#define INFO_CACHE_SINK_INPUT		"info_cache.sink_input"
+#define INFO_CACHE_SOURCE_OUTPUT	"info_cache.source_output"
+
+static const char * const info_cache_keys[] = {
+	INFO_CACHE_CLIENT,
+	INFO_CACHE_MODULE,
+	INFO_CACHE_CARD,
+	INFO_CACHE_SINK,
+	INFO_CACHE_SOURCE,
+	INFO_CACHE_SINK_INPUT,
+	INFO_CACHE_SOURCE_OUTPUT,
+};
+
+static void drop_info_cache(struct pw_manager_object *o)
+{
+	struct info_cache *c;
+	size_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(info_cache_keys); i++) {
+		if ((c = pw_manager_object_get_data(o, info_cache_keys[i])) != NULL)
+			c->serial = 0;
+	}
+}
+
+static uint32_t get_node_card_id(struct pw_manager_object *o)
+{
+	struct pw_node_info *info = o->info;
+	const char *str;
+
+	if (info == NULL || info->props == NULL ||
+	    (str = spa_dict_lookup(info->props, PW_KEY_DEVICE_ID)) == NULL)
+		return SPA_ID_INVALID;
+	return (uint32_t)atoi(str);
+}
+
+static void invalidate_info_cache(struct client *client, struct pw_manager_object *o)
+{
+	struct pw_manager_object *obj;
+	uint32_t card_id = SPA_ID_INVALID;
+
+	drop_info_cache(o);
+
+	/* the sink and source info contains the card properties and ports,
+	 * the card info the latency offsets of its sinks and sources */
+	if (pw_manager_object_is_card(o))
+		card_id = o->id;
+	else if (pw_manager_object_is_sink(o) || pw_manager_object_is_source_or_monitor(o))
+		card_id = get_node_card_id(o);
+	if (card_id == SPA_ID_INVALID)
+		return;
+
+	spa_list_for_each(obj, &client->manager->object_list, link) {
+		if (obj->id == card_id ||
+		    ((pw_manager_object_is_sink(obj) || pw_manager_object_is_source_or_monitor(obj)) &&
+		     get_node_card_id(obj) == card_id))
+			drop_info_cache(obj);
+	}
+}
+
 static struct sample *find_sample(struct impl *impl, uint32_t index, const char *name)
 {
 	union pw_map_item *item;
@@ -110,10 +187,22 @@ void broadcast_subscribe_event(struct impl *impl, uint32_t facility, uint32_t ty
 	}
 }
 
+static bool client_can_use_shm(struct client *client)
+{
+	struct impl *impl = client->impl;
+
+	/* only share memory with clients of the same user, the segments
+	 * might contain data that is private to the user */
+	return impl->defs.enable_shm &&
+		client->server->addr.ss_family == AF_UNIX &&
+		client->uid == getuid();
+}
+
 static int do_command_auth(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
+	struct impl *impl = client->impl;
 	struct message *reply;
-	uint32_t version;
+	uint32_t version, flags = 0;
 	const void *cookie;
 	size_t len;
 
@@ -128,22 +217,64 @@ static int do_command_auth(struct client *client, uint32_t command, uint32_t tag
 	if (len != NATIVE_COOKIE_LENGTH)
 		return -EINVAL;
 
-	if ((version & PROTOCOL_VERSION_MASK) >= 13)
+	if ((version & PROTOCOL_VERSION_MASK) >= 13) {
+		flags = version & PROTOCOL_FLAG_MASK;
 		version &= PROTOCOL_VERSION_MASK;
+	}
 
 	client->version = version;
 	client->authenticated = true;
 
-	pw_log_info("client:%p AUTH tag:%u version:%d", client, tag, version);
+	if (SPA_FLAG_IS_SET(flags, PROTOCOL_FLAG_SHM) && client_can_use_shm(client)) {
+		client->memfd = version >= 31 && impl->defs.enable_memfd &&
+			SPA_FLAG_IS_SET(flags, PROTOCOL_FLAG_MEMFD);
+		/* without memfd, the client uses POSIX shared memory */
+		client->shm = client->memfd || impl->defs.enable_posix_shm;
+	}
+
+	pw_log_info("client:%p AUTH tag:%u version:%d shm:%d memfd:%d", client, tag,
+			version, client->shm, client->memfd);
 
 	reply = reply_new(client, tag);
 	message_put(reply,
-			TAG_U32, PROTOCOL_VERSION,
+			TAG_U32, PROTOCOL_VERSION |
+				(client->shm ? PROTOCOL_FLAG_SHM : 0) |
+				(client->memfd ? PROTOCOL_FLAG_MEMFD : 0),
 			TAG_INVALID);
 
+	/* the client checks our credentials before it enables SHM */
+	if (client->shm)
+		reply->type = MESSAGE_TYPE_CREDENTIALS;
+
 	return client_queue_message(client, reply);
 }
 
+static int do_register_memfd_shmid(struct client *client, uint32_t command, uint32_t tag, struct message *m)
+{
+	uint32_t shm_id;
+	int fd, res;
+
+	if (message_get(m,
+			TAG_U32, &shm_id,
+			TAG_INVALID) < 0)
+		return -EPROTO;
+
+	pw_log_info("[%s] REGISTER_MEMFD_SHMID tag:%u shm_id:%u", client->name, tag, shm_id);
+
+	if (!client->memfd)
+		return -EPROTO;
+	if ((fd = client_take_fd(client)) < 0)
+		return -EPROTO;
+
+	if ((res = client_add_shm(client, shm_id, true, fd)) < 0) {
+		pw_log_warn("[%s] can't add memfd segment %u: %s", client->name,
+				shm_id, spa_strerror(res));
+		return res;
+	}
+	/* no reply, the client does not wait for one */
+	return 0;
+}
+
 static int reply_set_client_name(struct client *client, uint32_t tag)
 {
 	struct pw_manager *manager = client->manager;
@@ -182,7 +313,7 @@ static void manager_sync(void *data)
 		client->connect_tag = SPA_ID_INVALID;
 	}
 
-	client->ref++;
+	SPA_ATOMIC_INC(client->ref);
 	spa_list_consume(o, &client->operations, link)
 		operation_complete(o);
 	client_unref(client);
@@ -567,14 +698,17 @@ static int reply_create_playback_stream(struct stream *stream, struct pw_manager
 	uint32_t missing, peer_index;
 	const char *peer_name;
 	uint64_t lat_usec;
+	void *buffer;
 
-	stream->buffer = calloc(1, MAXLENGTH);
-	if (stream->buffer == NULL)
+	if ((buffer = calloc(1, MAXLENGTH)) == NULL)
 		return -errno;
 
+	/* the io thread starts writing memblocks in the stream from here */
+	pw_loop_lock(client->impl->io_loop);
+	stream->buffer = buffer;
 	lat_usec = set_playback_buffer_attr(stream, &stream->attr);
-
 	missing = stream_pop_missing(stream);
+	pw_loop_unlock(client->impl->io_loop);
 	stream->index = id_to_index(manager, stream->id);
 	stream->lat_usec = lat_usec;
 
@@ -724,12 +858,16 @@ static int reply_create_record_stream(struct stream *stream, struct pw_manager_o
 	const char *peer_name, *name;
 	uint32_t peer_index;
 	uint64_t lat_usec;
+	void *buffer;
 
-	stream->buffer = calloc(1, MAXLENGTH);
-	if (stream->buffer == NULL)
+	if ((buffer = calloc(1, MAXLENGTH)) == NULL)
 		return -errno;
 
+	/* the io thread reads the attributes when the stream is processed */
+	pw_loop_lock(client->impl->io_loop);
+	stream->buffer = buffer;
 	lat_usec = set_record_buffer_attr(stream, &stream->attr);
+	pw_loop_unlock(client->impl->io_loop);
 
 	stream->index = id_to_index(manager, stream->id);
 	stream->lat_usec = lat_usec;
@@ -875,6 +1013,9 @@ static void manager_added(void *data, struct pw_manager_object *o)
 
 	update_object_info(manager, o, &impl->defs);
 
+	/* new links, clients and modules change the info of other objects */
+	client->info_serial++;
+
 	send_object_event(client, o, SUBSCRIPTION_EVENT_NEW);
 
 	o->change_mask = 0;
@@ -891,6 +1032,8 @@ static void manager_updated(void *data, struct pw_manager_object *o)
 
 	update_object_info(manager, o, &impl->defs);
 
+	invalidate_info_cache(client, o);
+
 	send_object_event(client, o, SUBSCRIPTION_EVENT_CHANGE);
 
 	o->change_mask = 0;
@@ -906,6 +1049,8 @@ static void manager_removed(void *data, struct pw_manager_object *o)
 	struct client *client = data;
 	const char *str;
 
+	client->info_serial++;
+
 	send_object_event(client, o, SUBSCRIPTION_EVENT_REMOVE);
 
 	send_default_change_subscribe_event(client, pw_manager_object_is_sink(o), pw_manager_object_is_source_or_monitor(o));
@@ -1035,25 +1180,32 @@ static int do_set_client_name(struct client *client, uint32_t command, uint32_t
 	const char *name = NULL;
 	int res = 0, changed = 0;
 
+	/* the io thread logs the name */
+	pw_loop_lock(impl->io_loop);
 	if (client->version < 13) {
 		if (message_get(m,
 				TAG_STRING, &name,
 				TAG_INVALID) < 0)
-			return -EPROTO;
-		if (name)
+			res = -EPROTO;
+		else if (name)
 			changed += pw_properties_set(client->props,
 					PW_KEY_APP_NAME, name);
 	} else {
 		if (message_get(m,
 				TAG_PROPLIST, client->props,
 				TAG_INVALID) < 0)
-			return -EPROTO;
+			res = -EPROTO;
 		changed++;
 	}
+	if (res >= 0) {
+		client_update_quirks(client);
+		client->info_serial++;
+		client->name = pw_properties_get(client->props, PW_KEY_APP_NAME);
+	}
+	pw_loop_unlock(impl->io_loop);
 
-	client_update_quirks(client);
-
-	client->name = pw_properties_get(client->props, PW_KEY_APP_NAME);
+	if (res < 0)
+		return res;
 	pw_log_info("[%s] %s tag:%d", client->name,
 			commands[command].name, tag);
 
@@ -1193,9 +1345,16 @@ static const struct spa_pod *get_buffers_param(struct stream *s,
 		struct buffer_attr *attr, struct spa_pod_builder *b)
 {
 	const struct spa_pod *param;
-	uint32_t blocks, size, stride;
+	uint32_t buffers, min_buffers, blocks, size, stride;
 	struct defs *defs = &s->impl->defs;
 
+	if (s->direction == PW_DIRECTION_OUTPUT) {
+		/* spare buffers for the io thread to write the next quanta into */
+		buffers = MAX_BUFFERS;
+		min_buffers = 2u;
+	} else {
+		buffers = min_buffers = MIN_BUFFERS;
+	}
 	blocks = 1;
 	stride = s->frame_size;
 
@@ -1205,8 +1364,8 @@ static const struct spa_pod *get_buffers_param(struct stream *s,
 
 	param = spa_pod_builder_add_object(b,
 			SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
-			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(MIN_BUFFERS,
-				MIN_BUFFERS, MAX_BUFFERS),
+			SPA_PARAM_BUFFERS_buffers, SPA_POD_CHOICE_RANGE_Int(buffers,
+				min_buffers, MAX_BUFFERS),
 			SPA_PARAM_BUFFERS_blocks,  SPA_POD_Int(blocks),
 			SPA_PARAM_BUFFERS_size,    SPA_POD_CHOICE_RANGE_Int(
 								size,
@@ -1316,6 +1475,9 @@ do_process_done(struct spa_loop *loop,
 		if (pd->quantum != stream->last_quantum)
 			stream_update_minreq(stream, pd->minreq);
 		stream->last_quantum = pd->quantum;
+		/* without resampling, a quantum can be written directly */
+		stream->direct_size = pd->minreq == pd->quantum * stream->frame_size ?
+			pd->minreq : 0;
 
 		stream->read_index += pd->read_inc;
 		if (stream->corked) {
@@ -1340,7 +1502,7 @@ do_process_done(struct spa_loop *loop,
 			    stream->idle_timeout_sec > 0 &&
 			    stream->timestamp - stream->idle_time >
 					(stream->idle_timeout_sec * SPA_NSEC_PER_SEC)) {
-				stream_set_paused(stream, true, "long underrun");
+				stream_queue_paused(stream, true, "long underrun");
 			}
 		}
 		stream->is_idle = pd->idle;
@@ -1411,7 +1573,7 @@ static void stream_process(void *data)
 	struct client *client = stream->client;
 	struct impl *impl = stream->impl;
 	void *p;
-	struct pw_buffer *buffer;
+	struct pw_buffer *buffer, *direct;
 	struct spa_buffer *buf;
 	struct spa_data *d;
 	uint32_t offs, size, minreq = 0, index;
@@ -1423,7 +1585,8 @@ static void stream_process(void *data)
 
 	pw_log_trace_fp("%p: process", stream);
 	buffer = pw_stream_dequeue_buffer(stream->stream);
-	if (buffer == NULL)
+	if (buffer == NULL &&
+	    (buffer = SPA_ATOMIC_XCHG(stream->direct_free, NULL)) == NULL)
 		return;
 
 	buf = buffer->buffer;
@@ -1460,6 +1623,7 @@ static void stream_process(void *data)
 			if ((stream->attr.prebuf == 0 || do_flush) && !stream->corked) {
 				if (avail > 0) {
 					avail = SPA_MIN((uint32_t)avail, size);
+					stream_pop_direct(stream, index, avail, false);
 					spa_ringbuffer_read_data(&stream->ring,
 						stream->buffer, MAXLENGTH,
 						index % MAXLENGTH,
@@ -1490,10 +1654,17 @@ static void stream_process(void *data)
 			size = SPA_MIN(d->maxsize, (uint32_t)avail);
 			size = SPA_MIN(size, minreq);
 
-			spa_ringbuffer_read_data(&stream->ring,
-					stream->buffer, MAXLENGTH,
-					index % MAXLENGTH,
-					p, size);
+			if ((direct = stream_pop_direct(stream, index, size, true)) != NULL) {
+				/* the io thread already wrote the data */
+				stream_recycle_direct(stream, buffer);
+				buffer = direct;
+				d = &buffer->buffer->datas[0];
+			} else {
+				spa_ringbuffer_read_data(&stream->ring,
+						stream->buffer, MAXLENGTH,
+						index % MAXLENGTH,
+						p, size);
+			}
 
 			index += size;
 			pd.read_inc += size;
@@ -1507,6 +1678,13 @@ static void stream_process(void *data)
 		d->chunk->size = size;
 		SPA_FLAG_UPDATE(d->chunk->flags, SPA_CHUNK_FLAG_EMPTY, empty);
 		buffer->size = size / stream->frame_size;
+		pw_stream_queue_buffer(stream->stream, buffer);
+
+		/* give the io thread a buffer for the next quantum */
+		if (minreq == pd.quantum * stream->frame_size &&
+		    SPA_ATOMIC_LOAD(stream->direct_free) == NULL &&
+		    (direct = pw_stream_dequeue_buffer(stream->stream)) != NULL)
+			SPA_ATOMIC_STORE(stream->direct_free, direct);
 	} else  {
 		int32_t filled = spa_ringbuffer_get_write_index(&stream->ring, &index);
 
@@ -1536,18 +1714,26 @@ static void stream_process(void *data)
 		index += size;
 		pd.write_inc = size;
 		spa_ringbuffer_write_update(&stream->ring, index);
+
+		pw_stream_queue_buffer(stream->stream, buffer);
 	}
-	pw_stream_queue_buffer(stream->stream, buffer);
 
 	if (do_flush)
 		pw_stream_flush(stream->stream, true);
 
 	pw_stream_get_time_n(stream->stream, &pd.pwt, sizeof(pd.pwt));
 
-	pw_loop_invoke(impl->main_loop,
+	pw_loop_invoke(impl->io_loop,
 			do_process_done, 1, &pd, sizeof(pd), false, stream);
 }
 
+static void stream_remove_buffer(void *data, struct pw_buffer *buffer)
+{
+	struct stream *stream = data;
+	if (stream->direction == PW_DIRECTION_OUTPUT)
+		stream_reset_direct(stream);
+}
+
 static void stream_drained(void *data)
 {
 	struct stream *stream = data;
@@ -1569,6 +1755,7 @@ static const struct pw_stream_events stream_events =
 	.state_changed = stream_state_changed,
 	.param_changed = stream_param_changed,
 	.io_changed = stream_io_changed,
+	.remove_buffer = stream_remove_buffer,
 	.process = stream_process,
 	.drained = stream_drained,
 };
@@ -2422,6 +2609,8 @@ static int do_finish_upload_stream(struct client *client, uint32_t command, uint
 	} else {
 		pw_properties_free(old->props);
 		free(old->buffer);
+		free(old->mix_data);
+		old->mix_data = NULL;
 		impl->stat.sample_cache -= old->length;
 
 		sample = old;
@@ -2692,6 +2881,8 @@ static int do_cork_stream(struct client *client, uint32_t command, uint32_t tag,
 		return -ENOENT;
 
 	stream_set_corked(stream, cork);
+
+	pw_loop_lock(client->impl->io_loop);
 	if (cork) {
 		stream->is_underrun = true;
 	} else {
@@ -2699,6 +2890,7 @@ static int do_cork_stream(struct client *client, uint32_t command, uint32_t tag,
 		stream->underrun_for = -1;
 		stream_send_request(stream);
 	}
+	pw_loop_unlock(client->impl->io_loop);
 
 	return reply_simple_ack(client, tag);
 }
@@ -2730,11 +2922,13 @@ static int do_flush_trigger_prebuf_stream(struct client *client, uint32_t comman
 	case COMMAND_PREBUF_PLAYBACK_STREAM:
 		if (stream->type != STREAM_TYPE_PLAYBACK)
 			return -ENOENT;
+		pw_loop_lock(client->impl->io_loop);
 		if (command == COMMAND_TRIGGER_PLAYBACK_STREAM)
 			stream->in_prebuf = false;
 		else if (stream->attr.prebuf > 0)
 			stream->in_prebuf = true;
 		stream_send_request(stream);
+		pw_loop_unlock(client->impl->io_loop);
 		break;
 	default:
 		return -EINVAL;
@@ -3230,6 +3424,7 @@ static int do_set_stream_name(struct client *client, uint32_t command, uint32_t
 static int do_update_proplist(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	uint32_t channel, mode;
+	int changed;
 
 	spa_autoptr(pw_properties) props = pw_properties_new(NULL, NULL);
 	if (props == NULL)
@@ -3261,11 +3456,16 @@ static int do_update_proplist(struct client *client, uint32_t command, uint32_t
 		if (pw_stream_update_properties(stream->stream, &props->dict) > 0)
 			stream_update_tag_param(stream);
 	} else {
-		if (pw_properties_update(client->props, &props->dict) > 0) {
+		pw_loop_lock(client->impl->io_loop);
+		if ((changed = pw_properties_update(client->props, &props->dict)) > 0) {
 			client_update_quirks(client);
+			client->info_serial++;
 			client->name = pw_properties_get(client->props, PW_KEY_APP_NAME);
-			pw_core_update_properties(client->core, &client->props->dict);
 		}
+		pw_loop_unlock(client->impl->io_loop);
+
+		if (changed > 0)
+			pw_core_update_properties(client->core, &client->props->dict);
 	}
 
 	return reply_simple_ack(client, tag);
@@ -4230,6 +4430,53 @@ static int fill_source_output_info(struct client *client, struct message *m,
 	return 0;
 }
 
+struct info_fill {
+	const char *cache_key;
+	int (*func) (struct client *client, struct message *m, struct pw_manager_object *o);
+};
+
+static const struct info_fill client_info_fill = { INFO_CACHE_CLIENT, fill_client_info };
+static const struct info_fill module_info_fill = { INFO_CACHE_MODULE, fill_module_info };
+static const struct info_fill card_info_fill = { INFO_CACHE_CARD, fill_card_info };
+static const struct info_fill sink_info_fill = { INFO_CACHE_SINK, fill_sink_info };
+static const struct info_fill source_info_fill = { INFO_CACHE_SOURCE, fill_source_info };
+static const struct info_fill sink_input_info_fill = { INFO_CACHE_SINK_INPUT, fill_sink_input_info };
+static const struct info_fill source_output_info_fill = { INFO_CACHE_SOURCE_OUTPUT, fill_source_output_info };
+
+/* Write the info of the object, from the cache when it is still valid. The
+ * cached data is invalidated by the manager events of the client. */
+static int fill_info_cached(struct client *client, struct message *m,
+		struct pw_manager_object *o, const struct info_fill *fill)
+{
+	struct temporary_move_data *d;
+	struct info_cache *c;
+	uint32_t start = m->length;
+	int res;
+
+	/* the temporary move target expires without an update of the object */
+	d = pw_manager_object_get_data(o, "temporary_move_data");
+	if (d != NULL && d->peer_index != SPA_ID_INVALID)
+		return fill->func(client, m, o);
+
+	c = pw_manager_object_get_data(o, fill->cache_key);
+	if (c != NULL && c->serial == client->info_serial)
+		return message_put_data(m, c->data, c->size);
+
+	if ((res = fill->func(client, m, o)) < 0)
+		return res;
+	if (m->length > m->allocated)
+		return -ENOMEM;
+
+	c = pw_manager_object_add_data(o, fill->cache_key,
+			sizeof(*c) + m->length - start);
+	if (c != NULL) {
+		c->serial = client->info_serial;
+		c->size = m->length - start;
+		memcpy(c->data, m->data + start, c->size);
+	}
+	return 0;
+}
+
 static int do_get_info(struct client *client, uint32_t command, uint32_t tag, struct message *m)
 {
 	struct impl *impl = client->impl;
@@ -4238,7 +4485,7 @@ static int do_get_info(struct client *client, uint32_t command, uint32_t tag, st
 	int res;
 	struct pw_manager_object *o;
 	struct selector sel;
-	int (*fill_func) (struct client *client, struct message *m, struct pw_manager_object *o) = NULL;
+	const struct info_fill *fill = NULL;
 
 	spa_zero(sel);
 
@@ -4261,34 +4508,34 @@ static int do_get_info(struct client *client, uint32_t command, uint32_t tag, st
 	switch (command) {
 	case COMMAND_GET_CLIENT_INFO:
 		sel.type = pw_manager_object_is_client;
-		fill_func = fill_client_info;
+		fill = &client_info_fill;
 		break;
 	case COMMAND_GET_MODULE_INFO:
 		sel.type = pw_manager_object_is_module;
-		fill_func = fill_module_info;
+		fill = &module_info_fill;
 		break;
 	case COMMAND_GET_CARD_INFO:
 		sel.type = pw_manager_object_is_card;
 		sel.key = PW_KEY_DEVICE_NAME;
-		fill_func = fill_card_info;
+		fill = &card_info_fill;
 		break;
 	case COMMAND_GET_SINK_INFO:
 		sel.type = pw_manager_object_is_sink;
 		sel.key = PW_KEY_NODE_NAME;
-		fill_func = fill_sink_info;
+		fill = &sink_info_fill;
 		break;
 	case COMMAND_GET_SOURCE_INFO:
 		sel.type = pw_manager_object_is_source_or_monitor;
 		sel.key = PW_KEY_NODE_NAME;
-		fill_func = fill_source_info;
+		fill = &source_info_fill;
 		break;
 	case COMMAND_GET_SINK_INPUT_INFO:
 		sel.type = pw_manager_object_is_sink_input;
-		fill_func = fill_sink_input_info;
+		fill = &sink_input_info_fill;
 		break;
 	case COMMAND_GET_SOURCE_OUTPUT_INFO:
 		sel.type = pw_manager_object_is_source_output;
-		fill_func = fill_source_output_info;
+		fill = &source_output_info_fill;
 		break;
 	}
 	if (sel.key) {
@@ -4297,7 +4544,7 @@ static int do_get_info(struct client *client, uint32_t command, uint32_t tag, st
 				TAG_INVALID) < 0)
 			goto error_protocol;
 	}
-	if (fill_func == NULL)
+	if (fill == NULL)
 		goto error_invalid;
 
 	if (sel.index != SPA_ID_INVALID && sel.value != NULL)
@@ -4317,7 +4564,7 @@ static int do_get_info(struct client *client, uint32_t command, uint32_t tag, st
 	if (o == NULL)
 		goto error_noentity;
 
-	if ((res = fill_func(client, reply, o)) < 0)
+	if ((res = fill_info_cached(client, reply, o, fill)) < 0)
 		goto error;
 
 	return client_queue_message(client, reply);
@@ -4435,13 +4682,13 @@ static int do_get_sample_info_list(struct client *client, uint32_t command, uint
 struct info_list_data {
 	struct client *client;
 	struct message *reply;
-	int (*fill_func) (struct client *client, struct message *m, struct pw_manager_object *o);
+	const struct info_fill *fill;
 };
 
 static int do_list_info(void *data, struct pw_manager_object *object)
 {
 	struct info_list_data *info = data;
-	info->fill_func(info->client, info->reply, object);
+	fill_info_cached(info->client, info->reply, object, info->fill);
 	return 0;
 }
 
@@ -4467,32 +4714,32 @@ static int do_get_info_list(struct client *client, uint32_t command, uint32_t ta
 
 	switch (command) {
 	case COMMAND_GET_CLIENT_INFO_LIST:
-		info.fill_func = fill_client_info;
+		info.fill = &client_info_fill;
 		break;
 	case COMMAND_GET_MODULE_INFO_LIST:
-		info.fill_func = fill_module_info;
+		info.fill = &module_info_fill;
 		break;
 	case COMMAND_GET_CARD_INFO_LIST:
-		info.fill_func = fill_card_info;
+		info.fill = &card_info_fill;
 		break;
 	case COMMAND_GET_SINK_INFO_LIST:
-		info.fill_func = fill_sink_info;
+		info.fill = &sink_info_fill;
 		break;
 	case COMMAND_GET_SOURCE_INFO_LIST:
-		info.fill_func = fill_source_info;
+		info.fill = &source_info_fill;
 		break;
 	case COMMAND_GET_SINK_INPUT_INFO_LIST:
-		info.fill_func = fill_sink_input_info;
+		info.fill = &sink_input_info_fill;
 		break;
 	case COMMAND_GET_SOURCE_OUTPUT_INFO_LIST:
-		info.fill_func = fill_source_output_info;
+		info.fill = &source_output_info_fill;
 		break;
 	default:
 		return -ENOTSUP;
 	}
 
 	info.reply = reply_new(client, tag);
-	if (info.fill_func)
+	if (info.fill)
 		pw_manager_for_each_object(manager, do_list_info, &info);
 
 	if (command == COMMAND_GET_MODULE_INFO_LIST)
@@ -4560,6 +4807,7 @@ static int do_set_stream_buffer_attr(struct client *client, uint32_t command, ui
 	stream->adjust_latency = adjust_latency;
 	stream->early_requests = early_requests;
 
+	pw_loop_lock(client->impl->io_loop);
 	if (command == COMMAND_SET_PLAYBACK_STREAM_BUFFER_ATTR) {
 		stream->lat_usec = set_playback_buffer_attr(stream, &attr);
 
@@ -4587,6 +4835,8 @@ static int do_set_stream_buffer_attr(struct client *client, uint32_t command, ui
 				TAG_INVALID);
 		}
 	}
+	pw_loop_unlock(client->impl->io_loop);
+
 	return client_queue_message(client, reply);
 }
 
@@ -5236,7 +5486,7 @@ const struct command commands[COMMAND_MAX] =
 	COMMAND(LOOKUP_SOURCE, do_lookup),
 	COMMAND(DRAIN_PLAYBACK_STREAM, do_drain_stream),
 	COMMAND(STAT, do_stat, COMMAND_ACCESS_WITHOUT_MANAGER),
-	COMMAND(GET_PLAYBACK_LATENCY, do_get_playback_latency),
+	COMMAND(GET_PLAYBACK_LATENCY, do_get_playback_latency, COMMAND_IO_THREAD),
 	COMMAND(CREATE_UPLOAD_STREAM, do_create_upload_stream),
 	COMMAND(DELETE_UPLOAD_STREAM, do_delete_stream),
 	COMMAND(FINISH_UPLOAD_STREAM, do_finish_upload_stream),
@@ -5294,7 +5544,7 @@ const struct command commands[COMMAND_MAX] =
 	COMMAND(GET_AUTOLOAD_INFO___OBSOLETE, do_error_access),
 	COMMAND(GET_AUTOLOAD_INFO_LIST___OBSOLETE, do_error_access),
 
-	COMMAND(GET_RECORD_LATENCY, do_get_record_latency),
+	COMMAND(GET_RECORD_LATENCY, do_get_record_latency, COMMAND_IO_THREAD),
 	COMMAND(CORK_RECORD_STREAM, do_cork_stream),
 	COMMAND(FLUSH_RECORD_STREAM, do_flush_trigger_prebuf_stream),
 
@@ -5375,7 +5625,7 @@ const struct command commands[COMMAND_MAX] =
 
 	/* Supported since protocol v31 (9.0)
 	 * BOTH DIRECTIONS */
-	COMMAND(REGISTER_MEMFD_SHMID, do_error_access),
+	COMMAND(REGISTER_MEMFD_SHMID, do_register_memfd_shmid, COMMAND_ACCESS_WITHOUT_MANAGER),
 
 	/* Supported since protocol v35 (15.0) */
 	COMMAND(SEND_OBJECT_MESSAGE, do_send_object_message),
@@ -5411,9 +5661,20 @@ static void impl_clear(struct impl *impl)
 	spa_list_consume(s, &impl->servers, link)
 		server_free(s);
 
+	/* the clients are disconnected, run what the io thread queued for them */
+	if (impl->io_thread)
+		pw_loop_invoke(impl->main_loop, NULL, 0, NULL, 0, false, impl);
+
 	spa_list_consume(c, &impl->cleanup_clients, link)
 		client_free(c);
 
+	if (impl->io_thread) {
+		pw_thread_loop_stop(impl->io_thread);
+		impl->io_loop = impl->main_loop;
+		pw_thread_loop_destroy(impl->io_thread);
+		impl->io_thread = NULL;
+	}
+
 	spa_list_consume(msg, &impl->free_messages, link)
 		message_free(msg, true, true);
 
@@ -5528,6 +5789,10 @@ static void load_defaults(struct defs *def, struct pw_properties *props)
 {
 	parse_bool(props, "pulse.allow-module-loading", DEFAULT_ALLOW_MODULE_LOADING,
 			&def->allow_module_loading);
+	parse_bool(props, "pulse.enable-shm", DEFAULT_ENABLE_SHM, &def->enable_shm);
+	parse_bool(props, "pulse.enable-memfd", DEFAULT_ENABLE_MEMFD, &def->enable_memfd);
+	parse_bool(props, "pulse.enable-posix-shm", DEFAULT_ENABLE_POSIX_SHM, &def->enable_posix_shm);
+	parse_bool(props, "pulse.io-thread", DEFAULT_IO_THREAD, &def->io_thread);
 	parse_frac(props, "pulse.min.req", DEFAULT_MIN_REQ, &def->min_req);
 	parse_frac(props, "pulse.default.req", DEFAULT_DEFAULT_REQ, &def->default_req);
 	parse_frac(props, "pulse.min.frag", DEFAULT_MIN_FRAG, &def->min_frag);
@@ -5565,6 +5830,7 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 	spa_list_init(&impl->free_messages);
 
 	impl->main_loop = pw_context_get_main_loop(context);
+	impl->io_loop = impl->main_loop;
 	impl->work_queue = pw_context_get_work_queue(context);
 	impl->timer_queue = pw_context_get_timer_queue(context);
 
@@ -5598,6 +5864,22 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 	if (str == NULL)
 		goto error_free;
 
+	load_defaults(&impl->defs, props);
+
+	if (impl->defs.io_thread) {
+		impl->io_thread = pw_thread_loop_new("pulse-io", NULL);
+		if (impl->io_thread == NULL) {
+			res = -errno;
+			goto error_free;
+		}
+		impl->io_loop = pw_thread_loop_get_loop(impl->io_thread);
+		if ((res = pw_thread_loop_start(impl->io_thread)) < 0) {
+			pw_log_error("%p: can't start io thread: %s",
+					impl, spa_strerror(res));
+			goto error_free;
+		}
+	}
+
 	if ((res = servers_create_and_start(impl, str, NULL)) < 0) {
 		pw_log_error("%p: no servers could be started: %s",
 				impl, spa_strerror(res));
@@ -5617,7 +5899,6 @@ struct pw_protocol_pulse *pw_protocol_pulse_new(struct pw_context *context,
 		impl->dbus_name = dbus_request_name(context, str);
 #endif
 
-	load_defaults(&impl->defs, props);
 	impl->props = spa_steal_ptr(props);
 
 	pw_context_add_listener(context, &impl->context_listener,
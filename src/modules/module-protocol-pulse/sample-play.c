@@ -10,12 +10,15 @@
 #include <spa/node/io.h>
 #include <spa/param/audio/raw.h>
 #include <spa/pod/builder.h>
+#include <spa/utils/atomic.h>
 #include <spa/utils/hook.h>
+#include <spa/utils/string.h>
 #include <pipewire/context.h>
 #include <pipewire/core.h>
 #include <pipewire/log.h>
 #include <pipewire/properties.h>
 #include <pipewire/stream.h>
+#include <pipewire/work-queue.h>
 
 #include "defs.h"
 #include "format.h"
@@ -55,6 +58,7 @@ static void sample_play_start_timeout(void *user_data)
 
 	if (p->stream)
 		pw_stream_set_active(p->stream, false);
+	p->done = true;
 	sample_play_emit_done(p, -ETIMEDOUT);
 }
 
@@ -126,7 +130,378 @@ static const struct pw_stream_events sample_play_stream_events = {
 	.drained = sample_play_stream_drained,
 };
 
-struct sample_play *sample_play_new(struct pw_core *core,
+static int do_mixer_add_play(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct sample_play *p = user_data;
+
+	spa_list_append(&p->mixer->rt_plays, &p->rt_link);
+	return 0;
+}
+
+static int do_mixer_remove_play(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct sample_play *p = user_data;
+
+	if (!p->finished)
+		spa_list_remove(&p->rt_link);
+	return 0;
+}
+
+static void mixer_invoke(struct sample_mixer *m, spa_invoke_func_t func, struct sample_play *p)
+{
+	struct pw_loop *loop = m->stream ? pw_stream_get_data_loop(m->stream) : NULL;
+
+	if (loop != NULL)
+		pw_loop_invoke(loop, func, 0, NULL, 0, true, p);
+	else
+		func(NULL, false, 0, NULL, 0, p);
+}
+
+static void mixer_idle_timeout(void *user_data)
+{
+	struct sample_mixer *m = user_data;
+
+	/* wait until the finished plays are destroyed */
+	if (!spa_list_is_empty(&m->plays)) {
+		pw_timer_queue_add(m->impl->timer_queue, &m->idle_timer, NULL,
+				SAMPLE_MIXER_IDLE_TIMEOUT, mixer_idle_timeout, m);
+		return;
+	}
+
+	pw_log_info("sample mixer %p: idle, target:%s", m, m->target);
+	sample_mixer_destroy(m);
+}
+
+static void mixer_update_idle(struct sample_mixer *m)
+{
+	struct sample_play *p;
+
+	pw_timer_queue_cancel(&m->idle_timer);
+
+	spa_list_for_each(p, &m->plays, link) {
+		if (!p->done)
+			return;
+	}
+	pw_timer_queue_add(m->impl->timer_queue, &m->idle_timer, NULL,
+			SAMPLE_MIXER_IDLE_TIMEOUT, mixer_idle_timeout, m);
+}
+
+static void sample_mixer_stream_state_changed(void *data, enum pw_stream_state old,
+					      enum pw_stream_state state, const char *error)
+{
+	struct sample_mixer *m = data;
+	struct sample_play *p, *t;
+
+	switch (state) {
+	case PW_STREAM_STATE_UNCONNECTED:
+	case PW_STREAM_STATE_ERROR:
+		/* don't use the mixer for new plays, it is destroyed when idle */
+		m->failed = true;
+		spa_list_for_each_safe(p, t, &m->plays, link) {
+			if (p->done)
+				continue;
+			p->done = true;
+			pw_timer_queue_cancel(&p->timer);
+			sample_play_emit_done(p, -EIO);
+		}
+		mixer_update_idle(m);
+		break;
+	case PW_STREAM_STATE_PAUSED:
+		m->id = pw_stream_get_node_id(m->stream);
+		spa_list_for_each_safe(p, t, &m->plays, link) {
+			if (p->ready)
+				continue;
+			p->ready = true;
+			p->id = m->id;
+			sample_play_emit_ready(p, p->id);
+		}
+		break;
+	case PW_STREAM_STATE_STREAMING:
+		m->streaming = true;
+		spa_list_for_each(p, &m->plays, link)
+			pw_timer_queue_cancel(&p->timer);
+		break;
+	default:
+		break;
+	}
+}
+
+static void sample_mixer_stream_destroy(void *data)
+{
+	struct sample_mixer *m = data;
+
+	spa_hook_remove(&m->listener);
+	m->stream = NULL;
+}
+
+static void sample_mixer_stream_process(void *data)
+{
+	struct sample_mixer *m = data;
+	struct sample_play *p, *t;
+	struct pw_buffer *b;
+	struct spa_buffer *buf;
+	uint32_t i, n, n_samples;
+	bool finished = false;
+	float *d;
+
+	if ((b = pw_stream_dequeue_buffer(m->stream)) == NULL) {
+		pw_log_warn("out of buffers: %m");
+		return;
+	}
+
+	buf = b->buffer;
+	if ((d = buf->datas[0].data) == NULL)
+		return;
+
+	n_samples = buf->datas[0].maxsize / sizeof(float);
+	if (b->requested)
+		n_samples = SPA_MIN(n_samples, b->requested * m->ss.channels);
+	n_samples -= n_samples % m->ss.channels;
+
+	memset(d, 0, n_samples * sizeof(float));
+
+	spa_list_for_each_safe(p, t, &m->rt_plays, rt_link) {
+		n = SPA_MIN(n_samples, p->mix_samples - p->offset);
+		for (i = 0; i < n; i++)
+			d[i] += p->mix_data[p->offset + i];
+		p->offset += n;
+
+		if (p->offset >= p->mix_samples) {
+			spa_list_remove(&p->rt_link);
+			SPA_ATOMIC_STORE(p->finished, true);
+			finished = true;
+		}
+	}
+
+	buf->datas[0].chunk->offset = 0;
+	buf->datas[0].chunk->stride = m->ss.channels * sizeof(float);
+	buf->datas[0].chunk->size = n_samples * sizeof(float);
+
+	pw_stream_queue_buffer(m->stream, b);
+
+	if (finished)
+		pw_loop_signal_event(m->main_loop, m->done_event);
+}
+
+static const struct pw_stream_events sample_mixer_stream_events = {
+	PW_VERSION_STREAM_EVENTS,
+	.state_changed = sample_mixer_stream_state_changed,
+	.destroy = sample_mixer_stream_destroy,
+	.process = sample_mixer_stream_process,
+};
+
+static void on_mixer_done(void *data, uint64_t count)
+{
+	struct sample_mixer *m = data;
+	struct sample_play *p, *t;
+
+	spa_list_for_each_safe(p, t, &m->plays, link) {
+		if (p->done || !SPA_ATOMIC_LOAD(p->finished))
+			continue;
+		p->done = true;
+		pw_timer_queue_cancel(&p->timer);
+		sample_play_emit_done(p, 0);
+	}
+	mixer_update_idle(m);
+}
+
+static struct sample_mixer *sample_mixer_new(struct pw_core *core,
+		struct sample *sample, struct pw_properties *props)
+{
+	struct sample_mixer *m;
+	const char *str;
+	uint8_t buffer[1024];
+	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
+	const struct spa_pod *params[1];
+	uint32_t n_params = 0;
+	int res;
+
+	m = calloc(1, sizeof(*m));
+	if (m == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+
+	m->impl = sample->impl;
+	m->main_loop = pw_context_get_main_loop(pw_core_get_context(core));
+	m->id = SPA_ID_INVALID;
+	m->ss = SAMPLE_SPEC_INIT;
+	m->ss.format = SPA_AUDIO_FORMAT_F32;
+	m->ss.rate = sample->ss.rate;
+	m->ss.channels = sample->ss.channels;
+	m->map = sample->map;
+	spa_list_init(&m->plays);
+	spa_list_init(&m->rt_plays);
+
+	if ((str = pw_properties_get(props, PW_KEY_TARGET_OBJECT)) != NULL &&
+	    (m->target = strdup(str)) == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+	if ((m->props = pw_properties_copy(props)) == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+
+	m->done_event = pw_loop_add_event(m->main_loop, on_mixer_done, m);
+	if (m->done_event == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+
+	m->stream = pw_stream_new(core, "sample-mixer", props);
+	props = NULL;
+	if (m->stream == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+
+	pw_stream_add_listener(m->stream,
+			&m->listener,
+			&sample_mixer_stream_events, m);
+
+	params[n_params++] = format_build_param(&b, SPA_PARAM_EnumFormat,
+			&m->ss, &m->map);
+
+	res = pw_stream_connect(m->stream,
+			PW_DIRECTION_OUTPUT,
+			PW_ID_ANY,
+			PW_STREAM_FLAG_AUTOCONNECT |
+			PW_STREAM_FLAG_MAP_BUFFERS |
+			PW_STREAM_FLAG_RT_PROCESS,
+			params, n_params);
+	if (res < 0)
+		goto error_free;
+
+	pw_log_info("sample mixer %p: new, target:%s rate:%u channels:%u",
+			m, m->target, m->ss.rate, m->ss.channels);
+
+	return m;
+
+error_free:
+	if (m != NULL) {
+		if (m->stream)
+			pw_stream_destroy(m->stream);
+		if (m->done_event)
+			pw_loop_destroy_source(m->main_loop, m->done_event);
+		pw_properties_free(m->props);
+		free(m->target);
+		free(m);
+	}
+	pw_properties_free(props);
+	errno = -res;
+	return NULL;
+}
+
+static bool props_equal(const struct spa_dict *a, const struct spa_dict *b)
+{
+	const struct spa_dict_item *it;
+
+	if (a->n_items != b->n_items)
+		return false;
+	spa_dict_for_each(it, a) {
+		if (!spa_streq(spa_dict_lookup(b, it->key), it->value))
+			return false;
+	}
+	return true;
+}
+
+static bool sample_mixer_matches(struct sample_mixer *m, struct sample *sample,
+		const struct pw_properties *props)
+{
+	/* media.role, event.id, the application properties and the target are
+	 * used by the policy, the plays of a mixer all have the same */
+	return !m->failed &&
+		props_equal(&m->props->dict, &props->dict) &&
+		m->ss.rate == sample->ss.rate &&
+		m->ss.channels == sample->ss.channels &&
+		m->map.channels == sample->map.channels &&
+		memcmp(m->map.map, sample->map.map, m->map.channels * sizeof(m->map.map[0])) == 0;
+}
+
+static void do_play_ready(void *obj, void *data, int res, uint32_t id)
+{
+	struct sample_play *p = obj;
+
+	if (p->ready)
+		return;
+	p->ready = true;
+	p->id = p->mixer->id;
+	sample_play_emit_ready(p, p->id);
+}
+
+static int sample_play_add_to_mixer(struct sample_play *p, struct pw_core *core,
+		struct spa_list *mixers, struct sample *sample,
+		const float *mix_data, uint32_t mix_samples, struct pw_properties *props)
+{
+	struct sample_mixer *m;
+
+	/* the properties of the play like it would have in its own stream, the
+	 * stream outlives the sample that created it */
+	pw_properties_update(props, &sample->props->dict);
+	pw_properties_set(props, PW_KEY_MEDIA_NAME, "Sample mixer");
+
+	spa_list_for_each(m, mixers, link) {
+		if (sample_mixer_matches(m, sample, props))
+			break;
+	}
+	if (&m->link == mixers) {
+		if ((m = sample_mixer_new(core, sample, props)) == NULL)
+			return -errno;
+		spa_list_append(mixers, &m->link);
+	} else {
+		pw_properties_free(props);
+	}
+
+	p->mixer = m;
+	p->sample = sample_ref(sample);
+	p->stride = m->ss.channels * sizeof(float);
+	p->mix_data = mix_data;
+	p->mix_samples = mix_samples - mix_samples % m->ss.channels;
+
+	spa_list_append(&m->plays, &p->link);
+	mixer_invoke(m, do_mixer_add_play, p);
+	mixer_update_idle(m);
+
+	if (m->id != SPA_ID_INVALID)
+		pw_work_queue_add(m->impl->work_queue, p, 0, do_play_ready, NULL);
+	if (!m->streaming)
+		pw_timer_queue_add(m->impl->timer_queue, &p->timer, NULL,
+				STREAM_CREATE_TIMEOUT, sample_play_start_timeout, p);
+
+	return 0;
+}
+
+void sample_mixer_destroy(struct sample_mixer *m)
+{
+	struct sample_play *p;
+
+	pw_log_info("sample mixer %p: destroy", m);
+
+	spa_list_remove(&m->link);
+	pw_timer_queue_cancel(&m->idle_timer);
+
+	if (m->stream) {
+		spa_hook_remove(&m->listener);
+		pw_stream_destroy(m->stream);
+	}
+
+	/* the plays are normally destroyed before the mixer */
+	spa_list_consume(p, &m->plays, link) {
+		spa_list_remove(&p->link);
+		pw_work_queue_cancel(m->impl->work_queue, p, SPA_ID_INVALID);
+		p->mixer = NULL;
+	}
+
+	pw_loop_destroy_source(m->main_loop, m->done_event);
+	pw_properties_free(m->props);
+	free(m->target);
+	free(m);
+}
+
+struct sample_play *sample_play_new(struct pw_core *core, struct spa_list *mixers,
 				    struct sample *sample, struct pw_properties *props,
 				    size_t user_data_size)
 {
@@ -134,7 +509,8 @@ struct sample_play *sample_play_new(struct pw_core *core,
 	uint8_t buffer[1024];
 	struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 	const struct spa_pod *params[1];
-	uint32_t n_params = 0;
+	uint32_t n_params = 0, mix_samples;
+	const float *mix_data;
 	int res;
 
 	p = calloc(1, sizeof(*p) + user_data_size);
@@ -145,9 +521,21 @@ struct sample_play *sample_play_new(struct pw_core *core,
 
 	p->context = pw_core_get_context(core);
 	p->main_loop = pw_context_get_main_loop(p->context);
+	p->id = SPA_ID_INVALID;
 	spa_hook_list_init(&p->hooks);
 	p->user_data = SPA_PTROFF(p, sizeof(struct sample_play), void);
 
+	/* samples that can be converted once are mixed in a shared stream */
+	if (mixers != NULL &&
+	    (mix_data = sample_get_mix_data(sample, &mix_samples)) != NULL) {
+		res = sample_play_add_to_mixer(p, core, mixers, sample,
+				mix_data, mix_samples, props);
+		props = NULL;
+		if (res < 0)
+			goto error_free;
+		return p;
+	}
+
 	pw_properties_update(props, &sample->props->dict);
 
 	p->stream = pw_stream_new(core, sample->name, props);
@@ -197,9 +585,22 @@ error_free:
 
 void sample_play_destroy(struct sample_play *p)
 {
+	struct sample_mixer *m = p->mixer;
+
+	if (m != NULL) {
+		mixer_invoke(m, do_mixer_remove_play, p);
+		spa_list_remove(&p->link);
+		pw_work_queue_cancel(m->impl->work_queue, p, SPA_ID_INVALID);
+		mixer_update_idle(m);
+	}
+
 	if (p->stream)
 		pw_stream_destroy(p->stream);
 
+	/* a mixed play has no stream to release the sample */
+	if (p->sample)
+		sample_unref(p->sample);
+
 	spa_hook_list_clean(&p->hooks);
 
 	pw_timer_queue_cancel(&p->timer);
@@ -13,7 +13,10 @@
 
 #include <pipewire/pipewire.h>
 
+#include "format.h"
+
 struct sample;
+struct sample_mixer;
 struct pw_core;
 struct pw_loop;
 struct pw_stream;
@@ -33,9 +36,9 @@ struct sample_play_events {
 #define sample_play_emit_done(p,r) spa_hook_list_call(&p->hooks, struct sample_play_events, done, 0, r)
 
 struct sample_play {
-	struct spa_list link;
+	struct spa_list link;		/**< link in sample_mixer::plays */
 	struct sample *sample;
-	struct pw_stream *stream;
+	struct pw_stream *stream;	/**< own stream, NULL when mixed */
 	uint32_t id;
 	struct spa_hook listener;
 	struct pw_context *context;
@@ -45,14 +48,45 @@ struct sample_play {
 	struct spa_hook_list hooks;
 	struct pw_timer timer;
 	void *user_data;
+
+	struct sample_mixer *mixer;
+	struct spa_list rt_link;	/**< link in sample_mixer::rt_plays */
+	const float *mix_data;
+	uint32_t mix_samples;
+	bool finished;			/**< all data was mixed, set from the data loop */
+	bool ready;
+	bool done;
+};
+
+/* Mixes the plays of the samples with the same target and format in one
+ * long-lived stream */
+struct sample_mixer {
+	struct spa_list link;		/**< link in client::sample_mixers */
+	struct impl *impl;
+	struct pw_stream *stream;
+	struct spa_hook listener;
+	struct pw_loop *main_loop;
+	struct spa_source *done_event;
+	char *target;
+	struct pw_properties *props;	/**< properties of the plays */
+	struct sample_spec ss;
+	struct channel_map map;
+	uint32_t id;
+	struct spa_list plays;
+	struct spa_list rt_plays;
+	struct pw_timer idle_timer;
+	bool streaming;
+	bool failed;
 };
 
-struct sample_play *sample_play_new(struct pw_core *core,
+struct sample_play *sample_play_new(struct pw_core *core, struct spa_list *mixers,
 				    struct sample *sample, struct pw_properties *props,
 				    size_t user_data_size);
 
 void sample_play_destroy(struct sample_play *p);
 
+void sample_mixer_destroy(struct sample_mixer *m);
+
 void sample_play_add_listener(struct sample_play *p, struct spa_hook *listener,
 			      const struct sample_play_events *events, void *data);
 
@@ -2,7 +2,11 @@
 /* SPDX-FileCopyrightText: Copyright © 2020 Wim Taymans */
 /* SPDX-License-Identifier: MIT */
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <spa/param/audio/raw.h>
 
 #include <pipewire/log.h>
 #include <pipewire/map.h>
@@ -26,5 +30,59 @@ void sample_free(struct sample *sample)
 	pw_properties_free(sample->props);
 
 	free(sample->buffer);
+	free(sample->mix_data);
 	free(sample);
 }
+
+/* Convert the sample once to F32 so that it can be mixed with the other
+ * samples. Returns NULL with errno set to ENOTSUP when the format can not
+ * be mixed. */
+const float *sample_get_mix_data(struct sample *sample, uint32_t *n_samples)
+{
+	uint32_t i, n;
+	float *d;
+
+	if (sample->mix_data != NULL)
+		goto done;
+
+	switch (sample->ss.format) {
+	case SPA_AUDIO_FORMAT_S16:
+		n = sample->length / sizeof(int16_t);
+		break;
+	case SPA_AUDIO_FORMAT_S32:
+	case SPA_AUDIO_FORMAT_F32:
+		n = sample->length / sizeof(int32_t);
+		break;
+	default:
+		errno = ENOTSUP;
+		return NULL;
+	}
+	if ((d = malloc(SPA_MAX(n, 1u) * sizeof(float))) == NULL)
+		return NULL;
+
+	switch (sample->ss.format) {
+	case SPA_AUDIO_FORMAT_S16:
+	{
+		const int16_t *s = (const int16_t *) sample->buffer;
+		for (i = 0; i < n; i++)
+			d[i] = s[i] / 32768.0f;
+		break;
+	}
+	case SPA_AUDIO_FORMAT_S32:
+	{
+		const int32_t *s = (const int32_t *) sample->buffer;
+		for (i = 0; i < n; i++)
+			d[i] = s[i] / 2147483648.0f;
+		break;
+	}
+	case SPA_AUDIO_FORMAT_F32:
+		memcpy(d, sample->buffer, n * sizeof(float));
+		break;
+	}
+	sample->mix_data = d;
+	sample->mix_samples = n;
+
+done:
+	*n_samples = sample->mix_samples;
+	return sample->mix_data;
+}
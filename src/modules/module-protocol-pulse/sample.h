@@ -22,9 +22,13 @@ struct sample {
 	struct pw_properties *props;
 	uint32_t length;
 	uint8_t *buffer;
+
+	float *mix_data;		/**< buffer converted to F32 for the sample mixer */
+	uint32_t mix_samples;		/**< number of samples in mix_data */
 };
 
 void sample_free(struct sample *sample);
+const float *sample_get_mix_data(struct sample *sample, uint32_t *n_samples);
 
 static inline struct sample *sample_ref(struct sample *sample)
 {
@@ -101,6 +101,75 @@ finish:
 	return 0;
 }
 
+static int do_handle_packet(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct client * const client = user_data;
+	struct impl * const impl = client->impl;
+	struct message * const msg = *(struct message **) data;
+
+	if (!client->disconnect)
+		handle_packet(client, msg);
+	else
+		message_free(msg, false, false);
+
+	client_close_fds(client);
+
+	/* resume reading from the client */
+	pw_loop_lock(impl->io_loop);
+	client->packet_pending = false;
+	if (client->source != NULL)
+		pw_loop_update_io(impl->io_loop, client->source,
+				client->source->mask | SPA_IO_IN);
+	pw_loop_unlock(impl->io_loop);
+
+	/* drop the reference that was acquired in dispatch_packet() */
+	client_unref(client);
+	return 0;
+}
+
+static bool is_io_command(struct client *client, struct message *msg)
+{
+	uint32_t command;
+	bool res;
+
+	if (!client->authenticated || client->manager == NULL)
+		return false;
+
+	res = message_get(msg,
+			TAG_U32, &command,
+			TAG_INVALID) >= 0 &&
+		command < COMMAND_MAX &&
+		SPA_FLAG_IS_SET(commands[command].access, COMMAND_IO_THREAD);
+	msg->offset = 0;
+
+	return res;
+}
+
+static int dispatch_packet(struct client *client, struct message *msg)
+{
+	struct impl * const impl = client->impl;
+	int res;
+
+	if (impl->io_thread != NULL && !is_io_command(client, msg)) {
+		/* stop reading until the main loop handled the packet, this keeps
+		 * the packets and memblocks of the client in order and the
+		 * received fds with the packet */
+		client->packet_pending = true;
+		pw_loop_update_io(impl->io_loop, client->source,
+				client->source->mask & ~SPA_IO_IN);
+
+		SPA_ATOMIC_INC(client->ref);
+		pw_loop_invoke(impl->main_loop, do_handle_packet, 0,
+				&msg, sizeof(msg), false, client);
+		return 0;
+	}
+
+	res = handle_packet(client, msg);
+	client_close_fds(client);
+	return res;
+}
+
 static void stream_clear_data(struct stream *stream,
 		uint32_t offset, uint32_t len)
 {
@@ -113,7 +182,10 @@ static void stream_clear_data(struct stream *stream,
 static int handle_memblock(struct client *client, struct message *msg)
 {
 	struct stream *stream;
-	uint32_t channel, flags, index;
+	uint32_t channel, flags, index, length, direct;
+	uint32_t shm_info[SHM_INFO_MAX];
+	struct message *copy = NULL;
+	const void *data;
 	int64_t offset, diff;
 	int32_t filled;
 	int res = 0;
@@ -124,11 +196,27 @@ static int handle_memblock(struct client *client, struct message *msg)
 		(((uint64_t) ntohl(client->desc.offset_lo))));
 	flags = ntohl(client->desc.flags);
 
+	if (SPA_FLAG_IS_SET(flags, FLAG_SHMDATA)) {
+		/* the data is in a SHM segment of the client, copy it from there
+		 * and release the block again */
+		memcpy(shm_info, msg->data, sizeof(shm_info));
+		length = ntohl(shm_info[SHM_INFO_LENGTH]);
+		data = client_get_shm(client, ntohl(shm_info[SHM_INFO_SHMID]),
+				SPA_FLAG_IS_SET(flags, FLAG_SHMDATA_MEMFD_BLOCK),
+				ntohl(shm_info[SHM_INFO_INDEX]), length, &copy);
+	} else {
+		length = msg->length;
+		data = msg->data;
+	}
+
 	pw_log_debug("client %p: received memblock channel:%d offset:%" PRIi64 " flags:%08x size:%u",
-		     client, channel, offset, flags, msg->length);
+		     client, channel, offset, flags, length);
+
+	if (data == NULL)
+		goto finish;
 
 	stream = pw_map_lookup(&client->streams, channel);
-	if (stream == NULL || stream->type == STREAM_TYPE_RECORD) {
+	if (stream == NULL || stream->type == STREAM_TYPE_RECORD || stream->buffer == NULL) {
 		pw_log_info("client %p [%s]: received memblock for unknown channel %d",
 			    client, client->name, channel);
 		goto finish;
@@ -136,7 +224,7 @@ static int handle_memblock(struct client *client, struct message *msg)
 
 	filled = spa_ringbuffer_get_write_index(&stream->ring, &index);
 	pw_log_debug("new block %p %p/%u filled:%d index:%d flags:%02x offset:%" PRIu64,
-		     msg, msg->data, msg->length, filled, index, flags, offset);
+		     msg, data, length, filled, index, flags, offset);
 
 	switch (flags & FLAG_SEEKMASK) {
 	case SEEK_RELATIVE:
@@ -156,7 +244,9 @@ static int handle_memblock(struct client *client, struct message *msg)
 		goto finish;
 	}
 
-	if (diff > 0) {
+	if (diff < 0) {
+		stream_store_direct(stream);
+	} else if (diff > 0) {
 		pw_log_debug("clear gap of %"PRIu64, diff);
 		/* if we jump forwards, clear the data we skipped because we might otherwise
 		 * play back old data. FIXME, if the write pointer goes backwards and
@@ -173,34 +263,85 @@ static int handle_memblock(struct client *client, struct message *msg)
 
 	if (filled < 0) {
 		/* underrun, reported on reader side */
-	} else if (filled + msg->length > stream->attr.maxlength) {
+	} else if (filled + length > stream->attr.maxlength) {
 		/* overrun */
 		stream_send_overflow(stream);
 	}
 
-	/* always write data to ringbuffer, we expect the other side
+	/* data that completes the next quantum goes directly into a stream buffer */
+	direct = diff == 0 ? stream_write_direct(stream, index, filled, data, length) : 0;
+
+	/* always write the rest of the data to ringbuffer, we expect the other side
 	 * to recover */
 	spa_ringbuffer_write_data(&stream->ring,
 			stream->buffer, MAXLENGTH,
-			index % MAXLENGTH,
-			msg->data,
-			SPA_MIN(msg->length, MAXLENGTH));
-	index += msg->length;
+			(index + direct) % MAXLENGTH,
+			SPA_PTROFF(data, direct, void),
+			SPA_MIN(length - direct, MAXLENGTH));
+	index += length;
 	spa_ringbuffer_write_update(&stream->ring, index);
 
-	stream->write_index += msg->length;
-	stream->requested -= msg->length;
+	stream->write_index += length;
+	stream->requested -= length;
 
 	stream_send_request(stream);
 
 	if (stream->is_paused && !stream->corked)
-		stream_set_paused(stream, false, "new data");
+		stream_queue_paused(stream, false, "new data");
 
 finish:
+	if (SPA_FLAG_IS_SET(flags, FLAG_SHMDATA))
+		client_queue_shm_release(client, ntohl(shm_info[SHM_INFO_BLOCKID]));
+	if (copy != NULL)
+		message_free(copy, false, false);
 	message_free(msg, false, false);
 	return res;
 }
 
+static ssize_t recv_data(struct client *client, void *data, size_t size)
+{
+	union {
+		struct cmsghdr hdr;
+		uint8_t buf[CMSG_SPACE(MAX_RECV_FDS * sizeof(int))];
+	} ctrl;
+	struct iovec iov = {
+		.iov_base = data,
+		.iov_len = size,
+	};
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = &ctrl,
+		.msg_controllen = sizeof(ctrl),
+	};
+	struct cmsghdr *cmsg;
+	ssize_t r;
+
+	r = recvmsg(client->source->fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+	if (r <= 0)
+		return r;
+
+	/* keep the fds that are passed along with a packet, they are taken by
+	 * the command handler or closed when the frame is complete */
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		uint32_t i, n_fds;
+		int fd;
+
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		n_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (i = 0; i < n_fds; i++) {
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			if (client->n_recv_fds < MAX_RECV_FDS)
+				client->recv_fds[client->n_recv_fds++] = fd;
+			else
+				close(fd);
+		}
+	}
+	return r;
+}
+
 static int do_read(struct client *client)
 {
 	struct impl * const impl = client->impl;
@@ -224,7 +365,7 @@ static int do_read(struct client *client)
 	}
 
 	while (true) {
-		ssize_t r = recv(client->source->fd, data, size, MSG_DONTWAIT);
+		ssize_t r = recv_data(client, data, size);
 
 		if (r == 0 && size != 0) {
 			res = -EPIPE;
@@ -247,12 +388,30 @@ static int do_read(struct client *client)
 		uint32_t flags, length, channel;
 
 		flags = ntohl(client->desc.flags);
+		length = ntohl(client->desc.length);
+		channel = ntohl(client->desc.channel);
+
 		if ((flags & FLAG_SHMMASK) != 0) {
-			res = -EPROTO;
-			goto exit;
+			if (!client->shm) {
+				pw_log_warn("client %p: received SHM frame but SHM is not enabled",
+					    client);
+				res = -EPROTO;
+				goto exit;
+			}
+			if (flags == FLAG_SHMRELEASE || flags == FLAG_SHMREVOKE) {
+				/* we never send SHM blocks and we copy the blocks of the
+				 * client right away, so there is nothing to release or revoke */
+				client->in_index = 0;
+				goto exit;
+			}
+			if (!SPA_FLAG_IS_SET(flags, FLAG_SHMDATA) ||
+			    length != SHM_INFO_SIZE || channel == (uint32_t) -1) {
+				pw_log_warn("client %p: received invalid SHM frame", client);
+				res = -EPROTO;
+				goto exit;
+			}
 		}
 
-		length = ntohl(client->desc.length);
 		if (length > FRAME_SIZE_MAX_ALLOW || length <= 0) {
 			pw_log_warn("client %p: received invalid frame size: %u",
 				    client, length);
@@ -260,7 +419,6 @@ static int do_read(struct client *client)
 			goto exit;
 		}
 
-		channel = ntohl(client->desc.channel);
 		if (channel == (uint32_t) -1) {
 			if (flags != 0) {
 				pw_log_warn("client %p: received packet frame with invalid flags",
@@ -281,23 +439,53 @@ static int do_read(struct client *client)
 		client->message = NULL;
 		client->in_index = 0;
 
-		if (msg->channel == (uint32_t)-1)
-			res = handle_packet(client, msg);
-		else
+		if (msg->channel == (uint32_t)-1) {
+			res = dispatch_packet(client, msg);
+		} else {
 			res = handle_memblock(client, msg);
+			client_close_fds(client);
+		}
 	}
 
 exit:
 	return res;
 }
 
+static int do_disconnect_client(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct client * const client = user_data;
+
+	/*
+	 * drop the server's reference to the client
+	 * (if it hasn't been dropped already),
+	 * it is guaranteed that this will not call `client_free()`
+	 * since an extra reference has been acquired which will
+	 * keep the client alive
+	 */
+	if (client_detach(client))
+		client_unref(client);
+
+	/* then disconnect the client */
+	client_disconnect(client);
+
+	/* drop the reference that was acquired in on_client_data() */
+	client_unref(client);
+	return 0;
+}
+
 static void
 on_client_data(void *data, int fd, uint32_t mask)
 {
 	struct client * const client = data;
+	struct impl * const impl = client->impl;
 	int res;
 
-	client->ref++;
+	/* the packets handled on the main loop can drop the last reference
+	 * of the client. From the io thread, the client is only freed by the
+	 * main loop after its source was removed. */
+	if (impl->io_thread == NULL)
+		client->ref++;
 
 	if (mask & SPA_IO_HUP) {
 		res = -EPIPE;
@@ -311,7 +499,7 @@ on_client_data(void *data, int fd, uint32_t mask)
 
 	if (mask & SPA_IO_IN) {
 		pw_log_trace("client %p: can read", client);
-		while (true) {
+		while (!client->packet_pending) {
 			res = do_read(client);
 			if (res < 0) {
 				if (res != -EAGAIN && res != -EWOULDBLOCK)
@@ -329,7 +517,8 @@ on_client_data(void *data, int fd, uint32_t mask)
 
 done:
 	/* drop the reference that was acquired at the beginning of the function */
-	client_unref(client);
+	if (impl->io_thread == NULL)
+		client_unref(client);
 	return;
 
 error:
@@ -340,18 +529,14 @@ error:
 			    client->server, client, client->name);
 		SPA_FALLTHROUGH;
 	case -EPROTO:
-		/*
-		 * drop the server's reference to the client
-		 * (if it hasn't been dropped already),
-		 * it is guaranteed that this will not call `client_free()`
-		 * since at the beginning of this function an extra reference
-		 * has been acquired which will keep the client alive
-		 */
-		if (client_detach(client))
-			client_unref(client);
-
-		/* then disconnect the client */
-		client_disconnect(client);
+		/* stop handling the client I/O and disconnect the client
+		 * from the main loop */
+		pw_loop_destroy_source(impl->io_loop, client->source);
+		client->source = NULL;
+
+		SPA_ATOMIC_INC(client->ref);
+		pw_loop_invoke(impl->main_loop, do_disconnect_client, 0,
+				NULL, 0, false, client);
 		break;
 	default:
 		pw_log_error("server %p: client %p [%s] error %d (%s)",
@@ -391,7 +576,6 @@ on_connect(void *data, int fd, uint32_t mask)
 	}
 
 	if (server->n_clients >= server->max_clients) {
-		close(client_fd);
 		error_reason = "too many client application connections";
 		errno = ECONNREFUSED;
 		goto error;
@@ -403,13 +587,6 @@ on_connect(void *data, int fd, uint32_t mask)
 
 	pw_log_debug("server %p: new client %p fd:%d", server, client, client_fd);
 
-	client->source = pw_loop_add_io(impl->main_loop,
-					client_fd,
-					SPA_IO_ERR | SPA_IO_HUP | SPA_IO_IN,
-					true, on_client_data, client);
-	if (client->source == NULL)
-		goto error;
-
 	client->props = pw_properties_new(
 			PW_KEY_CLIENT_API, "pipewire-pulse",
 			"config.ext", pw_properties_get(impl->props, "config.ext"),
@@ -447,6 +624,7 @@ on_connect(void *data, int fd, uint32_t mask)
 		if (setsockopt(client_fd, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val)) < 0)
 			pw_log_warn("setsockopt(SO_PRIORITY) failed: %m");
 #endif
+		client->uid = get_client_uid(client, client_fd);
 		pid = get_client_pid(client, client_fd);
 		if (pid != 0 && pw_check_flatpak(pid, &app_id, &instance_id, &devices) == 1) {
 			/*
@@ -513,12 +691,25 @@ on_connect(void *data, int fd, uint32_t mask)
 	}
 	pw_properties_set(client->props, PW_KEY_CLIENT_ACCESS, client_access);
 
+	/* from here on, the client is handled by the io thread */
+	pw_loop_lock(impl->io_loop);
+	client->source = pw_loop_add_io(impl->io_loop,
+					client_fd,
+					SPA_IO_ERR | SPA_IO_HUP | SPA_IO_IN,
+					true, on_client_data, client);
+	pw_loop_unlock(impl->io_loop);
+	if (client->source == NULL)
+		goto error;
+
 	return;
 
 error:
 	pw_log_error("server %p: %s: %m", server,
 			error_reason ? error_reason : "failed to create client");
 
+	/* the client source is added last, the fd is not owned by it yet */
+	if (client_fd >= 0)
+		close(client_fd);
 	if (client)
 		client_free(client);
 }
@@ -1094,6 +1285,8 @@ void server_free(struct server *server)
 
 	spa_list_for_each_safe(c, t, &server->clients, link) {
 		spa_assert_se(client_detach(c));
+		/* stop the I/O before the io thread can see the last reference go */
+		client_disconnect(c);
 		client_unref(c);
 	}
 
@@ -2,10 +2,13 @@
 /* SPDX-FileCopyrightText: Copyright © 2020 Wim Taymans */
 /* SPDX-License-Identifier: MIT */
 
+#include <sched.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <spa/utils/atomic.h>
 #include <spa/utils/hook.h>
 #include <spa/utils/ringbuffer.h>
 #include <spa/pod/dynamic.h>
@@ -67,10 +70,6 @@ struct stream *stream_new(struct client *client, enum stream_type type, uint32_t
 	if (stream == NULL)
 		return NULL;
 
-	stream->channel = pw_map_insert_new(&client->streams, stream);
-	if (stream->channel == SPA_ID_INVALID)
-		goto error_errno;
-
 	stream->impl = client->impl;
 	stream->client = client;
 	stream->type = type;
@@ -79,6 +78,7 @@ struct stream *stream_new(struct client *client, enum stream_type type, uint32_t
 	stream->map = *map;
 	stream->attr = *attr;
 	spa_ringbuffer_init(&stream->ring);
+	spa_ringbuffer_init(&stream->direct_ring);
 
 	stream->peer_index = SPA_ID_INVALID;
 
@@ -104,6 +104,13 @@ struct stream *stream_new(struct client *client, enum stream_type type, uint32_t
 		spa_assert_not_reached();
 	}
 
+	/* the io thread looks up streams, inserting can move the array */
+	pw_loop_lock(client->impl->io_loop);
+	stream->channel = pw_map_insert_new(&client->streams, stream);
+	pw_loop_unlock(client->impl->io_loop);
+	if (stream->channel == SPA_ID_INVALID)
+		goto error_errno;
+
 	/* Time out if we don't get a link and can't send a reply to create in 35s. Client will time out in
 	 * 30s and clean up its stream anyway. */
 	pw_timer_queue_add(stream->impl->timer_queue, &stream->timer, NULL,
@@ -143,18 +150,23 @@ void stream_free(struct stream *stream)
 	if (stream->killed)
 		stream_send_killed(stream);
 
+	/* the io thread can't find the stream anymore after this */
+	if (stream->channel != SPA_ID_INVALID) {
+		pw_loop_lock(impl->io_loop);
+		pw_map_remove(&client->streams, stream->channel);
+		pw_loop_unlock(impl->io_loop);
+	}
+
 	if (stream->stream) {
 		spa_hook_remove(&stream->stream_listener);
 		pw_stream_disconnect(stream->stream);
 
 		/* force processing of all pending messages before we destroy
 		 * the stream */
-		pw_loop_invoke(impl->main_loop, NULL, 0, NULL, 0, false, client);
+		pw_loop_invoke(impl->io_loop, NULL, 0, NULL, 0, true, client);
 
 		pw_stream_destroy(stream->stream);
 	}
-	if (stream->channel != SPA_ID_INVALID)
-		pw_map_remove(&client->streams, stream->channel);
 
 	pw_work_queue_cancel(impl->work_queue, stream, SPA_ID_INVALID);
 
@@ -166,13 +178,72 @@ void stream_free(struct stream *stream)
 	free(stream);
 }
 
+/* called from the main thread when the stream buffers are removed */
+void stream_reset_direct(struct stream *stream)
+{
+	pw_loop_lock(stream->impl->io_loop);
+	SPA_ATOMIC_STORE(stream->direct_free, NULL);
+	spa_ringbuffer_init(&stream->direct_ring);
+	SPA_ATOMIC_INC(stream->direct_gen);
+	pw_loop_unlock(stream->impl->io_loop);
+}
+
+static void direct_block_store(struct stream *stream, const struct direct_block *b)
+{
+	spa_ringbuffer_write_data(&stream->ring,
+			stream->buffer, MAXLENGTH,
+			b->index % MAXLENGTH,
+			b->buffer->buffer->datas[0].data, b->size);
+}
+
+/* claim a block for the io or main thread, waits when the data thread is
+ * busy with it so that the ringbuffer can be written after this */
+static bool direct_block_claim(struct direct_block *b)
+{
+	while (!SPA_ATOMIC_CAS(b->state, DIRECT_PENDING, DIRECT_BUSY)) {
+		if (SPA_ATOMIC_LOAD(b->state) == DIRECT_DONE)
+			return false;
+		sched_yield();
+	}
+	return true;
+}
+
+/* stores the pending direct blocks in the ringbuffer when store is set, drops
+ * them otherwise. When this returns, the data thread does not write into the
+ * ringbuffer anymore until new blocks are added. */
+static void direct_drop(struct stream *stream, bool store)
+{
+	uint32_t index, gen = SPA_ATOMIC_LOAD(stream->direct_gen);
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&stream->direct_ring, &index);
+	for (; avail > 0; avail--, index++) {
+		struct direct_block *b = &stream->direct[index & (DIRECT_BLOCKS - 1)];
+		if (!direct_block_claim(b))
+			continue;
+		if (store && b->gen == gen)
+			direct_block_store(stream, b);
+		SPA_ATOMIC_STORE(b->state, DIRECT_DONE);
+	}
+	SPA_ATOMIC_INC(stream->direct_gen);
+}
+
+/* called from the io thread before the ringbuffer is written out of order,
+ * makes the ringbuffer contain all pending direct blocks. */
+void stream_store_direct(struct stream *stream)
+{
+	direct_drop(stream, true);
+}
+
 void stream_flush(struct stream *stream)
 {
 	pw_stream_flush(stream->stream, false);
 
+	pw_loop_lock(stream->impl->io_loop);
 	if (stream->type == STREAM_TYPE_PLAYBACK) {
 		stream->ring.writeindex = stream->ring.readindex;
 		stream->write_index = stream->read_index;
+		direct_drop(stream, false);
 
 		if (stream->attr.prebuf > 0)
 			stream->in_prebuf = true;
@@ -186,6 +257,106 @@ void stream_flush(struct stream *stream)
 		stream->ring.readindex = stream->ring.writeindex;
 		stream->read_index = stream->write_index;
 	}
+	pw_loop_unlock(stream->impl->io_loop);
+}
+
+/* called from the io thread before size bytes of data are written at index.
+ * When the data completes the next quantum that the data thread will read,
+ * the quantum is assembled in a spare stream buffer. Returns the number of
+ * bytes of data that don't need to be written into the ringbuffer. */
+uint32_t stream_write_direct(struct stream *stream, uint32_t index, int32_t filled,
+		const void *data, uint32_t size)
+{
+	struct direct_block *b;
+	struct pw_buffer *buf;
+	struct spa_data *d;
+	uint32_t windex, quantum = stream->direct_size, offs, len;
+
+	if (quantum == 0 || filled < 0)
+		return 0;
+
+	/* the read pointer moves in quanta, this much of the next quantum is
+	 * already in the ringbuffer */
+	offs = filled % quantum;
+	if (offs + size < quantum)
+		return 0;
+	if (spa_ringbuffer_get_write_index(&stream->direct_ring, &windex) >= (int32_t)DIRECT_BLOCKS)
+		return 0;
+	if ((buf = SPA_ATOMIC_XCHG(stream->direct_free, NULL)) == NULL)
+		return 0;
+
+	b = &stream->direct[windex & (DIRECT_BLOCKS - 1)];
+	b->buffer = buf;
+	b->index = index - offs;
+	b->size = quantum;
+	b->gen = SPA_ATOMIC_LOAD(stream->direct_gen);
+	b->state = DIRECT_PENDING;
+
+	d = &buf->buffer->datas[0];
+	if (d->data == NULL || quantum > d->maxsize) {
+		/* let the data thread recycle the buffer */
+		b->gen--;
+		len = 0;
+	} else {
+		len = quantum - offs;
+		spa_ringbuffer_read_data(&stream->ring,
+				stream->buffer, MAXLENGTH,
+				b->index % MAXLENGTH,
+				d->data, offs);
+		memcpy(SPA_PTROFF(d->data, offs, void), data, len);
+	}
+	spa_ringbuffer_write_update(&stream->direct_ring, windex + 1);
+
+	return len;
+}
+
+/* called from the data thread */
+void stream_recycle_direct(struct stream *stream, struct pw_buffer *buffer)
+{
+	if (SPA_ATOMIC_LOAD(stream->direct_free) == NULL)
+		SPA_ATOMIC_STORE(stream->direct_free, buffer);
+	else
+		pw_stream_return_buffer(stream->stream, buffer);
+}
+
+/* called from the data thread before size bytes at index are read from the
+ * ringbuffer. When take is set and a direct block holds exactly this data,
+ * its buffer is returned. Otherwise all direct blocks up to the end of the
+ * data are stored in the ringbuffer and recycled. */
+struct pw_buffer *stream_pop_direct(struct stream *stream, uint32_t index, uint32_t size,
+		bool take)
+{
+	uint32_t rindex, gen = SPA_ATOMIC_LOAD(stream->direct_gen);
+	struct pw_buffer *buf = NULL;
+
+	while (buf == NULL &&
+	    spa_ringbuffer_get_read_index(&stream->direct_ring, &rindex) > 0) {
+		struct direct_block *b = &stream->direct[rindex & (DIRECT_BLOCKS - 1)];
+
+		if (b->gen == gen && (int32_t)(b->index - (index + size)) >= 0)
+			break;
+
+		/* the io thread stores the block before it writes to the
+		 * ringbuffer out of order, we can't recycle the buffer while it
+		 * does that */
+		if (!SPA_ATOMIC_CAS(b->state, DIRECT_PENDING, DIRECT_BUSY)) {
+			if (SPA_ATOMIC_LOAD(b->state) == DIRECT_BUSY)
+				break;
+		} else {
+			if (b->gen == gen) {
+				if (take && b->index == index && b->size == size)
+					buf = b->buffer;
+				else if ((int32_t)(b->index + b->size - index) > 0)
+					direct_block_store(stream, b);
+			}
+			SPA_ATOMIC_STORE(b->state, DIRECT_DONE);
+		}
+		if (buf == NULL)
+			stream_recycle_direct(stream, b->buffer);
+
+		spa_ringbuffer_read_update(&stream->direct_ring, rindex + 1);
+	}
+	return buf;
 }
 
 static bool stream_prebuf_active(struct stream *stream, int32_t avail)
@@ -242,9 +413,52 @@ void stream_set_paused(struct stream *stream, bool paused, const char *reason)
 	pw_stream_set_active(stream->stream, !paused);
 }
 
+struct pause_request {
+	struct stream *stream;
+	uint32_t channel;
+	bool paused;
+	const char *reason;
+};
+
+static int do_set_paused(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct client *client = user_data;
+	const struct pause_request *r = data;
+	struct stream *stream;
+
+	/* the stream could have been freed or corked in the meantime */
+	stream = pw_map_lookup(&client->streams, r->channel);
+	if (stream == r->stream && (r->paused || !stream->corked))
+		stream_set_paused(stream, r->paused, r->reason);
+
+	client_unref(client);
+	return 0;
+}
+
+/* pause or resume the stream from the io thread, the pw_stream is
+ * only used from the main loop */
+void stream_queue_paused(struct stream *stream, bool paused, const char *reason)
+{
+	struct client *client = stream->client;
+	struct pause_request r = {
+		.stream = stream,
+		.channel = stream->channel,
+		.paused = paused,
+		.reason = reason,
+	};
+
+	SPA_ATOMIC_INC(client->ref);
+	pw_loop_invoke(stream->impl->main_loop, do_set_paused, 0,
+			&r, sizeof(r), false, client);
+}
+
 void stream_set_corked(struct stream *stream, bool cork)
 {
+	/* the io thread checks this when data arrives or is played */
+	pw_loop_lock(stream->impl->io_loop);
 	stream->corked = cork;
+	pw_loop_unlock(stream->impl->io_loop);
 	pw_log_info("cork %d", cork);
 	pw_stream_update_properties(stream->stream,
 			&SPA_DICT_ITEMS(
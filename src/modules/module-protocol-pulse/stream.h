@@ -27,6 +27,22 @@ struct buffer_attr {
 	uint32_t fragsize;
 };
 
+#define DIRECT_BLOCKS	4u
+
+#define DIRECT_PENDING	0u	/* not handled yet */
+#define DIRECT_BUSY	1u	/* claimed, being stored or taken */
+#define DIRECT_DONE	2u	/* stored, taken or dropped */
+
+/* client data that the io thread wrote directly into a stream buffer */
+struct direct_block {
+	struct pw_buffer *buffer;
+	uint32_t index;		/* index in the ringbuffer */
+	uint32_t size;
+	uint32_t gen;
+	uint32_t state;		/* one of DIRECT_*, the thread that moves it
+				 * from PENDING to BUSY handles the block */
+};
+
 enum stream_type {
 	STREAM_TYPE_RECORD,
 	STREAM_TYPE_PLAYBACK,
@@ -56,6 +72,15 @@ struct stream {
 	struct spa_ringbuffer ring;
 	void *buffer;
 
+	/* a spare buffer handed from the data thread to the io thread, which
+	 * fills it and passes it back in direct. The blocks take the place of
+	 * their range in the ringbuffer. */
+	struct pw_buffer *direct_free;
+	struct spa_ringbuffer direct_ring;
+	struct direct_block direct[DIRECT_BLOCKS];
+	uint32_t direct_gen;
+	uint32_t direct_size;
+
 	int64_t read_index;
 	int64_t write_index;
 	uint64_t underrun_for;
@@ -87,17 +112,20 @@ struct stream {
 	bool muted;
 
 	uint32_t drain_tag;
+
+	/* written from the io thread */
+	bool is_underrun;
+	bool in_prebuf;
+	bool is_idle;
+
 	unsigned int corked:1;
 	unsigned int draining:1;
 	unsigned int volume_set:1;
 	unsigned int muted_set:1;
 	unsigned int early_requests:1;
 	unsigned int adjust_latency:1;
-	unsigned int is_underrun:1;
-	unsigned int in_prebuf:1;
 	unsigned int killed:1;
 	unsigned int pending:1;
-	unsigned int is_idle:1;
 	unsigned int is_paused:1;
 	unsigned int fail_on_suspend:1;
 	unsigned int is_suspended:1;
@@ -109,10 +137,18 @@ struct stream *stream_new(struct client *client, enum stream_type type, uint32_t
 void stream_created(struct stream *stream);
 void stream_free(struct stream *stream);
 void stream_flush(struct stream *stream);
+void stream_reset_direct(struct stream *stream);
+void stream_store_direct(struct stream *stream);
+uint32_t stream_write_direct(struct stream *stream, uint32_t index, int32_t filled,
+		const void *data, uint32_t size);
+struct pw_buffer *stream_pop_direct(struct stream *stream, uint32_t index, uint32_t size,
+		bool take);
+void stream_recycle_direct(struct stream *stream, struct pw_buffer *buffer);
 uint32_t stream_pop_missing(struct stream *stream);
 
 void stream_set_corked(struct stream *stream, bool corked);
 void stream_set_paused(struct stream *stream, bool paused, const char *reason);
+void stream_queue_paused(struct stream *stream, bool paused, const char *reason);
 
 int stream_send_underflow(struct stream *stream, int64_t offset);
 int stream_send_overflow(struct stream *stream);
@@ -486,13 +486,12 @@ unexpected_ssrc:
 
 static void set_timer(struct impl *impl, uint64_t time, uint64_t itime)
 {
-	struct itimerspec ts;
-	ts.it_value.tv_sec = time / SPA_NSEC_PER_SEC;
-	ts.it_value.tv_nsec = time % SPA_NSEC_PER_SEC;
-	ts.it_interval.tv_sec = itime / SPA_NSEC_PER_SEC;
-	ts.it_interval.tv_nsec = itime % SPA_NSEC_PER_SEC;
-	spa_system_timerfd_settime(impl->data_loop->system,
-			impl->timer->fd, SPA_FD_TIMER_ABSTIME, &ts, NULL);
+	struct timespec value, interval;
+	value.tv_sec = time / SPA_NSEC_PER_SEC;
+	value.tv_nsec = time % SPA_NSEC_PER_SEC;
+	interval.tv_sec = itime / SPA_NSEC_PER_SEC;
+	interval.tv_nsec = itime % SPA_NSEC_PER_SEC;
+	pw_loop_update_timer(impl->data_loop, impl->timer, &value, &interval, true);
 	set_timer_running(impl, time != 0 && itime != 0);
 }
 
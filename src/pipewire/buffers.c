@@ -83,7 +83,9 @@ static int alloc_buffers(struct pw_mempool *pool,
 		m = pw_mempool_alloc(pool,
 				PW_MEMBLOCK_FLAG_READWRITE |
 				PW_MEMBLOCK_FLAG_SEAL |
-				PW_MEMBLOCK_FLAG_MAP,
+				PW_MEMBLOCK_FLAG_MAP |
+				(SPA_FLAG_IS_SET(flags, PW_BUFFERS_FLAG_HUGEPAGES) ?
+				 PW_MEMBLOCK_FLAG_HUGEPAGES : 0),
 				SPA_DATA_MemFd,
 				n_buffers * info.mem_size);
 		if (m == NULL) {
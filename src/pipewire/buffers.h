@@ -31,6 +31,7 @@ extern "C" {
 #define PW_BUFFERS_FLAG_DYNAMIC		(1<<2)	/**< buffers have dynamic data */
 #define PW_BUFFERS_FLAG_IN_PRIORITY	(1<<4)	/**< input parameters have priority */
 #define PW_BUFFERS_FLAG_ASYNC		(1<<5)	/**< one of the nodes is async */
+#define PW_BUFFERS_FLAG_HUGEPAGES	(1<<6)	/**< shared memory can be allocated from huge pages */
 
 struct pw_buffers {
 	struct pw_memblock *mem;	/**< allocated buffer memory */
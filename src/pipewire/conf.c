@@ -358,9 +358,10 @@ int pw_conf_save_state(const char *prefix, const char *name, const struct pw_pro
 	if ((sfd = open_write_dir(path, sizeof(path), prefix)) < 0)
 		return sfd;
 
-	tmp_name = alloca(strlen(name)+5);
-	sprintf(tmp_name, "%s.tmp", name);
-	if ((fd = openat(sfd, tmp_name,  O_CLOEXEC | O_CREAT | O_WRONLY | O_TRUNC, 0600)) < 0) {
+	/* use a unique temp file, other processes might save the same state */
+	tmp_name = alloca(strlen(path)+strlen(name)+8);
+	sprintf(tmp_name, "%s%s.XXXXXX", path, name);
+	if ((fd = mkostemp(tmp_name, O_CLOEXEC)) < 0) {
 		res = -errno;
 		pw_log_error("can't open file '%s': %m", tmp_name);
 		return res;
@@ -375,6 +376,7 @@ int pw_conf_save_state(const char *prefix, const char *name, const struct pw_pro
 	if (renameat(sfd, tmp_name, sfd, name) < 0) {
 		res = -errno;
 		pw_log_error("can't rename temp file '%s': %m", tmp_name);
+		unlink(tmp_name);
 		return res;
 	}
 
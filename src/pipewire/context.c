@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <time.h>
 #include <stdio.h>
 #include <regex.h>
@@ -24,6 +25,9 @@
 #include <spa/utils/string.h>
 #include <spa/utils/json.h>
 #include <spa/utils/cleanup.h>
+#include <spa/buffer/buffer.h>
+#include <spa/pod/builder.h>
+#include <spa/pod/dynamic.h>
 #include <spa/debug/types.h>
 
 #include <pipewire/impl.h>
@@ -41,6 +45,13 @@ PW_LOG_TOPIC_EXTERN(log_context);
 #define MAX_LOOPS	64u
 
 #define DEFAULT_DATA_LOOPS	1
+#define DEFAULT_WORKERS		0
+
+#define DEFAULT_ADAPTIVE_QUANTUM		false
+#define DEFAULT_ADAPTIVE_MAX_LOAD		0.75f
+#define DEFAULT_ADAPTIVE_MIN_LOAD		0.30f
+#define DEFAULT_ADAPTIVE_MAX_QUANTUM		0u
+#define DEFAULT_ADAPTIVE_STABLE_TIME		10u
 
 #if !defined(FNM_EXTMATCH)
 #define FNM_EXTMATCH 0
@@ -51,6 +62,8 @@ struct data_loop {
 	bool autostart;
 	bool started;
 	uint64_t last_used;
+	uint32_t n_nodes;
+	uint64_t load;
 };
 
 /** \cond */
@@ -60,11 +73,22 @@ struct impl {
 	struct spa_plugin_loader plugin_loader;
 	unsigned int recalc:1;
 	unsigned int recalc_pending:1;
+	unsigned int group_index:1;
+
+	struct pw_array groups;			/* struct group_entry */
 
 	uint32_t cpu_count;
 
 	uint32_t n_data_loops;
 	struct data_loop data_loops[MAX_LOOPS];
+
+	struct {
+		struct spa_source *timer;
+		float max_load;			/* grow the quantum above this load */
+		float min_load;			/* shrink the quantum below this load */
+		uint32_t max_quantum;		/* upper bound, 0 is clock.max-quantum */
+		uint32_t stable_time;		/* seconds of low load before shrinking */
+	} adaptive;
 };
 
 
@@ -137,6 +161,9 @@ static int context_set_freewheel(struct pw_context *context, bool freewheel)
 		if (res < 0)
 			pw_log_info("%p: freewheel error:%s", context, spa_strerror(res));
 	}
+	if (context->worker_pool &&
+	    (res = pw_worker_pool_set_rt(context->worker_pool, !freewheel)) < 0)
+		pw_log_info("%p: worker pool freewheel error:%s", context, spa_strerror(res));
 	context->freewheeling = freewheel;
 
 	return res;
@@ -198,6 +225,7 @@ static int setup_data_loops(struct impl *impl)
 	struct pw_context *this = &impl->this;
 	const char *str, *lib_name;
 	uint32_t i;
+	int32_t count;
 	int res = 0;
 
 	pr = pw_properties_copy(this->properties);
@@ -250,7 +278,7 @@ static int setup_data_loops(struct impl *impl)
 		}
 		impl->n_data_loops = i;
 	} else {
-		int32_t count = pw_properties_get_int32(pr, "context.num-data-loops",
+		count = pw_properties_get_int32(pr, "context.num-data-loops",
 				DEFAULT_DATA_LOOPS);
 		if (count < 0)
 			count = impl->cpu_count;
@@ -273,11 +301,128 @@ static int setup_data_loops(struct impl *impl)
 		}
 	}
 	pw_log_info("created %d data-loops", impl->n_data_loops);
+
+	count = pw_properties_get_int32(this->properties, "context.num-workers",
+			DEFAULT_WORKERS);
+	if (count < 0)
+		count = impl->cpu_count;
+	if (count > 0) {
+		pw_properties_clear(pr);
+		pw_properties_update(pr, &this->properties->dict);
+		pw_properties_set(pr, PW_KEY_LIBRARY_NAME_SYSTEM, lib_name);
+		pw_properties_set(pr, PW_KEY_LOOP_NAME, "worker-pool");
+		this->worker_pool = pw_worker_pool_new(this, &pr->dict, count);
+		if (this->worker_pool == NULL) {
+			res = -errno;
+			goto exit;
+		}
+	}
 exit:
 	pw_properties_free(pr);
 	return res;
 }
 
+/* Raise the quantum of a driver when the graph is overloaded or has xruns and
+ * walk it back down when the load stays low for some time. */
+static void adaptive_quantum_timeout(void *data, uint64_t expirations)
+{
+	struct impl *impl = data;
+	struct pw_context *context = &impl->this;
+	struct settings *s = &context->settings;
+	struct pw_impl_node *n, *f;
+	uint32_t max_quantum, quantum, target, xruns, count;
+	bool changed = false;
+	float load;
+
+	max_quantum = impl->adaptive.max_quantum ?
+		impl->adaptive.max_quantum : s->clock_max_quantum;
+
+	spa_list_for_each(n, &context->driver_list, driver_link) {
+		struct pw_node_activation *a = n->rt.target.activation;
+
+		if (!n->driving || n->exported || a == NULL)
+			continue;
+
+		xruns = 0;
+		spa_list_for_each(f, &n->follower_list, follower_link) {
+			if (f->rt.target.activation != NULL)
+				xruns += f->rt.target.activation->xrun_count;
+		}
+		count = xruns > n->adaptive_xruns ? xruns - n->adaptive_xruns : 0;
+		n->adaptive_xruns = xruns;
+
+		if (n->info.state != PW_NODE_STATE_RUNNING) {
+			n->adaptive_quantum = 0;
+			n->adaptive_stable = 0;
+			continue;
+		}
+
+		quantum = n->rt.position->clock.duration;
+		load = a->cpu_load[1];
+
+		if (count > 0 || load > impl->adaptive.max_load) {
+			n->adaptive_stable = 0;
+			target = SPA_MIN(quantum * 2, max_quantum);
+			if (target <= quantum || target <= n->adaptive_quantum)
+				continue;
+			pw_log_info("(%s-%u) xruns:%u load:%f grow quantum %u->%u",
+					n->name, n->info.id, count, load, quantum, target);
+			n->adaptive_quantum = target;
+			changed = true;
+		}
+		else if (n->adaptive_quantum > 0 && load < impl->adaptive.min_load) {
+			if (++n->adaptive_stable < impl->adaptive.stable_time)
+				continue;
+			n->adaptive_stable = 0;
+			target = n->adaptive_quantum / 2;
+			pw_log_info("(%s-%u) load:%f shrink quantum %u->%u",
+					n->name, n->info.id, load, quantum, target);
+			n->adaptive_quantum = target;
+			changed = true;
+		} else {
+			n->adaptive_stable = 0;
+		}
+	}
+	if (changed)
+		pw_context_recalc_graph(context, "adaptive quantum");
+}
+
+static int setup_adaptive_quantum(struct impl *impl)
+{
+	struct pw_context *this = &impl->this;
+	struct pw_properties *p = this->properties;
+	struct timespec value, interval;
+	const char *str;
+
+	if (!pw_properties_get_bool(p, "clock.adaptive-quantum", DEFAULT_ADAPTIVE_QUANTUM))
+		return 0;
+
+	impl->adaptive.max_load = DEFAULT_ADAPTIVE_MAX_LOAD;
+	if ((str = pw_properties_get(p, "clock.adaptive-quantum.max-load")) != NULL)
+		impl->adaptive.max_load = pw_properties_parse_float(str);
+	impl->adaptive.min_load = DEFAULT_ADAPTIVE_MIN_LOAD;
+	if ((str = pw_properties_get(p, "clock.adaptive-quantum.min-load")) != NULL)
+		impl->adaptive.min_load = pw_properties_parse_float(str);
+	impl->adaptive.max_quantum = pw_properties_get_uint32(p,
+			"clock.adaptive-quantum.max-quantum", DEFAULT_ADAPTIVE_MAX_QUANTUM);
+	impl->adaptive.stable_time = pw_properties_get_uint32(p,
+			"clock.adaptive-quantum.stable-time", DEFAULT_ADAPTIVE_STABLE_TIME);
+
+	impl->adaptive.timer = pw_loop_add_timer(this->main_loop,
+			adaptive_quantum_timeout, impl);
+	if (impl->adaptive.timer == NULL)
+		return -errno;
+
+	value.tv_sec = interval.tv_sec = 1;
+	value.tv_nsec = interval.tv_nsec = 0;
+	pw_loop_update_timer(this->main_loop, impl->adaptive.timer, &value, &interval, false);
+
+	pw_log_info("%p: adaptive quantum load:%f-%f max-quantum:%u stable-time:%u",
+			this, impl->adaptive.min_load, impl->adaptive.max_load,
+			impl->adaptive.max_quantum, impl->adaptive.stable_time);
+	return 0;
+}
+
 static int data_loop_start(struct impl *impl, struct data_loop *loop)
 {
 	int res;
@@ -420,6 +565,8 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 
 	pw_array_init(&this->factory_lib, 32);
 	pw_array_init(&this->objects, 32);
+	pw_array_init(&impl->groups, 4096);
+	impl->group_index = true;
 	pw_map_init(&this->globals, 128, 32);
 
 	spa_list_init(&this->core_impl_list);
@@ -511,7 +658,7 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 	if ((res = setup_data_loops(impl)) < 0)
 		goto error_free;
 
-	this->pool = pw_mempool_new(NULL);
+	this->pool = pw_mempool_new(pw_context_get_mempool_props(this));
 	if (this->pool == NULL) {
 		res = -errno;
 		goto error_free;
@@ -524,6 +671,9 @@ struct pw_context *pw_context_new(struct pw_loop *main_loop,
 		goto error_free;
 	}
 
+	if ((res = setup_adaptive_quantum(impl)) < 0)
+		goto error_free;
+
 	init_plugin_loader(impl);
 
 	this->support[n_support++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_System, this->main_loop->system);
@@ -622,6 +772,9 @@ void pw_context_destroy(struct pw_context *context)
 	pw_log_debug("%p: destroy", context);
 	pw_context_emit_destroy(context);
 
+	if (impl->adaptive.timer)
+		pw_loop_destroy_source(context->main_loop, impl->adaptive.timer);
+
 	spa_list_consume(core, &context->core_list, link)
 		pw_core_disconnect(core);
 
@@ -639,6 +792,8 @@ void pw_context_destroy(struct pw_context *context)
 
 	for (i = 0; i < impl->n_data_loops; i++)
 		data_loop_stop(impl, &impl->data_loops[i]);
+	if (context->worker_pool)
+		pw_worker_pool_stop(context->worker_pool);
 
 	spa_list_consume(module, &context->module_list, link)
 		pw_impl_module_destroy(module);
@@ -660,6 +815,8 @@ void pw_context_destroy(struct pw_context *context)
 			pw_data_loop_destroy(impl->data_loops[i].impl);
 
 	}
+	if (context->worker_pool)
+		pw_worker_pool_destroy(context->worker_pool);
 
 	if (context->pool)
 		pw_mempool_destroy(context->pool);
@@ -684,6 +841,7 @@ void pw_context_destroy(struct pw_context *context)
 	pw_array_clear(&context->factory_lib);
 
 	pw_array_clear(&context->objects);
+	pw_array_clear(&impl->groups);
 
 	pw_map_clear(&context->globals);
 
@@ -718,6 +876,9 @@ const struct spa_support *context_get_support(struct pw_context *context, uint32
 	if (loop != NULL) {
 		context->support[n++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataSystem, loop->system);
 		context->support[n++] = SPA_SUPPORT_INIT(SPA_TYPE_INTERFACE_DataLoop, loop->loop);
+		/* the loop stays alive with the context, we only need the
+		 * placement, which is accounted for by the node */
+		pw_context_release_loop(context, loop);
 	}
 	*n_support = n;
 	return context->support;
@@ -735,7 +896,78 @@ struct pw_loop *pw_context_get_main_loop(struct pw_context *context)
 	return context->main_loop;
 }
 
-static struct pw_data_loop *acquire_data_loop(struct impl *impl, const char *name, const char *klass)
+static struct data_loop *find_data_loop(struct impl *impl, struct pw_loop *loop)
+{
+	uint32_t i;
+	for (i = 0; i < impl->n_data_loops; i++) {
+		struct data_loop *l = &impl->data_loops[i];
+		if (l->impl->loop == loop)
+			return l;
+	}
+	return NULL;
+}
+
+/* Estimate the load of the data loops from the time the nodes took to
+ * process their last cycle. This is used to place new nodes. */
+static void update_data_loop_load(struct impl *impl)
+{
+	struct pw_impl_node *n;
+	struct data_loop *l;
+	uint32_t i;
+
+	for (i = 0; i < impl->n_data_loops; i++)
+		impl->data_loops[i].load = 0;
+
+	spa_list_for_each(n, &impl->this.node_list, link) {
+		struct pw_node_activation *a = n->rt.target.activation;
+
+		/* remote nodes do their processing in the client */
+		if (!n->active || n->remote || a == NULL ||
+		    (l = find_data_loop(impl, n->data_loop)) == NULL)
+			continue;
+		if (a->finish_time > a->awake_time)
+			l->load += SPA_MIN(a->finish_time - a->awake_time,
+					(uint64_t)SPA_NSEC_PER_SEC);
+	}
+}
+
+/* Nodes in the same link group are chained and are best processed
+ * on the same loop */
+static struct pw_loop *find_link_group_loop(struct impl *impl, const struct spa_dict *props)
+{
+	struct pw_impl_node *n;
+	const char *str;
+	spa_auto(pw_strv) groups = NULL;
+
+	if (props == NULL ||
+	    (str = spa_dict_lookup(props, PW_KEY_NODE_LINK_GROUP)) == NULL ||
+	    (groups = pw_strv_parse(str, strlen(str), INT_MAX, NULL)) == NULL)
+		return NULL;
+
+	spa_list_for_each(n, &impl->this.node_list, link) {
+		if (n->link_groups != NULL &&
+		    pw_strv_find_common(n->link_groups, groups) >= 0)
+			return n->data_loop;
+	}
+	return NULL;
+}
+
+/* with equal scores, prefer the loop of the link group, then the least
+ * loaded loop, the loop with the least nodes and the least recently used
+ * loop */
+static bool is_better_loop(struct data_loop *l, struct data_loop *best, struct pw_loop *prefer)
+{
+	if (prefer != NULL && (l->impl->loop == prefer) != (best->impl->loop == prefer))
+		return l->impl->loop == prefer;
+	if (l->load != best->load)
+		return l->load < best->load;
+	if (l->n_nodes != best->n_nodes)
+		return l->n_nodes < best->n_nodes;
+	return l->last_used < best->last_used;
+}
+
+static struct data_loop *acquire_data_loop(struct impl *impl, const char *name, const char *klass,
+		struct pw_loop *prefer)
 {
 	uint32_t i, j;
 	struct data_loop *best_loop = NULL;
@@ -760,12 +992,12 @@ static struct pw_data_loop *acquire_data_loop(struct impl *impl, const char *nam
 			}
 		}
 
-		pw_log_debug("%d: name:'%s' class:'%s' score:%d last_used:%"PRIu64, i,
-				ln, l->impl->class, score, l->last_used);
+		pw_log_debug("%d: name:'%s' class:'%s' score:%d load:%"PRIu64" nodes:%u last_used:%"PRIu64,
+				i, ln, l->impl->class, score, l->load, l->n_nodes, l->last_used);
 
 		if ((best_loop == NULL) ||
 		    (score > best_score) ||
-		    (score == best_score && l->last_used < best_loop->last_used)) {
+		    (score == best_score && is_better_loop(l, best_loop, prefer))) {
 			best_loop = l;
 			best_score = score;
 		}
@@ -779,18 +1011,19 @@ static struct pw_data_loop *acquire_data_loop(struct impl *impl, const char *nam
 		return NULL;
 	}
 
-	pw_log_info("%p: using name:'%s' class:'%s' last_used:%"PRIu64, impl,
-			best_loop->impl->loop->name,
-			best_loop->impl->class, best_loop->last_used);
+	pw_log_info("%p: using name:'%s' class:'%s' load:%"PRIu64" nodes:%u last_used:%"PRIu64,
+			impl, best_loop->impl->loop->name, best_loop->impl->class,
+			best_loop->load, best_loop->n_nodes, best_loop->last_used);
 
-	return best_loop->impl;
+	return best_loop;
 }
 
 SPA_EXPORT
 struct pw_data_loop *pw_context_get_data_loop(struct pw_context *context)
 {
 	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
-	return acquire_data_loop(impl, NULL, NULL);
+	struct data_loop *loop = acquire_data_loop(impl, NULL, NULL, NULL);
+	return loop ? loop->impl : NULL;
 }
 
 SPA_EXPORT
@@ -798,13 +1031,27 @@ struct pw_loop *pw_context_acquire_loop(struct pw_context *context, const struct
 {
 	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
 	const char *name, *klass;
-	struct pw_data_loop *loop;
+	struct data_loop *loop;
+	bool pipeline;
+	int res;
 
 	name = props ? spa_dict_lookup(props, PW_KEY_NODE_LOOP_NAME) : NULL;
 	klass = props ? spa_dict_lookup(props, PW_KEY_NODE_LOOP_CLASS) : NULL;
 
 	pw_log_info("%p: looking for name:'%s' class:'%s'", context, name, klass);
 
+	if (context->worker_pool != NULL) {
+		struct pw_loop *pl = pw_worker_pool_get_loop(context->worker_pool);
+		if ((name && fnmatch(name, pl->name, FNM_EXTMATCH) == 0) ||
+		    (klass && fnmatch(klass, "pool", FNM_EXTMATCH) == 0)) {
+			pw_log_info("%p: using worker pool", context);
+			if ((res = pw_worker_pool_start(context->worker_pool)) < 0) {
+				errno = -res;
+				return NULL;
+			}
+			return pl;
+		}
+	}
 	if ((impl->n_data_loops == 0) ||
 	    (name && fnmatch(name, context->main_loop->name, FNM_EXTMATCH) == 0) ||
 	    (klass && fnmatch(klass, "main", FNM_EXTMATCH) == 0)) {
@@ -812,24 +1059,40 @@ struct pw_loop *pw_context_acquire_loop(struct pw_context *context, const struct
 		return context->main_loop;
 	}
 
-	loop = acquire_data_loop(impl, name, klass);
-	return loop ? loop->loop : NULL;
+	/* pipeline stages run concurrently with their upstream stage so they
+	 * should not share the loop of their link group */
+	pipeline = props ? spa_atob(spa_dict_lookup(props, PW_KEY_NODE_PIPELINE)) : false;
+
+	loop = acquire_data_loop(impl, name, klass,
+			pipeline ? NULL : find_link_group_loop(impl, props));
+	if (loop == NULL)
+		return NULL;
+	SPA_ATOMIC_INC(loop->n_nodes);
+	return loop->impl->loop;
 }
 
 SPA_EXPORT
 void pw_context_release_loop(struct pw_context *context, struct pw_loop *loop)
 {
 	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
-	uint32_t i;
+	struct data_loop *l;
 
-	for (i = 0; i < impl->n_data_loops; i++) {
-		struct data_loop *l = &impl->data_loops[i];
-		if (l->impl->loop == loop) {
-			pw_log_info("release name:'%s' class:'%s' last_used:%"PRIu64,
-					l->impl->loop->name, l->impl->class, l->last_used);
-			return;
-		}
-	}
+	if ((l = find_data_loop(impl, loop)) == NULL)
+		return;
+
+	if (l->n_nodes > 0)
+		SPA_ATOMIC_DEC(l->n_nodes);
+	pw_log_info("release name:'%s' class:'%s' nodes:%u last_used:%"PRIu64,
+			l->impl->loop->name, l->impl->class, l->n_nodes, l->last_used);
+}
+
+/* the number of nodes that acquired the data loop, the data threads read
+ * this to decide if a node can spin without delaying other nodes */
+const uint32_t *pw_context_get_loop_nodes(struct pw_context *context, struct pw_loop *loop)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct data_loop *l = find_data_loop(impl, loop);
+	return l ? &l->n_nodes : NULL;
 }
 
 SPA_EXPORT
@@ -1068,6 +1331,137 @@ static inline int run_nodes(struct pw_context *context, struct pw_impl_node *nod
 	return 0;
 }
 
+#define GROUP_TYPE_GROUP	0
+#define GROUP_TYPE_LINK		1
+#define GROUP_TYPE_SYNC		2
+
+/* An entry for each group, link group and sync group of the registered nodes.
+ * The entries are sorted on type and name and are updated when nodes are
+ * added, removed or change their groups so that collect_nodes() can find the
+ * nodes of a group without going over all nodes. */
+struct group_entry {
+	uint32_t type;
+	const char *name;
+	struct pw_impl_node *node;
+};
+
+/* position of the first entry of the group or, with after, of the first
+ * entry after the group */
+static uint32_t find_group(struct impl *impl, uint32_t type, const char *name, bool after)
+{
+	struct group_entry *entries = impl->groups.data, *e;
+	uint32_t lo, hi, mid;
+	int res;
+
+	lo = 0;
+	hi = pw_array_get_len(&impl->groups, struct group_entry);
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		e = &entries[mid];
+		res = e->type != type ? (e->type < type ? -1 : 1) : strcmp(e->name, name);
+		if (res < 0 || (after && res == 0))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int add_group_entries(struct impl *impl, uint32_t type, char **names,
+		struct pw_impl_node *node)
+{
+	struct group_entry *entries;
+	uint32_t i, pos, len;
+
+	for (i = 0; names && names[i]; i++) {
+		pos = find_group(impl, type, names[i], true);
+		if (pw_array_add(&impl->groups, sizeof(struct group_entry)) == NULL)
+			return -errno;
+		entries = impl->groups.data;
+		len = pw_array_get_len(&impl->groups, struct group_entry);
+		memmove(&entries[pos + 1], &entries[pos], (len - pos - 1) * sizeof(struct group_entry));
+		entries[pos] = (struct group_entry) { type, names[i], node };
+	}
+	return 0;
+}
+
+void pw_context_add_node_groups(struct pw_context *context, struct pw_impl_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	int res;
+
+	if (!impl->group_index)
+		return;
+
+	if ((res = add_group_entries(impl, GROUP_TYPE_GROUP, node->groups, node)) < 0 ||
+	    (res = add_group_entries(impl, GROUP_TYPE_LINK, node->link_groups, node)) < 0 ||
+	    (res = add_group_entries(impl, GROUP_TYPE_SYNC, node->sync_groups, node)) < 0) {
+		pw_log_warn("%p: can't update group index: %s", context, spa_strerror(res));
+		impl->group_index = false;
+	}
+}
+
+void pw_context_remove_node_groups(struct pw_context *context, struct pw_impl_node *node)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct group_entry *e, *d;
+
+	if (!impl->group_index)
+		return;
+
+	/* only the node of the entries is used, the names can already be freed */
+	d = impl->groups.data;
+	pw_array_for_each(e, &impl->groups) {
+		if (e->node != node)
+			*d++ = *e;
+	}
+	impl->groups.size = SPA_PTRDIFF(d, impl->groups.data);
+}
+
+/* make the index again after it could not be updated */
+static void rebuild_group_index(struct pw_context *context)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct pw_impl_node *n;
+
+	pw_array_reset(&impl->groups);
+	impl->group_index = true;
+
+	spa_list_for_each(n, &context->node_list, link) {
+		pw_context_add_node_groups(context, n);
+		if (!impl->group_index)
+			break;
+	}
+}
+
+/* add the not yet visited nodes of the given groups to the queue */
+static void join_groups(struct pw_context *context, struct pw_impl_node *node,
+		uint32_t type, char **names, struct spa_list *queue)
+{
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
+	struct group_entry *entries = impl->groups.data, *e;
+	uint32_t i, n_entries;
+
+	n_entries = pw_array_get_len(&impl->groups, struct group_entry);
+
+	for (i = 0; names && names[i]; i++) {
+		for (e = &entries[find_group(impl, type, names[i], false)];
+		     e < &entries[n_entries]; e++) {
+			struct pw_impl_node *t = e->node;
+
+			if (e->type != type || !spa_streq(e->name, names[i]))
+				break;
+			if (t->exported || !t->active || t->visited)
+				continue;
+
+			pw_log_debug("%p: %s join group of %s",
+					t, t->name, node->name);
+			t->visited = true;
+			spa_list_append(queue, &t->sort_link);
+		}
+	}
+}
+
 /* Follow all prepared links and groups from node, activate the links.
  * If a non-passive link is found, we set the peer runnable flag.
  *
@@ -1081,11 +1475,12 @@ static inline int run_nodes(struct pw_context *context, struct pw_impl_node *nod
  */
 static int collect_nodes(struct pw_context *context, struct pw_impl_node *node, struct spa_list *collect)
 {
+	struct impl *impl = SPA_CONTAINER_OF(context, struct impl, this);
 	struct spa_list queue;
 	struct pw_impl_node *n, *t;
 	struct pw_impl_port *p;
 	struct pw_impl_link *l;
-	uint32_t n_sync;
+	uint32_t n_sync, n_sync_joined;
 	char *sync[MAX_SYNC+1];
 
 	pw_log_debug("node %p: '%s'", node, node->name);
@@ -1095,7 +1490,7 @@ static int collect_nodes(struct pw_context *context, struct pw_impl_node *node,
 	spa_list_append(&queue, &node->sort_link);
 	node->visited = true;
 
-	n_sync = 0;
+	n_sync = n_sync_joined = 0;
 	sync[0] = NULL;
 
 	/* now follow all the links from the nodes in the queue
@@ -1165,7 +1560,13 @@ static int collect_nodes(struct pw_context *context, struct pw_impl_node *node,
 		}
 		/* now go through all the nodes that have the same group and
 		 * that are not yet visited */
-		if (n->groups != NULL || n->link_groups != NULL || sync[0] != NULL) {
+		if (impl->group_index) {
+			join_groups(context, n, GROUP_TYPE_GROUP, n->groups, &queue);
+			join_groups(context, n, GROUP_TYPE_LINK, n->link_groups, &queue);
+			/* the nodes of the sync groups we already joined are visited */
+			join_groups(context, n, GROUP_TYPE_SYNC, &sync[n_sync_joined], &queue);
+			n_sync_joined = n_sync;
+		} else if (n->groups != NULL || n->link_groups != NULL || sync[0] != NULL) {
 			spa_list_for_each(t, &context->node_list, link) {
 				if (t->exported || !t->active || t->visited)
 					continue;
@@ -1452,6 +1853,8 @@ int pw_context_recalc_graph(struct pw_context *context, const char *reason)
 		return -EBUSY;
 	}
 
+	update_data_loop_load(impl);
+
 again:
 	impl->recalc = true;
 	freewheel = false;
@@ -1462,6 +1865,8 @@ again:
 		n->checked = 0;
 		n->runnable = n->always_process && n->active;
 	}
+	if (!impl->group_index)
+		rebuild_group_index(context);
 
 	get_quantums(context, &def_quantum, &min_quantum, &max_quantum, &rate_quantum,
 			&floor_quantum, &ceil_quantum);
@@ -1757,6 +2162,17 @@ again:
 
 			if (settings->clock_power_of_two_quantum && !force_quantum)
 				target_quantum = flp2(target_quantum);
+
+			/* the adaptive quantum can only raise the quantum, when it
+			 * no longer does, it is not needed anymore */
+			if (force_quantum || n->adaptive_quantum <= target_quantum)
+				n->adaptive_quantum = 0;
+			else {
+				target_quantum = SPA_MIN(n->adaptive_quantum,
+						SPA_MIN(node_max_quantum, ceil_quantum));
+				if (settings->clock_power_of_two_quantum)
+					target_quantum = flp2(target_quantum);
+			}
 		}
 
 		if (target_quantum != current_quantum) {
@@ -1834,6 +2250,9 @@ again:
 		/* now that all the followers are ready, start the driver */
 		ensure_state(n, running);
 	}
+	spa_list_for_each(n, &context->node_list, link)
+		pw_impl_node_update_fused(n);
+
 	impl->recalc = false;
 	if (impl->recalc_pending) {
 		impl->recalc_pending = false;
@@ -1868,6 +2287,135 @@ int pw_context_add_spa_lib(struct pw_context *context,
 	return 0;
 }
 
+/** Make the properties for a new memory pool from the mem.* properties
+ * of the context */
+struct pw_properties *pw_context_get_mempool_props(struct pw_context *context)
+{
+	static const char * const keys[] = {
+		"mem.cache-size",
+		"mem.hugepages",
+		"mem.prefault",
+		NULL
+	};
+	struct pw_properties *props;
+
+	if ((props = pw_properties_new(NULL, NULL)) != NULL)
+		pw_properties_update_keys(props, &context->properties->dict, keys);
+	return props;
+}
+
+/* The registry snapshot is a list of Struct records, one for each global:
+ *
+ *   Int id, Int permission mask, String type, Int version, Struct props
+ *
+ * The memory is shared with all clients that get the snapshot and they can
+ * keep it, so it is never changed after it was built. When the globals
+ * change, the next registry gets a new snapshot. */
+static int snapshot_build(struct pw_context *context, struct spa_pod_builder *b)
+{
+	struct pw_global *global;
+	struct spa_pod_frame f[2];
+	uint32_t i;
+
+	spa_list_for_each(global, &context->global_list, link) {
+		const struct spa_dict *dict = &global->properties->dict;
+
+		spa_pod_builder_push_struct(b, &f[0]);
+		spa_pod_builder_int(b, global->id);
+		spa_pod_builder_int(b, global->permission_mask);
+		spa_pod_builder_string(b, global->type);
+		spa_pod_builder_int(b, global->version);
+		spa_pod_builder_push_struct(b, &f[1]);
+		spa_pod_builder_int(b, dict->n_items);
+		for (i = 0; i < dict->n_items; i++) {
+			spa_pod_builder_string(b, dict->items[i].key);
+			spa_pod_builder_string(b, dict->items[i].value ? dict->items[i].value : "");
+		}
+		spa_pod_builder_pop(b, &f[1]);
+		spa_pod_builder_pop(b, &f[0]);
+	}
+	if (b->state.offset > b->size)
+		return -ENOSPC;
+	return 0;
+}
+
+static int snapshot_rebuild(struct pw_context *context)
+{
+	struct spa_pod_dynamic_builder b;
+	struct pw_memblock *mem = NULL;
+	uint8_t buffer[4096];
+	uint32_t size;
+	int res;
+
+	spa_pod_dynamic_builder_init(&b, buffer, sizeof(buffer), 64 * 1024);
+	if ((res = snapshot_build(context, &b.b)) < 0)
+		goto exit;
+	if ((size = b.b.state.offset) == 0) {
+		res = -ENOENT;
+		goto exit;
+	}
+
+	mem = pw_mempool_alloc(context->pool, PW_MEMBLOCK_FLAG_READABLE,
+			SPA_DATA_MemFd, size);
+	if (mem == NULL) {
+		res = -errno;
+		goto exit;
+	}
+	/* write without a mapping, F_SEAL_WRITE can't be added while there
+	 * is a shared writable mapping */
+	if (pwrite(mem->fd, b.b.data, size, 0) != (ssize_t)size) {
+		res = errno ? -errno : -EIO;
+		goto exit;
+	}
+#ifdef HAVE_MEMFD_CREATE
+	if (fcntl(mem->fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_GROW |
+				F_SEAL_SHRINK | F_SEAL_SEAL) < 0) {
+		res = -errno;
+		pw_log_info("%p: can't seal registry snapshot, disabling: %m", context);
+		context->no_snapshot = true;
+		goto exit;
+	}
+#else
+	res = -ENOTSUP;
+	context->no_snapshot = true;
+	goto exit;
+#endif
+	if (context->snapshot)
+		pw_memblock_unref(context->snapshot);
+	context->snapshot = mem;
+	context->snapshot_size = size;
+	context->snapshot_serial = context->registry_serial;
+	mem = NULL;
+
+	pw_log_debug("%p: registry snapshot size:%u serial:%"PRIu64, context,
+			size, context->snapshot_serial);
+	res = 0;
+exit:
+	if (mem)
+		pw_memblock_unref(mem);
+	spa_pod_dynamic_builder_clean(&b);
+	return res;
+}
+
+/** Get the registry snapshot and its size for the current registry_serial */
+int pw_context_get_registry_snapshot(struct pw_context *context,
+		struct pw_memblock **mem, uint32_t *size)
+{
+	int res;
+
+	if (context->no_snapshot)
+		return -ENOTSUP;
+
+	if (context->snapshot == NULL ||
+	    context->snapshot_serial != context->registry_serial) {
+		if ((res = snapshot_rebuild(context)) < 0)
+			return res;
+	}
+	*mem = context->snapshot;
+	*size = context->snapshot_size;
+	return 0;
+}
+
 SPA_EXPORT
 const char *pw_context_find_spa_lib(struct pw_context *context, const char *factory_name)
 {
@@ -1889,12 +2437,15 @@ struct spa_handle *pw_context_load_spa_handle(struct pw_context *context,
 	const struct spa_support *support;
 	uint32_t n_support;
 	struct spa_handle *handle;
+	char cached[PATH_MAX];
 
 	pw_log_debug("%p: load factory %s", context, factory_name);
 
 	lib = pw_context_find_spa_lib(context, factory_name);
 	if (lib == NULL && info != NULL)
 		lib = spa_dict_lookup(info, SPA_KEY_LIBRARY_NAME);
+	if (lib == NULL && pw_find_spa_lib(factory_name, cached, sizeof(cached)) >= 0)
+		lib = cached;
 	if (lib == NULL) {
 		errno = ENOENT;
 		pw_log_warn("%p: no library for %s: %m",
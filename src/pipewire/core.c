@@ -335,10 +335,11 @@ static struct pw_core *core_new(struct pw_context *context,
 		goto error_properties;
 
 	pw_properties_add(properties, &context->properties->dict);
+	pw_properties_set(properties, PW_MEMPOOL_KEY_MAP_HUGEPAGES, "true");
 
 	p->context = context;
 	p->properties = properties;
-	p->pool = pw_mempool_new(NULL);
+	p->pool = pw_mempool_new(pw_context_get_mempool_props(context));
 	if (user_data_size > 0)
 		p->user_data = SPA_PTROFF(p, sizeof(struct pw_core), void);
 	p->proxy.user_data = p->user_data;
@@ -38,9 +38,13 @@ extern "C" {
 
 #define PW_CORE_PERM_MASK		PW_PERM_R|PW_PERM_X|PW_PERM_M
 
+/** registry filter key with the interface types to list,
+ * see pw_core_get_registry_filtered() */
+#define PW_REGISTRY_FILTER_TYPES	"registry.filter.types"
+
 #define PW_VERSION_CORE		4
 struct pw_core;
-#define PW_VERSION_REGISTRY	3
+#define PW_VERSION_REGISTRY	4
 struct pw_registry;
 
 #ifndef PW_API_CORE_IMPL
@@ -243,7 +247,7 @@ struct pw_core_events {
  * also used for internal features.
  */
 struct pw_core_methods {
-#define PW_VERSION_CORE_METHODS	0
+#define PW_VERSION_CORE_METHODS	1
 	uint32_t version;
 
 	int (*add_listener) (void *object,
@@ -341,6 +345,31 @@ struct pw_core_methods {
 	 * This requires X permissions on the core.
 	 */
 	int (*destroy) (void *object, void *proxy);
+	/**
+	 * Get a filtered registry object
+	 *
+	 * Like get_registry but the registry only emits the global and
+	 * global_remove events for the globals that match \a filter.
+	 *
+	 * The filter item with the PW_REGISTRY_FILTER_TYPES key contains
+	 * the interface types to list. All other items are matched against
+	 * the global properties with the same key. The values are a single
+	 * value or a JSON array of values and one of them needs to be equal
+	 * to the type or property of the global.
+	 *
+	 * Servers that don't support filters list all globals, the client
+	 * should still check the globals it receives.
+	 *
+	 * \param version the client version
+	 * \param filter the filter to apply
+	 * \param user_data_size extra size
+	 *
+	 * This requires X permissions on the core.
+	 *
+	 * Since version 4:1
+	 */
+	struct pw_registry * (*get_registry_filtered) (void *object, uint32_t version,
+			const struct spa_dict *filter, size_t user_data_size);
 };
 
 
@@ -420,6 +449,16 @@ pw_core_get_registry(struct pw_core *core, uint32_t version, size_t user_data_si
 			pw_core, (struct spa_interface*)core, get_registry, 0,
 			version, user_data_size);
 }
+/** \copydoc pw_core_methods.get_registry_filtered
+ * \sa pw_core_methods.get_registry_filtered */
+PW_API_CORE_IMPL struct pw_registry *
+pw_core_get_registry_filtered(struct pw_core *core, uint32_t version,
+		const struct spa_dict *filter, size_t user_data_size)
+{
+	return spa_api_method_r(struct pw_registry*, NULL,
+			pw_core, (struct spa_interface*)core, get_registry_filtered, 1,
+			version, filter, user_data_size);
+}
 /** \copydoc pw_core_methods.create_object
  * \sa pw_core_methods.create_object */
 PW_API_CORE_IMPL void *
@@ -484,11 +523,12 @@ pw_core_destroy(struct pw_core *core, void *proxy)
 
 #define PW_REGISTRY_EVENT_GLOBAL             0
 #define PW_REGISTRY_EVENT_GLOBAL_REMOVE      1
-#define PW_REGISTRY_EVENT_NUM                2
+#define PW_REGISTRY_EVENT_SNAPSHOT           2
+#define PW_REGISTRY_EVENT_NUM                3
 
 /** Registry events */
 struct pw_registry_events {
-#define PW_VERSION_REGISTRY_EVENTS	0
+#define PW_VERSION_REGISTRY_EVENTS	1
 	uint32_t version;
 	/**
 	 * Notify of a new global object
@@ -515,6 +555,35 @@ struct pw_registry_events {
 	 * \param id the id of the global that was removed
 	 */
 	void (*global_remove) (void *data, uint32_t id);
+	/**
+	 * Notify of all global objects at once
+	 *
+	 * When the registry is created, this event can be emitted instead
+	 * of a global event for each of the existing global objects. The
+	 * globals are read from \a size bytes at \a offset in the memory
+	 * with \a mem_id, added to the core with the add_mem event. Later
+	 * changes are notified with the global and global_remove events.
+	 *
+	 * The memory contains a Struct for each global in the registry at
+	 * \a serial with the Int id, Int permission mask, String type, Int
+	 * version and a Struct with the properties. The memory is sealed
+	 * and does not change. The permissions of a global are
+	 * \a permissions masked with the permission mask of the global.
+	 *
+	 * The protocol implementation emits this as a global event for
+	 * each of the globals in the snapshot, listeners will not receive
+	 * this event.
+	 *
+	 * \param mem_id the memory id of the snapshot
+	 * \param offset the offset in \a mem_id
+	 * \param size the size of the snapshot
+	 * \param serial the serial of the registry
+	 * \param permissions the permissions of the client on all globals
+	 *
+	 * Since version 4:1
+	 */
+	void (*snapshot) (void *data, uint32_t mem_id, uint32_t offset, uint32_t size,
+			uint64_t serial, uint32_t permissions);
 };
 
 #define PW_REGISTRY_METHOD_ADD_LISTENER	0
@@ -26,8 +26,9 @@ extern "C" {
  * version 4: new port_set_mix_info event added
  * version 5: driver nodes are scheduled on the client
  * version 6: client needs to set activation INACTIVE -> FINISHED
+ * version 7: set_io with PW_CLIENT_NODE_IO_PARAM_RING
  */
-#define PW_VERSION_CLIENT_NODE			6
+#define PW_VERSION_CLIENT_NODE			7
 struct pw_client_node;
 
 #ifndef PW_API_CLIENT_NODE_IMPL
@@ -36,6 +37,9 @@ struct pw_client_node;
 
 #define PW_EXTENSION_MODULE_CLIENT_NODE		PIPEWIRE_MODULE_PREFIX "module-client-node"
 
+/** io id of the ring of params, outside of the spa_io_type range. Since version 7 */
+#define PW_CLIENT_NODE_IO_PARAM_RING		0x10000u
+
 /** information about a buffer */
 struct pw_client_node_buffer {
 	uint32_t mem_id;		/**< the memory id for the metadata */
@@ -98,6 +102,9 @@ struct pw_client_node_events {
 	 * IO areas are identified with an id and are used to
 	 * exchange state between client and server
 	 *
+	 * The id is an enum spa_io_type or PW_CLIENT_NODE_IO_PARAM_RING
+	 * for a ring of params that the client sets from the data loop.
+	 *
 	 * \param id the id of the io area
 	 * \param mem_id the id of the memory to use
 	 * \param offset offset of io area in memory
@@ -139,12 +139,14 @@ int pw_global_register(struct pw_global *global)
 	global->registered = true;
 
 	global->generation = ++context->generation;
+	context->registry_serial++;
 
 	spa_list_for_each(registry, &context->registry_resource_list, link) {
 		uint32_t permissions = pw_global_get_permissions(global, registry->client);
 		pw_log_debug("registry %p: global %d %08x serial:%"PRIu64" generation:%"PRIu64,
 				registry, global->id, permissions, global->serial, global->generation);
-		if (PW_PERM_IS_R(permissions))
+		if (PW_PERM_IS_R(permissions) &&
+		    pw_registry_resource_filter_show(registry, global))
 			pw_registry_resource_global(registry,
 						    global->id,
 						    permissions,
@@ -189,10 +191,13 @@ static int global_unregister(struct pw_global *global)
 	spa_list_for_each(resource, &context->registry_resource_list, link) {
 		uint32_t permissions = pw_global_get_permissions(global, resource->client);
 		pw_log_debug("registry %p: global %d %08x", resource, global->id, permissions);
-		if (PW_PERM_IS_R(permissions))
+		if (pw_registry_resource_filter_hide(resource, global) &&
+		    PW_PERM_IS_R(permissions))
 			pw_registry_resource_global_remove(resource, global->id);
 	}
 
+	context->registry_serial++;
+
 	spa_list_remove(&global->link);
 	global->registered = false;
 	global->serial = SPA_ID_INVALID;
@@ -237,7 +242,18 @@ SPA_EXPORT
 int pw_global_update_keys(struct pw_global *global,
 		     const struct spa_dict *dict, const char * const keys[])
 {
-	return pw_properties_update_keys(global->properties, dict, keys);
+	struct pw_context *context = global->context;
+	struct pw_resource *registry;
+	int changed;
+
+	changed = pw_properties_update_keys(global->properties, dict, keys);
+	if (changed > 0 && global->registered) {
+		context->registry_serial++;
+
+		spa_list_for_each(registry, &context->registry_resource_list, link)
+			pw_registry_resource_filter_update(registry, global);
+	}
+	return changed;
 }
 
 SPA_EXPORT
@@ -357,11 +373,15 @@ int pw_global_update_permissions(struct pw_global *global, struct pw_impl_client
 			continue;
 
 		if (do_hide) {
+			if (!pw_registry_resource_filter_hide(resource, global))
+				continue;
 			pw_log_debug("client %p: resource %p hide global %d",
 					client, resource, global->id);
 			pw_registry_resource_global_remove(resource, global->id);
 		}
 		else if (do_show) {
+			if (!pw_registry_resource_filter_show(resource, global))
+				continue;
 			pw_log_debug("client %p: resource %p show global %d serial:%"PRIu64,
 					client, resource, global->id, global->serial);
 			pw_registry_resource_global(resource,
@@ -5,6 +5,7 @@
 #include "config.h"
 
 #include <unistd.h>
+#include <limits.h>
 
 #include <spa/debug/types.h>
 #include <spa/utils/string.h>
@@ -17,12 +18,199 @@
 PW_LOG_TOPIC_EXTERN(log_core);
 #define PW_LOG_TOPIC_DEFAULT log_core
 
+struct filter_item {
+	char *key;
+	char **values;
+};
+
+struct registry_filter {
+	char **types;
+	struct pw_array items;		/**< array of struct filter_item */
+	struct pw_array shown;		/**< bitmap of the announced global ids */
+};
+
 struct resource_data {
 	struct pw_resource *resource;
 	struct spa_hook resource_listener;
 	struct spa_hook object_listener;
+	struct registry_filter *filter;
 };
 
+static void registry_filter_free(struct registry_filter *filter)
+{
+	struct filter_item *item;
+
+	pw_array_for_each(item, &filter->items) {
+		free(item->key);
+		pw_free_strv(item->values);
+	}
+	pw_array_clear(&filter->items);
+	pw_array_clear(&filter->shown);
+	pw_free_strv(filter->types);
+	free(filter);
+}
+
+static char **registry_filter_parse_values(const char *str)
+{
+	char **values;
+
+	if (str[0] == '[')
+		return pw_strv_parse(str, strlen(str), INT_MAX, NULL);
+
+	if ((values = calloc(2, sizeof(char *))) == NULL)
+		return NULL;
+	if ((values[0] = strdup(str)) == NULL) {
+		free(values);
+		return NULL;
+	}
+	return values;
+}
+
+static struct registry_filter *registry_filter_new(const struct spa_dict *dict)
+{
+	struct registry_filter *filter;
+	const struct spa_dict_item *it;
+	struct filter_item *item;
+	char **values;
+	int res;
+
+	filter = calloc(1, sizeof(*filter));
+	if (filter == NULL)
+		return NULL;
+
+	pw_array_init(&filter->items, 4 * sizeof(struct filter_item));
+	pw_array_init(&filter->shown, 64);
+
+	spa_dict_for_each(it, dict) {
+		if (it->key == NULL || it->value == NULL ||
+		    (values = registry_filter_parse_values(it->value)) == NULL) {
+			res = -EINVAL;
+			goto error;
+		}
+		if (spa_streq(it->key, PW_REGISTRY_FILTER_TYPES)) {
+			pw_free_strv(filter->types);
+			filter->types = values;
+			continue;
+		}
+		if ((item = pw_array_add(&filter->items, sizeof(*item))) == NULL) {
+			res = -errno;
+			pw_free_strv(values);
+			goto error;
+		}
+		item->values = values;
+		if ((item->key = strdup(it->key)) == NULL) {
+			res = -errno;
+			goto error;
+		}
+	}
+	return filter;
+
+error:
+	registry_filter_free(filter);
+	errno = -res;
+	return NULL;
+}
+
+static bool registry_filter_match(struct registry_filter *filter, struct pw_global *global)
+{
+	struct filter_item *item;
+
+	if (filter->types != NULL && pw_strv_find(filter->types, global->type) < 0)
+		return false;
+
+	pw_array_for_each(item, &filter->items) {
+		const char *str = pw_properties_get(global->properties, item->key);
+		if (pw_strv_find(item->values, str) < 0)
+			return false;
+	}
+	return true;
+}
+
+/* mark a global as announced or not, returns the previous state */
+static int registry_filter_mark(struct registry_filter *filter, uint32_t id, bool shown)
+{
+	size_t len = pw_array_get_len(&filter->shown, uint8_t);
+	uint32_t idx = id / 8;
+	uint8_t *bits, bit = 1 << (id & 7);
+	bool old;
+
+	if (idx >= len) {
+		if (!shown)
+			return 0;
+		if ((bits = pw_array_add(&filter->shown, idx + 1 - len)) == NULL)
+			return -errno;
+		memset(bits, 0, idx + 1 - len);
+	}
+	bits = filter->shown.data;
+	old = SPA_FLAG_IS_SET(bits[idx], bit);
+	SPA_FLAG_UPDATE(bits[idx], bit, shown);
+	return old ? 1 : 0;
+}
+
+/** Check if a global should be announced on a registry
+ *
+ * Marks the global as announced when it matches the filter of the registry.
+ */
+bool pw_registry_resource_filter_show(struct pw_resource *registry, struct pw_global *global)
+{
+	struct resource_data *data = pw_resource_get_user_data(registry);
+	struct registry_filter *filter = data->filter;
+
+	if (filter == NULL)
+		return true;
+	if (!registry_filter_match(filter, global))
+		return false;
+	return registry_filter_mark(filter, global->id, true) >= 0;
+}
+
+/** Check if the removal of a global should be announced on a registry
+ *
+ * Only the globals that were announced before are removed.
+ */
+bool pw_registry_resource_filter_hide(struct pw_resource *registry, struct pw_global *global)
+{
+	struct resource_data *data = pw_resource_get_user_data(registry);
+	struct registry_filter *filter = data->filter;
+
+	if (filter == NULL)
+		return true;
+	return registry_filter_mark(filter, global->id, false) > 0;
+}
+
+/** Announce or remove a global on a registry after its properties changed */
+void pw_registry_resource_filter_update(struct pw_resource *registry, struct pw_global *global)
+{
+	struct resource_data *data = pw_resource_get_user_data(registry);
+	struct registry_filter *filter = data->filter;
+	uint32_t permissions;
+	bool match;
+	int shown;
+
+	if (filter == NULL || filter->items.size == 0)
+		return;
+
+	permissions = pw_global_get_permissions(global, registry->client);
+	if (!PW_PERM_IS_R(permissions))
+		return;
+
+	match = registry_filter_match(filter, global);
+	if ((shown = registry_filter_mark(filter, global->id, match)) < 0)
+		return;
+
+	if (match && !shown) {
+		pw_log_debug("registry %p: global %d now matches filter", registry, global->id);
+		pw_registry_resource_global(registry,
+					    global->id,
+					    permissions,
+					    global->type,
+					    global->version,
+					    &global->properties->dict);
+	} else if (!match && shown) {
+		pw_log_debug("registry %p: global %d no longer matches filter", registry, global->id);
+		pw_registry_resource_global_remove(registry, global->id);
+	}
+}
+
 static void * registry_bind(void *object, uint32_t id,
 		const char *type, uint32_t version, size_t user_data_size)
 {
@@ -143,6 +331,8 @@ static void destroy_registry_resource(void *_data)
 	spa_list_remove(&resource->link);
 	spa_hook_remove(&data->resource_listener);
 	spa_hook_remove(&data->object_listener);
+	if (data->filter)
+		registry_filter_free(data->filter);
 }
 
 static const struct pw_resource_events resource_events = {
@@ -227,17 +417,69 @@ static int core_error(void *object, uint32_t id, int seq, int res, const char *m
 	return 0;
 }
 
-static struct pw_registry *core_get_registry(void *object, uint32_t version, size_t user_data_size)
+static int registry_send_snapshot(struct pw_resource *resource)
+{
+	struct resource_data *data = pw_resource_get_user_data(resource);
+	struct pw_impl_client *client = resource->client;
+	struct pw_context *context = client->context;
+	struct pw_global *global;
+	struct pw_memblock *snapshot, *mem;
+	uint32_t size, permissions = 0;
+	bool first = true;
+	int res;
+
+	if (resource->version < 4)
+		return -ENOTSUP;
+
+	/* the snapshot has all the globals, filtered registries use events */
+	if (data->filter != NULL)
+		return -ENOTSUP;
+
+	/* the snapshot is shared between clients, it can only be used when the
+	 * client has the same permissions on all globals and can see them */
+	spa_list_for_each(global, &context->global_list, link) {
+		uint32_t perms = PW_PERM_ALL;
+		if (client->permission_func != NULL)
+			perms = client->permission_func(global, client, client->permission_data);
+		if (!PW_PERM_IS_R(perms & global->permission_mask) ||
+		    (!first && perms != permissions))
+			return -EPERM;
+		permissions = perms;
+		first = false;
+	}
+
+	if ((res = pw_context_get_registry_snapshot(context, &snapshot, &size)) < 0)
+		return res;
+
+	mem = pw_mempool_import_block(client->pool, snapshot);
+	if (mem == NULL)
+		return -errno;
+
+	pw_registry_resource_snapshot(resource, mem->id, 0, size,
+			context->registry_serial, permissions);
+
+	/* add_mem was sent before the snapshot, remove_mem will follow it */
+	pw_memblock_unref(mem);
+
+	return 0;
+}
+
+static struct pw_registry *registry_new(struct pw_resource *resource, uint32_t version,
+		const struct spa_dict *filter, uint32_t new_id)
 {
-	struct pw_resource *resource = object;
 	struct pw_impl_client *client = resource->client;
 	struct pw_context *context = client->context;
 	struct pw_global *global;
 	struct pw_resource *registry_resource;
+	struct registry_filter *f = NULL;
 	struct resource_data *data;
-	uint32_t new_id = user_data_size;
 	int res;
 
+	if (filter != NULL && (f = registry_filter_new(filter)) == NULL) {
+		res = -errno;
+		goto error_filter;
+	}
+
 	registry_resource = pw_resource_new(client,
 					    new_id,
 					    PW_PERM_ALL,
@@ -251,6 +493,7 @@ static struct pw_registry *core_get_registry(void *object, uint32_t version, siz
 
 	data = pw_resource_get_user_data(registry_resource);
 	data->resource = registry_resource;
+	data->filter = f;
 	pw_resource_add_listener(registry_resource,
 				&data->resource_listener,
 				&resource_events,
@@ -262,21 +505,27 @@ static struct pw_registry *core_get_registry(void *object, uint32_t version, siz
 
 	spa_list_append(&context->registry_resource_list, &registry_resource->link);
 
-	spa_list_for_each(global, &context->global_list, link) {
-		uint32_t permissions = pw_global_get_permissions(global, client);
-		if (PW_PERM_IS_R(permissions)) {
-			pw_registry_resource_global(registry_resource,
-						    global->id,
-						    permissions,
-						    global->type,
-						    global->version,
-						    &global->properties->dict);
+	if (registry_send_snapshot(registry_resource) < 0) {
+		spa_list_for_each(global, &context->global_list, link) {
+			uint32_t permissions = pw_global_get_permissions(global, client);
+			if (PW_PERM_IS_R(permissions) &&
+			    pw_registry_resource_filter_show(registry_resource, global)) {
+				pw_registry_resource_global(registry_resource,
+							    global->id,
+							    permissions,
+							    global->type,
+							    global->version,
+							    &global->properties->dict);
+			}
 		}
 	}
 
 	return (struct pw_registry *)registry_resource;
 
 error_resource:
+	if (f)
+		registry_filter_free(f);
+error_filter:
 	pw_core_resource_errorf(client->core_resource, new_id,
 			client->recv_seq, res,
 			"can't create registry resource: %d (%s)",
@@ -287,6 +536,17 @@ error_resource:
 	return NULL;
 }
 
+static struct pw_registry *core_get_registry(void *object, uint32_t version, size_t user_data_size)
+{
+	return registry_new(object, version, NULL, user_data_size);
+}
+
+static struct pw_registry *core_get_registry_filtered(void *object, uint32_t version,
+		const struct spa_dict *filter, size_t user_data_size)
+{
+	return registry_new(object, version, filter, user_data_size);
+}
+
 static void *
 core_create_object(void *object,
 		   const char *factory_name,
@@ -379,6 +639,7 @@ static const struct pw_core_methods core_methods = {
 	.get_registry = core_get_registry,
 	.create_object = core_create_object,
 	.destroy = core_destroy,
+	.get_registry_filtered = core_get_registry_filtered,
 };
 
 SPA_EXPORT
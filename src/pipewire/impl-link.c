@@ -652,6 +652,26 @@ static void select_io(struct pw_impl_link *this)
 	this->io[1] = SPA_IO_BUFFERS_INIT;
 }
 
+/* memory from huge pages can only be mapped at huge page offsets, older
+ * clients map it at page offsets and fail */
+static bool node_maps_hugepages(struct pw_impl_node *node)
+{
+	struct pw_global *global;
+	struct pw_impl_client *client;
+	uint32_t id;
+
+	if (!node->remote)
+		return true;
+
+	id = pw_properties_get_uint32(node->properties, PW_KEY_CLIENT_ID, SPA_ID_INVALID);
+	if ((global = pw_context_find_global(node->context, id)) == NULL ||
+	    !pw_global_is_type(global, PW_TYPE_INTERFACE_Client))
+		return false;
+
+	client = pw_global_get_object(global);
+	return pw_properties_get_bool(client->properties, PW_MEMPOOL_KEY_MAP_HUGEPAGES, false);
+}
+
 static int do_allocation(struct pw_impl_link *this)
 {
 	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
@@ -707,6 +727,13 @@ static int do_allocation(struct pw_impl_link *this)
 		if (output->node->remote || input->node->remote || !output->exclusive)
 			alloc_flags |= PW_BUFFERS_FLAG_SHARED;
 
+		/* buffers of a port that can only be linked once are never used
+		 * by other links, they can come from huge pages when both sides
+		 * can map them */
+		if (output->exclusive &&
+		    node_maps_hugepages(output->node) && node_maps_hugepages(input->node))
+			alloc_flags |= PW_BUFFERS_FLAG_HUGEPAGES;
+
 		if (output->node->driver)
 			alloc_flags |= PW_BUFFERS_FLAG_IN_PRIORITY;
 
@@ -1544,6 +1571,13 @@ struct pw_impl_link *pw_context_create_link(struct pw_context *context,
 
 	if (this->async)
 		 pw_properties_set(properties, PW_KEY_LINK_ASYNC, "true");
+	else if ((output_node->async &&
+	    pw_properties_get_bool(output_node->properties, PW_KEY_NODE_PIPELINE, false)) ||
+	    (input_node->async &&
+	    pw_properties_get_bool(input_node->properties, PW_KEY_NODE_PIPELINE, false)))
+		pw_log_warn("%p: (%s) -> (%s) ports don't both support async, the link "
+				"stays synchronous and does not split the pipeline stage",
+				this, output_node->name, input_node->name);
 
 	spa_hook_list_init(&this->listener_list);
 
@@ -53,6 +53,11 @@ struct impl {
 	char *group;
 	char *link_group;
 	char *sync_group;
+
+	struct pw_array props_delta;
+
+	struct pw_node_param_ring *param_ring;	/* used from the data loop */
+	uint32_t param_ring_size;
 };
 
 static const char * const global_keys[] = {
@@ -90,6 +95,9 @@ struct resource_data {
 	uint32_t subscribe_ids[MAX_PARAMS];
 	uint32_t n_subscribe_ids;
 
+	/* the properties the resource has, since version 4 */
+	struct pw_properties *sent_props;
+
 	/* for async replies */
 	int seq;
 	int end;
@@ -194,6 +202,37 @@ static inline void trigger_targets(struct pw_impl_node *node, int status, uint64
  *   so activate our target.
  * - When we get scheduled, we will activate our peer targets
  */
+/* Set the params that the server wrote in the param ring, called from the
+ * data loop */
+static void process_param_ring(struct impl *impl)
+{
+	struct pw_impl_node *this = &impl->this;
+	struct pw_node_param_ring *r = impl->param_ring;
+	struct pw_node_param_msg *msg;
+	struct spa_pod *param;
+	uint32_t index, offs, size;
+	int32_t avail;
+
+	avail = spa_ringbuffer_get_read_index(&r->ring, &index);
+	while (avail >= (int32_t)sizeof(*msg)) {
+		offs = index & (impl->param_ring_size - 1);
+		msg = SPA_PTROFF(r, sizeof(*r) + offs, struct pw_node_param_msg);
+		size = sizeof(*msg) + SPA_ROUND_UP_N(msg->size, sizeof(*msg));
+		if (size > (uint32_t)avail || offs + size > impl->param_ring_size) {
+			pw_log_warn("%p: invalid param size %u in ring", this, msg->size);
+			index += avail;
+			break;
+		}
+		if (msg->id != SPA_ID_INVALID &&
+		    (param = spa_pod_from_data(msg, size, sizeof(*msg), msg->size)) != NULL)
+			spa_node_set_param(this->node, msg->id, msg->flags, param);
+
+		index += size;
+		avail -= size;
+	}
+	spa_ringbuffer_read_update(&r->ring, index);
+}
+
 static int
 do_node_prepare(struct spa_loop *loop, bool async, uint32_t seq,
 		const void *data, size_t size, void *user_data)
@@ -239,6 +278,7 @@ do_node_unprepare(struct spa_loop *loop, bool async, uint32_t seq,
 		const void *data, size_t size, void *user_data)
 {
 	struct pw_impl_node *this = user_data;
+	struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
 	struct pw_node_target *t;
 	int old_state;
 	uint64_t trigger = 0;
@@ -267,6 +307,11 @@ do_node_unprepare(struct spa_loop *loop, bool async, uint32_t seq,
 	spa_list_for_each(t, &this->rt.target_list, link)
 		deactivate_target(this, t, trigger);
 
+	/* the server stops writing params in the ring before it stops the node,
+	 * set the last ones now */
+	if (impl->param_ring != NULL)
+		process_param_ring(impl);
+
 	this->rt.prepared = false;
 	return 0;
 }
@@ -373,6 +418,44 @@ static int start_node(struct pw_impl_node *this)
 	return res;
 }
 
+static int add_delta_item(struct pw_array *delta, const char *key, const char *value)
+{
+	struct spa_dict_item *item;
+
+	if ((item = pw_array_add(delta, sizeof(*item))) == NULL)
+		return -errno;
+	*item = SPA_DICT_ITEM_INIT(key, value);
+	return 0;
+}
+
+/* Make a dict with the properties that changed since the last time we sent
+ * them to the resource. Removed keys have a NULL value. */
+static int make_props_delta(struct pw_impl_node *node, struct pw_properties *sent,
+		struct spa_dict *dict)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	const struct spa_dict_item *it;
+	int res;
+
+	pw_array_reset(&impl->props_delta);
+
+	spa_dict_for_each(it, &node->properties->dict) {
+		if (spa_streq(pw_properties_get(sent, it->key), it->value))
+			continue;
+		if ((res = add_delta_item(&impl->props_delta, it->key, it->value)) < 0)
+			return res;
+	}
+	spa_dict_for_each(it, &sent->dict) {
+		if (pw_properties_get(node->properties, it->key) != NULL)
+			continue;
+		if ((res = add_delta_item(&impl->props_delta, it->key, NULL)) < 0)
+			return res;
+	}
+	dict->items = impl->props_delta.data;
+	dict->n_items = pw_array_get_len(&impl->props_delta, struct spa_dict_item);
+	return 0;
+}
+
 static void emit_info_changed(struct pw_impl_node *node, bool flags_changed)
 {
 	if (node->info.change_mask == 0 && !flags_changed)
@@ -382,10 +465,32 @@ static void emit_info_changed(struct pw_impl_node *node, bool flags_changed)
 
 	if (node->global && node->info.change_mask != 0) {
 		struct pw_resource *resource;
+		struct pw_node_info info = node->info;
+		struct spa_dict delta;
+
 		if (node->info.change_mask & PW_NODE_CHANGE_MASK_PROPS)
 			pw_global_update_keys(node->global, node->info.props, global_keys);
-		spa_list_for_each(resource, &node->global->resource_list, link)
-			pw_node_resource_info(resource, &node->info);
+
+		spa_list_for_each(resource, &node->global->resource_list, link) {
+			struct resource_data *data = pw_resource_get_user_data(resource);
+
+			/* since version 4, only the changed properties are sent */
+			if ((info.change_mask & PW_NODE_CHANGE_MASK_PROPS) &&
+			    data->sent_props != NULL &&
+			    make_props_delta(node, data->sent_props, &delta) >= 0) {
+				info.props = &delta;
+				pw_node_resource_info(resource, &info);
+				pw_properties_clear(data->sent_props);
+				pw_properties_update(data->sent_props, &node->properties->dict);
+			} else {
+				pw_node_resource_info(resource, &node->info);
+				if (data->sent_props != NULL &&
+				    (info.change_mask & PW_NODE_CHANGE_MASK_PROPS)) {
+					pw_properties_free(data->sent_props);
+					data->sent_props = NULL;
+				}
+			}
+		}
 	}
 
 	node->info.change_mask = 0;
@@ -717,6 +822,7 @@ static void resource_destroy(void *data)
 	remove_busy_resource(d);
 	spa_hook_remove(&d->resource_listener);
 	spa_hook_remove(&d->object_listener);
+	pw_properties_free(d->sent_props);
 }
 
 static void resource_pong(void *data, int seq)
@@ -761,6 +867,10 @@ global_bind(void *object, struct pw_impl_client *client, uint32_t permissions,
 	pw_log_debug("%p: bound to %d", this, resource->id);
 	pw_global_add_resource(global, resource);
 
+	/* the first info has all properties, after that only the changes */
+	if (version >= 4)
+		data->sent_props = pw_properties_copy(this->properties);
+
 	this->info.change_mask = PW_NODE_CHANGE_MASK_ALL;
 	pw_node_resource_info(resource, &this->info);
 	this->info.change_mask = 0;
@@ -940,6 +1050,50 @@ int pw_impl_node_remove_target(struct pw_impl_node *node, struct pw_node_target
 	return 0;
 }
 
+struct param_ring {
+	struct pw_node_param_ring *ring;
+	uint32_t size;
+};
+
+static int
+do_set_param_ring(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct impl *impl = user_data;
+	const struct param_ring *r = data;
+
+	if (impl->param_ring != NULL)
+		process_param_ring(impl);
+
+	impl->param_ring = r->ring;
+	impl->param_ring_size = r->size;
+	return 0;
+}
+
+/* Set the ring with params to set from the data loop, the params in the old
+ * ring are set first. */
+SPA_EXPORT
+int pw_impl_node_set_param_ring(struct pw_impl_node *node, struct pw_node_param_ring *ring,
+		size_t size)
+{
+	struct impl *impl = SPA_CONTAINER_OF(node, struct impl, this);
+	struct param_ring r = { ring, 0 };
+
+	if (ring != NULL) {
+		if (size < sizeof(*ring))
+			return -EINVAL;
+		r.size = ring->size;
+		if (r.size == 0 || (r.size & (r.size - 1)) != 0 ||
+		    r.size > size - sizeof(*ring))
+			return -EINVAL;
+	}
+	pw_log_debug("%p: param ring %p size:%u", node, ring, r.size);
+
+	pw_loop_locked(node->data_loop,
+			do_set_param_ring, SPA_ID_INVALID, &r, sizeof(r), impl);
+	return 0;
+}
+
 static void update_io(struct pw_impl_node *node)
 {
 	struct pw_node_target *t = &node->rt.target;
@@ -975,6 +1129,7 @@ int pw_impl_node_register(struct pw_impl_node *this,
 		return -errno;
 
 	spa_list_append(&context->node_list, &this->link);
+	pw_context_add_node_groups(context, this);
 	if (this->driver)
 		insert_driver(context, this);
 	this->registered = true;
@@ -1124,7 +1279,7 @@ static void check_properties(struct pw_impl_node *node)
 	const char *str, *recalc_reason = NULL;
 	struct spa_fraction frac;
 	uint32_t value;
-	bool driver, trigger, sync, async;
+	bool driver, trigger, sync, async, groups_changed = false;
 	struct match match;
 
 	match = MATCH_INIT(node);
@@ -1159,6 +1314,8 @@ static void check_properties(struct pw_impl_node *node)
 	driver = pw_properties_get_bool(node->properties, PW_KEY_NODE_DRIVER, false);
 	node->exclusive = pw_properties_get_bool(node->properties, PW_KEY_NODE_EXCLUSIVE, false);
 	node->reliable = pw_properties_get_bool(node->properties, PW_KEY_NODE_RELIABLE, false);
+	node->spin_time = pw_properties_get_uint64(node->properties, PW_KEY_NODE_SPIN_TIME, 0) *
+		SPA_NSEC_PER_USEC;
 
 	if (node->driver != driver) {
 		pw_log_debug("%p: driver %d -> %d", node, node->driver, driver);
@@ -1194,6 +1351,7 @@ static void check_properties(struct pw_impl_node *node)
 		node->groups = impl->group ?
 			pw_strv_parse(impl->group, strlen(impl->group), INT_MAX, NULL) : NULL;
 		node->freewheel = pw_strv_find(node->groups, "pipewire.freewheel") >= 0;
+		groups_changed = true;
 		recalc_reason = "group changed";
 	}
 
@@ -1206,6 +1364,7 @@ static void check_properties(struct pw_impl_node *node)
 		pw_free_strv(node->link_groups);
 		node->link_groups = impl->link_group ?
 			pw_strv_parse(impl->link_group, strlen(impl->link_group), INT_MAX, NULL) : NULL;
+		groups_changed = true;
 		recalc_reason = "link group changed";
 	}
 
@@ -1220,8 +1379,13 @@ static void check_properties(struct pw_impl_node *node)
 		pw_free_strv(node->sync_groups);
 		node->sync_groups = impl->sync_group ?
 			pw_strv_parse(impl->sync_group, strlen(impl->sync_group), INT_MAX, NULL) : NULL;
+		groups_changed = true;
 		recalc_reason = "sync group changed";
 	}
+	if (groups_changed && node->registered) {
+		pw_context_remove_node_groups(context, node);
+		pw_context_add_node_groups(context, node);
+	}
 	sync = pw_properties_get_bool(node->properties, PW_KEY_NODE_SYNC, false);
 	if (sync != node->sync) {
 		pw_log_info("%p: sync %d -> %d", node, node->sync, sync);
@@ -1239,6 +1403,8 @@ static void check_properties(struct pw_impl_node *node)
 		recalc_reason = "transport changed";
 	}
 	async = pw_properties_get_bool(node->properties, PW_KEY_NODE_ASYNC, false);
+	/* a pipeline stage runs one cycle behind its inputs */
+	async |= pw_properties_get_bool(node->properties, PW_KEY_NODE_PIPELINE, false);
 	async &= !node->driver;
 	if (async != node->async) {
 		pw_log_info("%p: async %d -> %d", node, node->async, async);
@@ -1471,14 +1637,8 @@ static inline void calculate_stats(struct pw_impl_node *this,  struct pw_node_ac
 			a->cpu_load[0], a->cpu_load[1], a->cpu_load[2]);
 }
 
-/* The main processing entry point of a node. This is called from the data-loop and usually
- * as a result of signaling the eventfd of the node.
- *
- * This code runs on the client and the server, depending on where the node is.
- */
-static inline int process_node(void *data, uint64_t nsec)
+static inline int process_node_once(struct pw_impl_node *this, uint64_t nsec)
 {
-	struct pw_impl_node *this = data;
 	struct pw_impl_port *p;
 	struct pw_node_activation *a = this->rt.target.activation;
 	struct spa_system *data_system = this->rt.target.system;
@@ -1500,6 +1660,12 @@ static inline int process_node(void *data, uint64_t nsec)
 		a->pending_sync = false;
 
 	if (SPA_LIKELY(this->rt.prepared)) {
+		struct impl *impl = SPA_CONTAINER_OF(this, struct impl, this);
+
+		/* set the params from the server before the cycle starts */
+		if (SPA_UNLIKELY(impl->param_ring != NULL))
+			process_param_ring(impl);
+
 		/* process input mixers */
 		spa_list_for_each(p, &this->rt.input_mix, rt.node_link)
 			spa_node_process_fast(p->mix);
@@ -1548,6 +1714,181 @@ static inline int process_node(void *data, uint64_t nsec)
 	return status;
 }
 
+/* The main processing entry point of a node. This is called from the data-loop and usually
+ * as a result of signaling the eventfd of the node.
+ *
+ * The fused targets that become ready while a node is processed are added to
+ * a queue and processed here, one after the other, so that the stack does not
+ * grow with the length of the chain.
+ *
+ * This code runs on the client and the server, depending on where the node is.
+ */
+static inline int process_node(void *data, uint64_t nsec)
+{
+	struct pw_impl_node *this = data, *n;
+	struct spa_list queue;
+	int status;
+
+	spa_list_init(&queue);
+
+	this->rt.fused_queue = &queue;
+	status = process_node_once(this, nsec);
+	this->rt.fused_queue = NULL;
+
+	spa_list_consume(n, &queue, rt.fused_link) {
+		spa_list_remove(&n->rt.fused_link);
+		n->rt.fused_queue = &queue;
+		process_node_once(n, n->rt.target.activation->signal_time);
+		n->rt.fused_queue = NULL;
+	}
+	return status;
+}
+
+int pw_impl_node_process(struct pw_impl_node *node)
+{
+	return process_node(node, get_time_ns(node->rt.target.system));
+}
+
+/* Like trigger_target_v1 but the node is queued on its worker pool
+ * instead of waking up the eventfd of the node. The target is copied into
+ * the peers so this runs from whatever thread finished the last dependency. */
+static int trigger_target_pool(struct pw_node_target *t, uint64_t nsec)
+{
+	struct pw_node_activation *a = t->activation;
+	struct pw_node_activation_state *state = &a->state[0];
+	int32_t pending = SPA_ATOMIC_DEC(state->pending);
+	int res = pending == 0, r;
+
+	pw_log_trace_fp("%p: (%s-%u) state:%p pending:%d/%d", t->node,
+				t->name, t->id, state, pending, state->required);
+
+	if (res) {
+		if (SPA_LIKELY(SPA_ATOMIC_CAS(a->status,
+					PW_NODE_ACTIVATION_NOT_TRIGGERED,
+					PW_NODE_ACTIVATION_TRIGGERED))) {
+			a->signal_time = nsec;
+			/* remote nodes are woken up with their eventfd, also fall back
+			 * to the eventfd when the queue is full */
+			if (t->node->remote ||
+			    SPA_UNLIKELY(pw_worker_pool_queue(t->node->rt.pool, t->node) < 0)) {
+				if (SPA_UNLIKELY((r = spa_system_eventfd_write(t->system, t->fd, 1)) < 0)) {
+					pw_log_warn("%p: write failed %s", t->node, spa_strerror(r));
+					res = r;
+				}
+			}
+		} else {
+			pw_log_trace_fp("%p: (%s-%u) not ready %d", t->node,
+					t->name, t->id, a->status);
+			res = -EIO;
+		}
+	}
+	return res;
+}
+
+/* Called from the data loop of the node for the targets that are fused with
+ * the node. The target runs on the same data loop, so instead of waking it up
+ * we queue it for processing after the node when this was its last
+ * dependency. */
+static int trigger_target_fused(struct pw_node_target *t, uint64_t nsec)
+{
+	struct pw_node_peer *peer = SPA_CONTAINER_OF(t, struct pw_node_peer, target);
+	struct spa_list *queue = peer->output->rt.fused_queue;
+	struct pw_node_activation *a = t->activation;
+	struct pw_node_activation_state *state = &a->state[0];
+	int32_t pending;
+	int res;
+
+	/* when the node is not processing, like when the target is removed,
+	 * wake up the target as usual */
+	if (queue == NULL)
+		return t->node->rt.target.trigger(t, nsec);
+
+	pending = SPA_ATOMIC_DEC(state->pending);
+	res = pending == 0;
+
+	pw_log_trace_fp("%p: (%s-%u) state:%p pending:%d/%d", t->node,
+				t->name, t->id, state, pending, state->required);
+
+	if (res) {
+		if (SPA_LIKELY(SPA_ATOMIC_CAS(a->status,
+					PW_NODE_ACTIVATION_NOT_TRIGGERED,
+					PW_NODE_ACTIVATION_TRIGGERED))) {
+			a->signal_time = nsec;
+			spa_list_append(queue, &t->node->rt.fused_link);
+		} else {
+			pw_log_trace_fp("%p: (%s-%u) not ready %d", t->node,
+					t->name, t->id, a->status);
+			res = -EIO;
+		}
+	}
+	return res;
+}
+
+/* The input node of target when all its links come from one node or NULL */
+static struct pw_impl_node *find_single_input(struct pw_impl_node *target)
+{
+	struct pw_impl_node *input = NULL;
+	struct pw_impl_port *p;
+	struct pw_impl_link *l;
+
+	spa_list_for_each(p, &target->input_ports, link) {
+		spa_list_for_each(l, &p->links, input_link) {
+			struct pw_impl_node *n = l->output->node;
+			if (l->peer == NULL || n == target)
+				continue;
+			if (l->async || l->feedback)
+				return NULL;
+			if (input != NULL && input != n)
+				return NULL;
+			input = n;
+		}
+	}
+	return input;
+}
+
+static bool can_fuse(struct pw_impl_node *node, struct pw_impl_node *target)
+{
+	return target != NULL &&
+		node->data_loop == target->data_loop &&
+		!node->remote && !node->exported && !node->async && !node->driving &&
+		!target->remote && !target->exported && !target->async && !target->driving &&
+		node->rt.pool == NULL && target->rt.pool == NULL &&
+		find_single_input(target) == node;
+}
+
+static int
+do_update_fused(struct spa_loop *loop,
+		bool async, uint32_t seq, const void *data, size_t size, void *user_data)
+{
+	struct pw_node_target *t = user_data;
+	bool fused = *(bool*)data;
+
+	t->trigger = fused ? trigger_target_fused : t->node->rt.target.trigger;
+	return 0;
+}
+
+/* Called from the main thread when the graph changed. A peer can be fused
+ * with the node when it is a local node on the same data loop that has this
+ * node as its only input. Chains of such nodes are then processed in one go
+ * from the data loop without going through the eventfd for each hop. */
+void pw_impl_node_update_fused(struct pw_impl_node *node)
+{
+	struct pw_node_peer *peer;
+
+	spa_list_for_each(peer, &node->peer_list, link) {
+		struct pw_node_target *t = &peer->target;
+		bool fused = can_fuse(node, t->node);
+
+		if (fused == (t->trigger == trigger_target_fused))
+			continue;
+
+		pw_log_debug("%p: (%s-%u) fused:%d with (%s-%u)", node, node->name,
+				node->info.id, fused, t->name, t->id);
+		pw_loop_invoke(node->data_loop, do_update_fused, SPA_ID_INVALID,
+				&fused, sizeof(fused), true, t);
+	}
+}
+
 int pw_impl_node_trigger(struct pw_impl_node *node)
 {
 	uint64_t nsec = get_time_ns(node->rt.target.system);
@@ -1582,7 +1923,20 @@ static void node_on_fd_events(struct spa_source *source)
 				this, this->remote, this->exported, this->name, this->info.id,
 				nsec);
 
-		process_node(this, nsec);
+		if (this->rt.pool == NULL || this->remote ||
+		    pw_worker_pool_queue(this->rt.pool, this) < 0) {
+			process_node(this, nsec);
+
+			/* spin once for the next trigger, then go back to the
+			 * loop so that other sources are not starved. Don't
+			 * delay the other nodes when we share the loop. */
+			if (SPA_UNLIKELY(this->spin_time > 0) && !this->driving &&
+			    this->rt.loop_nodes != NULL &&
+			    SPA_ATOMIC_LOAD(*this->rt.loop_nodes) == 1 &&
+			    pw_node_activation_spin(this->rt.target.activation,
+					this->rt.position, data_system, this->spin_time))
+				process_node(this, get_time_ns(data_system));
+		}
 	}
 }
 
@@ -1653,6 +2007,10 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 		res = -ENOENT;
 		goto error_clean;
 	}
+	if (context->worker_pool &&
+	    this->data_loop == pw_worker_pool_get_loop(context->worker_pool))
+		this->rt.pool = context->worker_pool;
+	this->rt.loop_nodes = pw_context_get_loop_nodes(context, this->data_loop);
 
 	if (user_data_size > 0)
                 this->user_data = SPA_PTROFF(impl, sizeof(struct impl), void);
@@ -1686,6 +2044,7 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 
 	impl->work = pw_context_get_work_queue(this->context);
 	impl->pending_id = SPA_ID_INVALID;
+	pw_array_init(&impl->props_delta, 64);
 
 	spa_list_init(&this->follower_list);
 	spa_list_init(&this->peer_list);
@@ -1710,7 +2069,7 @@ struct pw_impl_node *pw_context_create_node(struct pw_context *context,
 	this->rt.target.node = this;
 	this->rt.target.system = this->data_loop->system;
 	this->rt.target.fd = this->source.fd;
-	this->rt.target.trigger = trigger_target_v1;
+	this->rt.target.trigger = this->rt.pool ? trigger_target_pool : trigger_target_v1;
 
 	reset_position(this, &this->rt.target.activation->position);
 	this->rt.target.activation->sync_timeout = DEFAULT_SYNC_TIMEOUT;
@@ -2432,6 +2791,7 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 
 	if (node->registered) {
 		spa_list_remove(&node->link);
+		pw_context_remove_node_groups(context, node);
 		if (node->driver)
 			remove_driver(context, node);
 	}
@@ -2484,6 +2844,7 @@ void pw_impl_node_destroy(struct pw_impl_node *node)
 	free(impl->group);
 	free(impl->link_group);
 	free(impl->sync_group);
+	pw_array_clear(&impl->props_delta);
 	free(impl);
 
 #ifdef HAVE_MALLOC_TRIM
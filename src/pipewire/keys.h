@@ -205,6 +205,10 @@ extern "C" {
 #define PW_KEY_NODE_DRIVER_ID		"node.driver-id"	/**< the node id of the node assigned as driver
 								  *   for this node */
 #define PW_KEY_NODE_ASYNC		"node.async"		/**< the node wants async scheduling */
+#define PW_KEY_NODE_PIPELINE		"node.pipeline"		/**< the node starts a new pipeline stage,
+								  *  implies async scheduling. Only links
+								  *  between ports that support async split
+								  *  the stage, see PW_KEY_LINK_ASYNC */
 #define PW_KEY_NODE_LOOP_NAME		"node.loop.name"	/**< the loop name fnmatch pattern to run in */
 #define PW_KEY_NODE_LOOP_CLASS		"node.loop.class"	/**< the loop class fnmatch pattern to run in */
 #define PW_KEY_NODE_STREAM		"node.stream"		/**< node is a stream, the server side should
@@ -233,6 +237,11 @@ extern "C" {
 #define PW_KEY_NODE_TERMINAL		"node.terminal"		/**< ports from the node are terminal */
 
 #define PW_KEY_NODE_RELIABLE		"node.reliable"		/**< node uses reliable transport 1.6.0 */
+#define PW_KEY_NODE_SPIN_TIME		"node.spin-time"	/**< time in microseconds to spin for the
+								  *  next trigger before sleeping */
+#define PW_KEY_NODE_PARAM_MAILBOX	"node.param-mailbox"	/**< the client node gets Props from the
+								  *  server in shared memory and sets
+								  *  them from the data loop */
 
 /** Port keys */
 #define PW_KEY_PORT_ID			"port.id"		/**< port id */
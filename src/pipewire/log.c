@@ -71,6 +71,7 @@ PW_LOG_TOPIC(log_stream, "pw.stream");
 PW_LOG_TOPIC(log_thread_loop, "pw.thread-loop");
 PW_LOG_TOPIC(log_timer_queue, "pw.timer-queue");
 PW_LOG_TOPIC(log_work_queue, "pw.work-queue");
+PW_LOG_TOPIC(log_worker_pool, "pw.worker-pool");
 
 PW_LOG_TOPIC(PW_LOG_TOPIC_DEFAULT, "default");
 
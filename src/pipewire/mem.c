@@ -19,6 +19,7 @@
 #include <spa/buffer/buffer.h>
 
 #define PW_API_MEM SPA_EXPORT
+#include <pipewire/array.h>
 #include <pipewire/log.h>
 #include <pipewire/map.h>
 #include <pipewire/mem.h>
@@ -46,6 +47,7 @@ static inline int memfd_create(const char *name, unsigned int flags)
 
 #if defined(__FreeBSD__) || defined(__MidnightBSD__) || defined(__GNU__)
 #define MAP_LOCKED 0
+#define MAP_POPULATE 0
 #endif
 
 /* memfd_create(2) flags */
@@ -115,7 +117,26 @@ struct mempool {
 
 	struct pw_map map;		/* map memblock to id */
 	struct spa_list blocks;		/* list of memblock */
+	struct pw_array fds;		/* memblock pointers indexed by fd */
+	struct pw_array mappings;	/* mapping pointers sorted by ptr */
 	uint32_t pagesize;
+	unsigned int hugepages:1;	/* allocate from huge pages */
+	unsigned int prefault:1;	/* populate mappings */
+
+	struct spa_list cache;		/* list of struct cached_block, newest first */
+	size_t cache_size;
+	size_t max_cache_size;
+};
+
+/* the fd and mapping of a freed block that can be used again */
+struct cached_block {
+	struct spa_list link;
+	int fd;
+	uint32_t flags;
+	size_t size;			/* size class, size rounded up to the pagesize */
+	size_t fd_size;			/* size of the fd, can be less than the class */
+	void *ptr;
+	uint32_t map_size;
 };
 
 struct memblock {
@@ -126,6 +147,8 @@ struct memblock {
 	struct memblock *owner;		/* owner of fd, if another memblock */
 	struct spa_hook owner_listener;	/* listen for fd owner memblock events */
 	struct spa_hook_list listener_list;
+	unsigned int cacheable:1;	/* allocated by the pool and never shared,
+					 * can be cached */
 };
 
 struct memblock_events {
@@ -152,6 +175,100 @@ struct memmap {
 	struct spa_list link;
 };
 
+static int index_fd(struct mempool *impl, struct memblock *b)
+{
+	int fd = b->this.fd;
+	size_t size;
+
+	if (fd < 0)
+		return 0;
+
+	size = ((size_t)fd + 1) * sizeof(struct memblock *);
+	if (impl->fds.size < size) {
+		if (pw_array_ensure_size(&impl->fds, size - impl->fds.size) < 0)
+			return -errno;
+		memset(pw_array_end(&impl->fds), 0, size - impl->fds.size);
+		impl->fds.size = size;
+	}
+	*pw_array_get_unchecked(&impl->fds, fd, struct memblock *) = b;
+	return 0;
+}
+
+static void unindex_fd(struct mempool *impl, struct memblock *b)
+{
+	struct memblock **p;
+	int fd = b->this.fd;
+
+	if (fd < 0 || !pw_array_check_index(&impl->fds, (size_t)fd, struct memblock *))
+		return;
+	p = pw_array_get_unchecked(&impl->fds, fd, struct memblock *);
+	if (*p == b)
+		*p = NULL;
+}
+
+/* index of the first mapping with a ptr > ptr */
+static size_t mapping_upper_bound(struct mempool *impl, const void *ptr)
+{
+	struct mapping **mappings = impl->mappings.data;
+	size_t lo = 0, hi = pw_array_get_len(&impl->mappings, struct mapping *);
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if ((const uint8_t*)mappings[mid]->ptr <= (const uint8_t*)ptr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int index_mapping(struct mempool *impl, struct mapping *m)
+{
+	struct mapping **mappings;
+	size_t idx, len;
+
+	idx = mapping_upper_bound(impl, m->ptr);
+	if (pw_array_add(&impl->mappings, sizeof(struct mapping *)) == NULL)
+		return -errno;
+
+	mappings = impl->mappings.data;
+	len = pw_array_get_len(&impl->mappings, struct mapping *);
+	memmove(&mappings[idx + 1], &mappings[idx], (len - idx - 1) * sizeof(struct mapping *));
+	mappings[idx] = m;
+	return 0;
+}
+
+static void unindex_mapping(struct mempool *impl, struct mapping *m)
+{
+	struct mapping **mappings = impl->mappings.data;
+	size_t idx, len = pw_array_get_len(&impl->mappings, struct mapping *);
+
+	/* mappings with the same ptr are before the upper bound */
+	for (idx = mapping_upper_bound(impl, m->ptr); idx > 0; idx--) {
+		if (mappings[idx - 1] == m) {
+			memmove(&mappings[idx - 1], &mappings[idx],
+					(len - idx) * sizeof(struct mapping *));
+			impl->mappings.size -= sizeof(struct mapping *);
+			return;
+		}
+		if (mappings[idx - 1]->ptr != m->ptr)
+			break;
+	}
+}
+
+static struct mapping *find_mapping_ptr(struct mempool *impl, const void *ptr)
+{
+	struct mapping **mappings = impl->mappings.data, *m;
+	size_t idx = mapping_upper_bound(impl, ptr);
+
+	if (idx == 0)
+		return NULL;
+	m = mappings[idx - 1];
+	if ((const uint8_t*)ptr < SPA_PTROFF(m->ptr, m->size, const uint8_t))
+		return m;
+	return NULL;
+}
+
 SPA_EXPORT
 struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 {
@@ -166,27 +283,51 @@ struct pw_mempool *pw_mempool_new(struct pw_properties *props)
 	this->props = props;
 
 	impl->pagesize = sysconf(_SC_PAGESIZE);
+	if (props) {
+		impl->hugepages = pw_properties_get_bool(props, "mem.hugepages", false);
+		impl->prefault = pw_properties_get_bool(props, "mem.prefault", false);
+		impl->max_cache_size = pw_properties_get_uint64(props, "mem.cache-size", 0);
+	}
 
-	pw_log_debug("%p: new pagesize:%" PRIu32 "", this, impl->pagesize);
+	pw_log_debug("%p: new pagesize:%" PRIu32 " hugepages:%d prefault:%d cache-size:%zu",
+			this, impl->pagesize, impl->hugepages, impl->prefault,
+			impl->max_cache_size);
 
 	spa_hook_list_init(&impl->listener_list);
 	pw_map_init(&impl->map, 64, 64);
 	spa_list_init(&impl->blocks);
+	spa_list_init(&impl->cache);
+	pw_array_init(&impl->fds, 64 * sizeof(struct memblock *));
+	pw_array_init(&impl->mappings, 64 * sizeof(struct mapping *));
 
 	return this;
 }
 
+static void cached_block_free(struct mempool *impl, struct cached_block *c)
+{
+	pw_log_debug("%p: free cached fd:%d size:%zu", impl, c->fd, c->size);
+	spa_list_remove(&c->link);
+	impl->cache_size -= c->size;
+	munmap(c->ptr, c->map_size);
+	close(c->fd);
+	free(c);
+}
+
 SPA_EXPORT
 void pw_mempool_clear(struct pw_mempool *pool)
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
 	struct memblock *b;
+	struct cached_block *c;
 
 	pw_log_debug("%p: clear", pool);
 
 	spa_list_consume(b, &impl->blocks, link)
 		pw_memblock_free(&b->this);
 	pw_map_reset(&impl->map);
+
+	spa_list_consume(c, &impl->cache, link)
+		cached_block_free(impl, c);
 }
 
 SPA_EXPORT
@@ -203,6 +344,8 @@ void pw_mempool_destroy(struct pw_mempool *pool)
 	spa_hook_list_clean(&impl->listener_list);
 
 	pw_map_clear(&impl->map);
+	pw_array_clear(&impl->fds);
+	pw_array_clear(&impl->mappings);
 	pw_properties_free(pool->props);
 	free(impl);
 }
@@ -318,6 +461,10 @@ static struct mapping * memblock_map(struct memblock *b,
 	if (flags & PW_MEMMAP_FLAG_LOCKED)
 		fl |= MAP_LOCKED;
 
+	/* fault in all pages now and not in the data thread */
+	if (p->prefault)
+		fl |= MAP_POPULATE;
+
 	if (flags & PW_MEMMAP_FLAG_TWICE) {
 		pw_log_error("%p: implement me PW_MEMMAP_FLAG_TWICE", p);
 		errno = ENOTSUP;
@@ -342,6 +489,13 @@ static struct mapping * memblock_map(struct memblock *b,
 		return NULL;
 	}
 
+#ifdef MADV_HUGEPAGE
+	/* for memory that is not from hugetlbfs, ask for transparent
+	 * huge pages. This fails for hugetlbfs, which is fine. */
+	if (p->hugepages)
+		madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+
 	m = calloc(1, sizeof(struct mapping));
 	if (m == NULL) {
 		munmap(ptr, size);
@@ -352,6 +506,11 @@ static struct mapping * memblock_map(struct memblock *b,
 	m->block = b;
 	m->offset = offset;
 	m->size = size;
+	if (index_mapping(p, m) < 0) {
+		munmap(ptr, size);
+		free(m);
+		return NULL;
+	}
 	b->this.ref++;
 	spa_list_append(&b->mappings, &m->link);
 
@@ -371,6 +530,7 @@ static void mapping_free(struct mapping *m)
 
 	if (m->do_unmap)
 		munmap(m->ptr, m->size);
+	unindex_mapping(p, m);
 	spa_list_remove(&m->link);
 	free(m);
 }
@@ -394,6 +554,7 @@ struct pw_memmap * pw_memblock_map(struct pw_memblock *block,
 	struct mapping *m;
 	struct memmap *mm;
 	struct stat sb;
+	uint32_t pagesize;
 
 	if (b->this.fd == -1) {
 		pw_log_error("%p: block:%p cannot map memory with stale fd", p, block);
@@ -417,10 +578,17 @@ struct pw_memmap * pw_memblock_map(struct pw_memblock *block,
 		return NULL;
 	}
 
+	/* memory from hugetlbfs can only be mapped in multiples of the
+	 * huge page size, which is the block size of the file */
+	pagesize = p->pagesize;
+	if (b->this.type == SPA_DATA_MemFd && sb.st_blksize > (blksize_t)pagesize &&
+	    (sb.st_blksize & (sb.st_blksize - 1)) == 0)
+		pagesize = sb.st_blksize;
+
 	m = memblock_find_mapping(b, flags, offset, size);
 	if (m == NULL) {
 		struct pw_map_range range;
-		if (pw_map_range_init(&range, offset, size, p->pagesize) < 0) {
+		if (pw_map_range_init(&range, offset, size, pagesize) < 0) {
 			errno = EOVERFLOW;
 			return NULL;
 		}
@@ -515,6 +683,143 @@ static inline enum pw_memmap_flags block_flags_to_mem(enum pw_memblock_flags fla
 	return fl;
 }
 
+/* Use the fd and mapping of a freed block of the same size class. The
+ * memory is cleared so that it looks like a new block. */
+static bool cache_take(struct mempool *impl, struct memblock *b,
+		enum pw_memblock_flags flags, size_t size)
+{
+	struct cached_block *c;
+	struct mapping *m;
+	size_t class = SPA_ROUND_UP_N(size, (size_t)impl->pagesize);
+
+	/* a sealed fd can't grow, it must be large enough for the block */
+	spa_list_for_each(c, &impl->cache, link) {
+		if (c->flags == flags && c->size == class && c->fd_size >= size)
+			break;
+	}
+	if (spa_list_is_end(c, &impl->cache, link))
+		return false;
+
+	if ((m = calloc(1, sizeof(struct mapping))) == NULL)
+		return false;
+
+	m->ptr = c->ptr;
+	m->do_unmap = true;
+	m->block = b;
+	m->offset = 0;
+	m->size = c->map_size;
+	if (index_mapping(impl, m) < 0) {
+		free(m);
+		return false;
+	}
+
+	spa_list_remove(&c->link);
+	impl->cache_size -= c->size;
+
+	memset(c->ptr, 0, c->size);
+
+	b->this.fd = c->fd;
+	b->this.ref++;
+	spa_list_append(&b->mappings, &m->link);
+
+	pw_log_debug("%p: reuse cached fd:%d size:%zu", impl, c->fd, size);
+	free(c);
+	return true;
+}
+
+/* Keep the fd and mapping of a block that is freed, call before the
+ * mappings of the block are freed. */
+static bool cache_put(struct mempool *impl, struct memblock *b)
+{
+	struct pw_memblock *block = &b->this;
+	struct memmap *mm;
+	struct mapping *m;
+	struct cached_block *c;
+	struct stat sb;
+	size_t class = SPA_ROUND_UP_N((size_t)block->size, (size_t)impl->pagesize);
+
+	if (!b->cacheable || block->fd == -1 || block->map == NULL ||
+	    SPA_FLAG_IS_SET(block->flags, PW_MEMBLOCK_FLAG_DONT_CLOSE) ||
+	    class > impl->max_cache_size)
+		return false;
+
+	/* only when the map of the block is the only user of the memory */
+	mm = SPA_CONTAINER_OF(block->map, struct memmap, this);
+	m = mm->mapping;
+	if (b->memmaps.next != &mm->link || b->memmaps.prev != &mm->link ||
+	    b->mappings.next != &m->link || b->mappings.prev != &m->link ||
+	    m->ref != 1 || m->offset != 0 || m->size < class ||
+	    fstat(block->fd, &sb) < 0)
+		return false;
+
+	if ((c = calloc(1, sizeof(struct cached_block))) == NULL)
+		return false;
+
+	c->fd = block->fd;
+	c->flags = block->flags;
+	c->size = class;
+	c->fd_size = sb.st_size;
+	c->ptr = m->ptr;
+	c->map_size = m->size;
+
+	spa_list_remove(&mm->link);
+	free(mm);
+	unindex_mapping(impl, m);
+	spa_list_remove(&m->link);
+	free(m);
+	unindex_fd(impl, b);
+	block->map = NULL;
+	block->fd = -1;
+
+	spa_list_prepend(&impl->cache, &c->link);
+	impl->cache_size += c->size;
+
+	pw_log_debug("%p: cache fd:%d size:%zu total:%zu", impl, c->fd, c->size,
+			impl->cache_size);
+
+	while (impl->cache_size > impl->max_cache_size) {
+		c = spa_list_last(&impl->cache, struct cached_block, link);
+		cached_block_free(impl, c);
+	}
+	return true;
+}
+
+#ifdef HAVE_MEMFD_CREATE
+/* Make a memfd from hugetlbfs. The pages are reserved and faulted in
+ * now so that we can fall back to normal memory when there are not
+ * enough huge pages. */
+static int alloc_hugetlb(struct mempool *impl, const char *name, size_t size)
+{
+	struct stat sb;
+	size_t alloc_size;
+	int fd;
+
+	fd = pw_memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING |
+			MFD_NOEXEC_SEAL | MFD_HUGETLB);
+	if (fd == -1)
+		goto error;
+
+	if (fstat(fd, &sb) < 0 || sb.st_blksize <= 0)
+		goto error_close;
+
+	alloc_size = SPA_ROUND_UP_N(size, (size_t)sb.st_blksize);
+	if (ftruncate(fd, alloc_size) < 0 ||
+	    fallocate(fd, 0, 0, alloc_size) < 0)
+		goto error_close;
+
+	pw_log_debug("%p: hugetlb fd:%d size:%zu alloc:%zu", impl, fd,
+			size, alloc_size);
+	return fd;
+
+error_close:
+	close(fd);
+error:
+	pw_log_info("%p: no huge pages for size:%zu, using normal memory: %m",
+			impl, size);
+	return -1;
+}
+#endif
+
 /** Create a new memblock
  * \param pool the pool to use
  * \param flags memblock flags
@@ -528,6 +833,9 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
 	struct memblock *b;
+	struct memmap *mm;
+	struct mapping *m;
+	bool hugetlb = false;
 	int res;
 
 	b = calloc(1, sizeof(struct memblock));
@@ -549,13 +857,26 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 	spa_list_init(&b->memmaps);
 	spa_hook_list_init(&b->listener_list);
 
+	if (SPA_FLAG_IS_SET(flags, PW_MEMBLOCK_FLAG_MAP) && size > 0 &&
+	    !SPA_FLAG_IS_SET(flags, PW_MEMBLOCK_FLAG_DONT_CLOSE) &&
+	    impl->max_cache_size > 0) {
+		b->cacheable = true;
+		if (cache_take(impl, b, flags, size))
+			goto map;
+	}
+
 #ifdef HAVE_MEMFD_CREATE
 	char name[128];
 	snprintf(name, sizeof(name),
 		 "pipewire-memfd:flags=0x%08x,type=%" PRIu32 ",size=%zu",
 		 (unsigned int) flags, type, size);
 
-	b->this.fd = pw_memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_NOEXEC_SEAL);
+	b->this.fd = -1;
+	if (impl->hugepages && SPA_FLAG_IS_SET(flags, PW_MEMBLOCK_FLAG_HUGEPAGES) && size > 0 &&
+	    (b->this.fd = alloc_hugetlb(impl, name, size)) != -1)
+		hugetlb = true;
+	if (b->this.fd == -1)
+		b->this.fd = pw_memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING | MFD_NOEXEC_SEAL);
 	if (b->this.fd == -1) {
 		res = -errno;
 		pw_log_error("%p: Failed to create memfd: %m", pool);
@@ -584,7 +905,7 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 #endif
 	pw_log_debug("%p: new fd:%d", pool, b->this.fd);
 
-	if (ftruncate(b->this.fd, size) < 0) {
+	if (!hugetlb && ftruncate(b->this.fd, size) < 0) {
 		res = -errno;
 		pw_log_warn("%p: Failed to truncate temporary file: %m", pool);
 		goto error_close;
@@ -597,6 +918,7 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 		}
 	}
 #endif
+map:
 	if (flags & PW_MEMBLOCK_FLAG_MAP && size > 0) {
 		b->this.map = pw_memblock_map(&b->this,
 				block_flags_to_mem(flags), 0, size, NULL);
@@ -608,6 +930,9 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 		b->this.ref--;
 	}
 
+	if ((res = index_fd(impl, b)) < 0)
+		goto error_close;
+
 	b->this.id = pw_map_insert_new(&impl->map, b);
 	spa_list_append(&impl->blocks, &b->link);
 	pw_log_debug("%p: block:%p id:%d type:%u flags:%08x size:%zu", pool,
@@ -619,6 +944,12 @@ struct pw_memblock * pw_mempool_alloc(struct pw_mempool *pool, enum pw_memblock_
 	return &b->this;
 
 error_close:
+	spa_list_consume(mm, &b->memmaps, link) {
+		spa_list_remove(&mm->link);
+		free(mm);
+	}
+	spa_list_consume(m, &b->mappings, link)
+		mapping_free(m);
 	pw_log_debug("%p: close fd:%d", pool, b->this.fd);
 	close(b->this.fd);
 error_free:
@@ -632,17 +963,16 @@ static struct memblock * mempool_find_fd(struct pw_mempool *pool, int fd)
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
 	struct memblock *b;
 
-	spa_list_for_each(b, &impl->blocks, link) {
-		if (b->this.fd == -1)
-			continue;
+	if (fd < 0 || !pw_array_check_index(&impl->fds, (size_t)fd, struct memblock *))
+		return NULL;
 
-		if (fd == b->this.fd) {
-			pw_log_debug("%p: found %p id:%u fd:%d ref:%d",
-					pool, &b->this, b->this.id, fd, b->this.ref);
-			return b;
-		}
-	}
-	return NULL;
+	b = *pw_array_get_unchecked(&impl->fds, fd, struct memblock *);
+	if (b == NULL || b->this.fd != fd)
+		return NULL;
+
+	pw_log_debug("%p: found %p id:%u fd:%d ref:%d",
+			pool, &b->this, b->this.id, fd, b->this.ref);
+	return b;
 }
 
 SPA_EXPORT
@@ -677,6 +1007,10 @@ struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
 	b->this.type = type;
 	b->this.fd = fd;
 	b->this.flags = flags;
+	if (index_fd(impl, b) < 0) {
+		free(b);
+		return NULL;
+	}
 	b->this.id = pw_map_insert_new(&impl->map, b);
 	spa_list_append(&impl->blocks, &b->link);
 
@@ -692,6 +1026,7 @@ struct pw_memblock * pw_mempool_import(struct pw_mempool *pool,
 static void memblock_invalidated(void *data)
 {
 	struct memblock *b = data;
+	struct mempool *impl = SPA_CONTAINER_OF(b->this.pool, struct mempool, this);
 
 	if (!b->owner)
 		return;
@@ -702,6 +1037,7 @@ static void memblock_invalidated(void *data)
 	spa_hook_remove(&b->owner_listener);
 	b->owner = NULL;
 
+	unindex_fd(impl, b);
 	b->this.fd = -1;
 }
 
@@ -733,6 +1069,10 @@ struct pw_memblock * pw_mempool_import_block(struct pw_mempool *pool,
 		while (bmem->owner)
 			bmem = bmem->owner;
 
+		/* the fd is shared with the users of the other pool, they could
+		 * keep it, so the memory can't be given to anyone else later */
+		bmem->cacheable = false;
+
 		if (!(bmem->this.flags & PW_MEMBLOCK_FLAG_DONT_CLOSE)) {
 			b->owner = bmem;
 			spa_hook_list_append(&bmem->listener_list, &b->owner_listener, &memblock_events, b);
@@ -746,6 +1086,7 @@ SPA_EXPORT
 struct pw_memmap * pw_mempool_import_map(struct pw_mempool *pool,
 		struct pw_mempool *other, void *data, uint32_t size, uint32_t tag[5])
 {
+	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
 	struct pw_memblock *old, *block;
 	struct memblock *b;
 	struct pw_memmap *map;
@@ -775,6 +1116,11 @@ struct pw_memmap * pw_mempool_import_map(struct pw_mempool *pool,
 		m->block = b;
 		m->offset = old->map->offset;
 		m->size = old->map->size;
+		if (index_mapping(impl, m) < 0) {
+			free(m);
+			pw_memblock_unref(block);
+			return NULL;
+		}
 		spa_list_append(&b->mappings, &m->link);
 		pw_log_debug("%p: mapping:%p block:%p offset:%u size:%u ref:%u",
 				pool, m, block, m->offset, m->size, block->ref);
@@ -839,6 +1185,7 @@ void pw_memblock_free(struct pw_memblock *block)
 	if (block->id != SPA_ID_INVALID)
 		pw_map_remove(&impl->map, block->id);
 	spa_list_remove(&b->link);
+	unindex_fd(impl, b);
 
 	if (!SPA_FLAG_IS_SET(block->flags, PW_MEMBLOCK_FLAG_DONT_NOTIFY))
 		pw_mempool_emit_removed(impl, block);
@@ -850,6 +1197,8 @@ void pw_memblock_free(struct pw_memblock *block)
 
 	memblock_emit_invalidated(b);
 
+	cache_put(impl, b);
+
 	spa_list_consume(mm, &b->memmaps, link)
 		pw_memmap_free(&mm->this);
 
@@ -872,19 +1221,15 @@ SPA_EXPORT
 struct pw_memblock * pw_mempool_find_ptr(struct pw_mempool *pool, const void *ptr)
 {
 	struct mempool *impl = SPA_CONTAINER_OF(pool, struct mempool, this);
-	struct memblock *b;
 	struct mapping *m;
 
-	spa_list_for_each(b, &impl->blocks, link) {
-		spa_list_for_each(m, &b->mappings, link) {
-			if (ptr >= m->ptr && ptr < SPA_PTROFF(m->ptr, m->size, void)) {
-				pw_log_debug("%p: block:%p id:%u for %p", pool,
-						b, b->this.id, ptr);
-				return &b->this;
-			}
-		}
-	}
-	return NULL;
+	m = find_mapping_ptr(impl, ptr);
+	if (m == NULL)
+		return NULL;
+
+	pw_log_debug("%p: block:%p id:%u for %p", pool,
+			m->block, m->block->this.id, ptr);
+	return &m->block->this;
 }
 
 SPA_EXPORT
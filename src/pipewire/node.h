@@ -31,7 +31,7 @@ extern "C" {
 
 #define PW_NODE_PERM_MASK	PW_PERM_RWXML
 
-#define PW_VERSION_NODE		3
+#define PW_VERSION_NODE		4
 struct pw_node;
 
 #ifndef PW_API_NODE_IMPL
@@ -13,19 +13,23 @@
 #include <pwd.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include <dirent.h>
 #include <pthread.h>
+#include <sys/stat.h>
 
 #include <locale.h>
 #include <libintl.h>
 
 #include <valgrind/valgrind.h>
 
+#include <spa/utils/json.h>
 #include <spa/utils/names.h>
 #include <spa/utils/string.h>
 #include <spa/support/cpu.h>
 #include <spa/support/i18n.h>
 
 #include "pipewire.h"
+#include "conf.h"
 #include "private.h"
 #include "i18n.h"
 
@@ -33,6 +37,8 @@
 
 #define SUPPORTLIB	"support/libspa-support"
 
+#define FACTORY_CACHE		"spa-factories.conf"
+
 PW_LOG_TOPIC_EXTERN(log_context);
 #define PW_LOG_TOPIC_DEFAULT log_context
 
@@ -75,6 +81,9 @@ struct support {
 	unsigned int no_color:1;
 	unsigned int no_config:1;
 	unsigned int do_dlclose:1;
+	unsigned int no_cache:1;
+	struct pw_properties *factory_cache;
+	struct pw_properties *factory_probed;
 };
 
 static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -314,6 +323,370 @@ error:
 	return NULL;
 }
 
+/* The factory cache maps factory names to the library that implements
+ * them so that a factory can be found without loading all plugins.
+ *
+ * The cache is filled lazily, one library at a time. An entry is used when
+ * the library did not change since it was scanned, otherwise only that
+ * library is scanned again. When a factory is not in the cache, only the
+ * libraries in the plugin subdirectories that are named after a part of the
+ * factory name are scanned, like alsa/ for api.alsa.pcm.sink or
+ * audioconvert/ for audio.convert. Every library is scanned at most once
+ * per process and without holding the support lock. The cache file is only
+ * written when a scan changed its contents. */
+struct cache_entry {
+	char library[PATH_MAX];
+	char path[PATH_MAX];
+	uint64_t mtime;
+};
+
+struct scan {
+	char *filename;
+	char *library;
+	struct pw_properties *entries;
+};
+
+static int get_cache_dir(char *path, size_t size)
+{
+	const char *dir;
+
+	if ((dir = getenv("XDG_CACHE_HOME")) != NULL)
+		return spa_scnprintf(path, size, "%s/pipewire", dir);
+	if ((dir = getenv("HOME")) != NULL)
+		return spa_scnprintf(path, size, "%s/.cache/pipewire", dir);
+	return -ENOENT;
+}
+
+static int get_mtime(const char *path, uint64_t *mtime)
+{
+	struct stat st;
+
+	if (stat(path, &st) < 0)
+		return -errno;
+	*mtime = SPA_TIMESPEC_TO_NSEC(&st.st_mtim);
+	return 0;
+}
+
+static int parse_cache_entry(const char *str, struct cache_entry *e)
+{
+	char mtime[64];
+	size_t len = strlen(str);
+
+	if (spa_json_str_object_find(str, len, "library", e->library, sizeof(e->library)) <= 0 ||
+	    spa_json_str_object_find(str, len, "path", e->path, sizeof(e->path)) <= 0 ||
+	    spa_json_str_object_find(str, len, "mtime", mtime, sizeof(mtime)) <= 0 ||
+	    !spa_atou64(mtime, &e->mtime, 10))
+		return -EINVAL;
+	return 0;
+}
+
+/* find the plugin dir of a library in the cache, the plugin path could
+ * have changed since the entry was made */
+static const char *cache_entry_dir(struct support *sup, const struct cache_entry *e,
+		size_t *len)
+{
+	char filename[PATH_MAX];
+	const char *state = NULL, *p;
+
+	while ((p = pw_split_walk(sup->plugin_dir, ":", len, &state))) {
+		if (spa_scnprintf(filename, sizeof(filename), "%.*s/%s.so",
+				(int)*len, p, e->library) >= 0 &&
+		    spa_streq(filename, e->path))
+			return p;
+	}
+	return NULL;
+}
+
+/* queue a library for scanning, unless it was already scanned */
+static int add_scan(struct support *sup, struct pw_array *scans,
+		const char *path, size_t len, const char *lib)
+{
+	char filename[PATH_MAX];
+	struct scan *s;
+
+	if (spa_scnprintf(filename, sizeof(filename), "%.*s/%s.so", (int)len, path, lib) < 0 ||
+	    pw_properties_get(sup->factory_probed, filename) != NULL)
+		return 0;
+
+	if ((s = pw_array_add(scans, sizeof(*s))) == NULL)
+		return -errno;
+	s->filename = strdup(filename);
+	s->library = strdup(lib);
+	s->entries = NULL;
+	if (s->filename == NULL || s->library == NULL)
+		return -errno;
+
+	pw_properties_set(sup->factory_probed, filename, "true");
+	return 1;
+}
+
+/* read the factories of a library, this runs without the support lock */
+static int scan_library(struct scan *s)
+{
+	const struct spa_handle_factory *factory;
+	const struct spa_interface_info *info;
+	spa_handle_factory_enum_func_t enum_func;
+	char buffer[4096], str[PATH_MAX + 2];
+	struct spa_strbuf b;
+	uint32_t index, i;
+	uint64_t mtime;
+	void *hnd;
+	int res;
+
+	if (s->filename == NULL || s->library == NULL ||
+	    (s->entries = pw_properties_new(NULL, NULL)) == NULL)
+		return -ENOMEM;
+	if ((res = get_mtime(s->filename, &mtime)) < 0)
+		return res;
+
+	if ((hnd = dlopen(s->filename, RTLD_NOW)) == NULL) {
+		pw_log_debug("can't load %s: %s", s->filename, dlerror());
+		return -ENOENT;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		res = -ENOSYS;
+		goto done;
+	}
+	for (index = 0; enum_func(&factory, &index) > 0;) {
+		if (factory->version < 1)
+			continue;
+
+		spa_strbuf_init(&b, buffer, sizeof(buffer));
+		spa_json_encode_string(str, sizeof(str), s->library);
+		spa_strbuf_append(&b, "{ \"library\": %s", str);
+		spa_json_encode_string(str, sizeof(str), s->filename);
+		spa_strbuf_append(&b, ", \"path\": %s", str);
+		spa_strbuf_append(&b, ", \"mtime\": %"PRIu64", \"interfaces\": [", mtime);
+		for (i = 0; spa_handle_factory_enum_interface_info(factory, &info, &i) > 0;)
+			spa_strbuf_append(&b, " \"%s\"", info->type);
+		spa_strbuf_append(&b, " ] }");
+
+		pw_properties_set(s->entries, factory->name, buffer);
+	}
+	res = s->entries->dict.n_items;
+done:
+	if (pw_should_dlclose())
+		dlclose(hnd);
+
+	pw_log_debug("library '%s': %d factories", s->filename, res);
+	return res;
+}
+
+/* replace the entries of a scanned library in the cache, returns true
+ * when the cache changed */
+static bool merge_scan(struct support *sup, struct scan *s)
+{
+	struct pw_properties *cache = sup->factory_cache;
+	const struct spa_dict_item *it;
+	struct cache_entry e;
+	const char *val;
+	bool changed = false;
+	size_t len;
+
+	if (s->filename == NULL)
+		return false;
+again:
+	spa_dict_for_each(it, &cache->dict) {
+		if (parse_cache_entry(it->value, &e) == 0 && spa_streq(e.path, s->filename) &&
+		    (s->entries == NULL || pw_properties_get(s->entries, it->key) == NULL)) {
+			pw_properties_set(cache, it->key, NULL);
+			changed = true;
+			goto again;
+		}
+	}
+	if (s->entries == NULL)
+		return changed;
+
+	spa_dict_for_each(it, &s->entries->dict) {
+		/* keep the entries of other libraries that are still valid */
+		if ((val = pw_properties_get(cache, it->key)) != NULL &&
+		    parse_cache_entry(val, &e) == 0 && !spa_streq(e.path, s->filename) &&
+		    cache_entry_dir(sup, &e, &len) != NULL)
+			continue;
+		if (pw_properties_set(cache, it->key, it->value) > 0)
+			changed = true;
+	}
+	return changed;
+}
+
+/* check if a plugin subdir is named after a part of the factory name,
+ * a single part or a concatenation of parts: alsa for api.alsa.pcm.sink,
+ * audioconvert for audio.convert */
+static bool factory_matches_dir(const char *factory_name, const char *dir)
+{
+	const char *p, *q;
+	size_t len;
+
+	for (p = factory_name; *p; p = q[0] ? q + 1 : q) {
+		const char *d = dir;
+
+		for (q = p; *q && *d; ) {
+			len = strcspn(q, ".");
+			if (strncmp(q, d, len) != 0)
+				break;
+			d += len;
+			q += len;
+			if (*d == '\0')
+				return true;
+			if (*q == '.')
+				q++;
+		}
+		q = p + strcspn(p, ".");
+	}
+	return false;
+}
+
+static void probe_libraries(struct support *sup, const char *factory_name,
+		struct pw_array *scans)
+{
+	char dirname[PATH_MAX], subdir[PATH_MAX * 2], lib[PATH_MAX];
+	const char *state = NULL, *p;
+	struct dirent **entries, **libs;
+	int i, j, n_entries, n_libs;
+	size_t len, l;
+
+	while ((p = pw_split_walk(sup->plugin_dir, ":", &len, &state))) {
+		if (spa_scnprintf(dirname, sizeof(dirname), "%.*s", (int)len, p) < 0 ||
+		    (n_entries = scandir(dirname, &entries, NULL, alphasort)) < 0)
+			continue;
+
+		for (i = 0; i < n_entries; i++) {
+			if (entries[i]->d_name[0] == '.' ||
+			    !factory_matches_dir(factory_name, entries[i]->d_name))
+				goto next;
+			snprintf(subdir, sizeof(subdir), "%s/%s", dirname, entries[i]->d_name);
+			if ((n_libs = scandir(subdir, &libs, NULL, alphasort)) < 0)
+				goto next;
+			for (j = 0; j < n_libs; j++) {
+				l = strlen(libs[j]->d_name);
+				if (l > 3 && spa_streq(&libs[j]->d_name[l - 3], ".so") &&
+				    spa_scnprintf(lib, sizeof(lib), "%s/%.*s",
+						entries[i]->d_name, (int)(l - 3), libs[j]->d_name) >= 0)
+					add_scan(sup, scans, p, len, lib);
+				free(libs[j]);
+			}
+			free(libs);
+next:
+			free(entries[i]);
+		}
+		free(entries);
+	}
+}
+
+static int lookup_cache(struct support *sup, const char *factory_name,
+		struct cache_entry *e, const char **dir, size_t *len)
+{
+	const char *str;
+	uint64_t mtime;
+
+	if ((str = pw_properties_get(sup->factory_cache, factory_name)) == NULL)
+		return -ENOENT;
+	if (parse_cache_entry(str, e) < 0 ||
+	    (*dir = cache_entry_dir(sup, e, len)) == NULL)
+		return -EINVAL;
+	if (get_mtime(e->path, &mtime) < 0 || mtime != e->mtime)
+		return -ESTALE;
+	return 0;
+}
+
+static int find_cached_lib(struct support *sup, const char *factory_name,
+		struct cache_entry *e, struct pw_array *scans)
+{
+	char dirname[PATH_MAX], filename[PATH_MAX + 32];
+	const char *dir;
+	size_t len;
+	int res;
+
+	if (sup->factory_cache == NULL) {
+		if ((sup->factory_cache = pw_properties_new(NULL, NULL)) == NULL ||
+		    (sup->factory_probed = pw_properties_new(NULL, NULL)) == NULL)
+			return -errno;
+		if (get_cache_dir(dirname, sizeof(dirname)) >= 0 &&
+		    spa_scnprintf(filename, sizeof(filename), "%s/%s", dirname, FACTORY_CACHE) >= 0 &&
+		    access(filename, R_OK) == 0)
+			pw_conf_load_state(dirname, FACTORY_CACHE, sup->factory_cache);
+	}
+	res = lookup_cache(sup, factory_name, e, &dir, &len);
+	if (res == -ESTALE)
+		/* the library changed, scan only that one again */
+		add_scan(sup, scans, dir, len, e->library);
+	else if (res < 0)
+		probe_libraries(sup, factory_name, scans);
+	return res;
+}
+
+static void update_cache(struct support *sup, struct pw_array *scans)
+{
+	char dirname[PATH_MAX];
+	struct scan *s;
+	bool changed = false;
+	int res;
+
+	pw_array_for_each(s, scans)
+		changed |= merge_scan(sup, s);
+
+	if (changed &&
+	    get_cache_dir(dirname, sizeof(dirname)) >= 0 &&
+	    (res = pw_conf_save_state(dirname, FACTORY_CACHE, sup->factory_cache)) < 0)
+		pw_log_info("can't save factory cache in '%s': %s",
+				dirname, spa_strerror(res));
+}
+
+/** Find the library that implements a factory
+ *
+ * \param factory_name the name of a factory
+ * \param lib result buffer for the library name
+ * \param size size of \a lib
+ * \return the length of the library name or < 0 on error
+ */
+int pw_find_spa_lib(const char *factory_name, char *lib, size_t size)
+{
+	struct support *sup = &global_support;
+	struct pw_array scans = PW_ARRAY_INIT(4 * sizeof(struct scan));
+	struct cache_entry e;
+	struct scan *s;
+	const char *dir;
+	size_t len;
+	int res;
+
+	pthread_mutex_lock(&support_lock);
+	if (sup->init_count == 0 || sup->plugin_dir == NULL)
+		res = -EBADFD;
+	else if (sup->no_cache)
+		res = -ENOTSUP;
+	else
+		res = find_cached_lib(sup, factory_name, &e, &scans);
+	pthread_mutex_unlock(&support_lock);
+
+	if (pw_array_get_len(&scans, struct scan) > 0) {
+		/* loading libraries can be slow, don't block other threads
+		 * that load plugins meanwhile */
+		pw_array_for_each(s, &scans)
+			scan_library(s);
+
+		pthread_mutex_lock(&support_lock);
+		if (sup->factory_cache != NULL) {
+			update_cache(sup, &scans);
+			res = lookup_cache(sup, factory_name, &e, &dir, &len);
+		}
+		pthread_mutex_unlock(&support_lock);
+
+		pw_array_for_each(s, &scans) {
+			free(s->filename);
+			free(s->library);
+			pw_properties_free(s->entries);
+		}
+	}
+	pw_array_clear(&scans);
+
+	if (res >= 0)
+		res = spa_scnprintf(lib, size, "%s", e.library);
+
+	pw_log_debug("factory '%s': %s", factory_name,
+			res < 0 ? spa_strerror(res) : lib);
+	return res;
+}
+
 static struct handle *find_handle(struct spa_handle *handle)
 {
 	struct registry *registry = &global_support.registry;
@@ -524,6 +897,9 @@ void pw_init(int *argc, char **argv[])
 	if ((str = getenv("PIPEWIRE_NO_CONFIG")) != NULL)
 		support->no_config = pw_properties_parse_bool(str);
 
+	if ((str = getenv("PIPEWIRE_NO_SPA_CACHE")) != NULL)
+		support->no_cache = pw_properties_parse_bool(str);
+
 	init_i18n(support);
 
 	if ((str = getenv("SPA_PLUGIN_DIR")) == NULL)
@@ -628,6 +1004,8 @@ void pw_deinit(void)
 	spa_list_consume(h, &registry->handles, link)
 		unref_handle(h);
 
+	pw_properties_free(support->factory_cache);
+	pw_properties_free(support->factory_probed);
 	free(support->i18n_domain);
 	spa_zero(global_support);
 	pthread_mutex_unlock(&support_lock);
@@ -17,6 +17,7 @@
 #include <spa/param/latency-utils.h>
 #include <spa/utils/atomic.h>
 #include <spa/utils/ratelimit.h>
+#include <spa/utils/ringbuffer.h>
 #include <spa/utils/result.h>
 #include <spa/utils/type-info.h>
 
@@ -354,6 +355,7 @@ pw_core_resource_errorf(struct pw_resource *resource, uint32_t id, int seq,
 #define pw_registry_resource(r,m,v,...) pw_resource_call(r, struct pw_registry_events,m,v,##__VA_ARGS__)
 #define pw_registry_resource_global(r,...)        pw_registry_resource(r,global,0,__VA_ARGS__)
 #define pw_registry_resource_global_remove(r,...) pw_registry_resource(r,global_remove,0,__VA_ARGS__)
+#define pw_registry_resource_snapshot(r,...)      pw_registry_resource(r,snapshot,1,__VA_ARGS__)
 
 #define pw_context_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_context_events, m, v, ##__VA_ARGS__)
 #define pw_context_emit_destroy(c)		pw_context_emit(c, destroy, 0)
@@ -382,6 +384,10 @@ struct pw_context {
 	uint64_t serial;
 	uint64_t generation;			/**< registry generation number */
 	struct pw_map globals;			/**< map of globals */
+	uint64_t registry_serial;		/**< bumped when the globals change */
+	struct pw_memblock *snapshot;		/**< sealed snapshot of the globals or NULL */
+	uint64_t snapshot_serial;		/**< registry_serial of the snapshot */
+	uint32_t snapshot_size;			/**< size of the snapshot */
 
 	struct spa_list core_impl_list;		/**< list of core_imp */
 	struct spa_list protocol_list;		/**< list of protocols */
@@ -406,6 +412,7 @@ struct pw_context {
 	struct pw_loop *main_loop;		/**< main loop for control */
 	struct pw_work_queue *work_queue;	/**< work queue */
 	struct pw_timer_queue *timer_queue;	/**< timer queue */
+	struct pw_worker_pool *worker_pool;	/**< pool of processing threads or NULL */
 
 	struct spa_support support[16];	/**< support for spa plugins */
 	uint32_t n_support;		/**< number of support items */
@@ -417,6 +424,7 @@ struct pw_context {
 
 	long sc_pagesize;
 	unsigned int freewheeling:1;
+	unsigned int no_snapshot:1;	/**< registry snapshots are not possible */
 
 	void *user_data;		/**< extra user data */
 };
@@ -599,7 +607,13 @@ struct pw_node_activation {
 							 * CAS their node id in this array. */
 	uint64_t prev_awake_time;
 	uint64_t prev_finish_time;
-	uint32_t padding[7];				/* must be 0 */
+#define PW_NODE_ACTIVATION_WAITER_SLEEPING	0	/* the node needs an eventfd wakeup */
+#define PW_NODE_ACTIVATION_WAITER_SPINNING	1	/* the node is spinning */
+#define PW_NODE_ACTIVATION_WAITER_WOKEN		2	/* the signaller woke the spinning node */
+	uint32_t waiter;				/* how the node waits for the next trigger, the
+							 * signaller that moves it from SPINNING to WOKEN
+							 * skips the eventfd write */
+	uint32_t padding[6];				/* must be 0 */
 
 	uint32_t client_version;			/* verions of client, see above */
 	uint32_t server_version;			/* verions of server, see above */
@@ -634,6 +648,38 @@ struct pw_node_activation {
 							 * to update wins */
 };
 
+/* A param in the param ring, followed by the param of size bytes. The messages are
+ * aligned to 16 bytes and don't wrap around, a message with id SPA_ID_INVALID skips
+ * the rest of the ring. */
+struct pw_node_param_msg {
+	uint32_t id;
+	uint32_t flags;
+	uint32_t size;
+	uint32_t padding;
+};
+
+/* Shared memory with a single producer, single consumer ring of params. The server
+ * writes the params for a client node and the client sets them on the node from
+ * the data loop at the start of each cycle. */
+struct pw_node_param_ring {
+	struct spa_ringbuffer ring;
+	uint32_t size;					/* size of the data, a power of 2 */
+	uint32_t padding[13];
+	/* followed by the messages */
+};
+
+/* hint the CPU that we are in a busy-wait loop */
+static inline void pw_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	SPA_BARRIER;
+#endif
+}
+
 static inline uint64_t get_time_ns(struct spa_system *system)
 {
 	struct timespec ts;
@@ -641,6 +687,53 @@ static inline uint64_t get_time_ns(struct spa_system *system)
 	return SPA_TIMESPEC_TO_NSEC(&ts);
 }
 
+/* Called from the data thread after the node finished processing. Spin for
+ * at most spin_time. The signaller either moves the waiter from SPINNING to
+ * WOKEN and does not write to the eventfd, or finds the node SLEEPING and
+ * writes the eventfd. The node is woken up in exactly one of the two ways so
+ * that there are no stale eventfd wakeups.
+ *
+ * The node is triggered at the earliest one cycle after the current trigger.
+ * When that is further away than spin_time, we don't spin at all and sleep
+ * in the loop, spinning would only burn CPU until the next cycle.
+ *
+ * Returns true when the node was triggered and can be processed. */
+static inline bool pw_node_activation_spin(struct pw_node_activation *a,
+		struct spa_io_position *pos, struct spa_system *system, uint64_t spin_time)
+{
+	uint64_t now = get_time_ns(system), end = now + spin_time, next;
+	uint32_t count = 0;
+
+	if (pos == NULL || pos->clock.next_nsec <= pos->clock.nsec)
+		return false;
+	next = a->signal_time + (pos->clock.next_nsec - pos->clock.nsec);
+	if (next > end)
+		return false;
+
+	SPA_ATOMIC_STORE(a->waiter, PW_NODE_ACTIVATION_WAITER_SPINNING);
+	while (SPA_ATOMIC_LOAD(a->waiter) == PW_NODE_ACTIVATION_WAITER_SPINNING) {
+		if ((++count & 0x3f) == 0 && get_time_ns(system) >= end) {
+			/* when this fails, we were woken before we went to sleep */
+			if (SPA_ATOMIC_CAS(a->waiter, PW_NODE_ACTIVATION_WAITER_SPINNING,
+						PW_NODE_ACTIVATION_WAITER_SLEEPING))
+				return false;
+			break;
+		}
+		pw_cpu_relax();
+	}
+	SPA_ATOMIC_STORE(a->waiter, PW_NODE_ACTIVATION_WAITER_SLEEPING);
+	return true;
+}
+
+/* Called from the signaller after the node was triggered. Returns true when
+ * the node was spinning and saw the trigger, false when the eventfd needs
+ * to be written. */
+static inline bool pw_node_activation_wake(struct pw_node_activation *a)
+{
+	return SPA_ATOMIC_CAS(a->waiter, PW_NODE_ACTIVATION_WAITER_SPINNING,
+			PW_NODE_ACTIVATION_WAITER_WOKEN);
+}
+
 /* called from data-loop decrement the dependency counter of the target and when
  * there are no more dependencies, trigger the node. */
 static inline int trigger_target_v1(struct pw_node_target *t, uint64_t nsec)
@@ -658,6 +751,8 @@ static inline int trigger_target_v1(struct pw_node_target *t, uint64_t nsec)
 					PW_NODE_ACTIVATION_NOT_TRIGGERED,
 					PW_NODE_ACTIVATION_TRIGGERED))) {
 			a->signal_time = nsec;
+			if (pw_node_activation_wake(a))
+				return res;
 			if (SPA_UNLIKELY((r = spa_system_eventfd_write(t->system, t->fd, 1)) < 0)) {
 				pw_log_warn("%p: write failed %s", t->node, spa_strerror(r));
 				res = r;
@@ -821,6 +916,7 @@ struct pw_impl_node {
 	uint32_t force_rate;			/**< forced rate */
 	uint32_t stamp;				/**< stamp of last update */
 	struct spa_source source;		/**< source to remotely trigger this node */
+	uint64_t spin_time;			/**< time to spin for the next trigger in nsec */
 	struct pw_memblock *activation;
 	struct {
 		struct spa_io_clock *clock;	/**< io area of the clock or NULL */
@@ -837,12 +933,23 @@ struct pw_impl_node {
 
 		struct spa_ratelimit rate_limit;
 
+		struct pw_worker_pool *pool;		/**< the worker pool that processes this
+							  *  node or NULL */
+		const uint32_t *loop_nodes;		/**< number of nodes on the data loop or
+							  *  NULL, we only spin when it is 1 */
+		struct spa_list *fused_queue;		/**< queue for the fused targets while
+							  *  the node is processed */
+		struct spa_list fused_link;		/**< link in the fused queue */
+
 		bool prepared;				/**< the node was added to loop */
 	} rt;
 	struct pw_node_peer *to_driver_peer;		/* node -> driver */
 	struct pw_node_peer *from_driver_peer;		/* driver -> node */
 	struct spa_fraction target_rate;
 	uint64_t target_quantum;
+	uint32_t adaptive_quantum;	/* quantum requested by the adaptive quantum policy */
+	uint32_t adaptive_xruns;	/* xrun count of the followers at the last check */
+	uint32_t adaptive_stable;	/* seconds of low load since the last change */
 
 	uint64_t driver_start;
 	uint64_t elapsed;		/* elapsed time in playing */
@@ -1106,6 +1213,9 @@ struct pw_proxy {
 
 	const struct pw_protocol_marshal *marshal;	/**< protocol specific marshal functions */
 
+	struct pw_properties *info_props;	/**< properties merged from the info
+						  *  deltas */
+
 	void *user_data;		/**< extra user data */
 };
 
@@ -1275,6 +1385,11 @@ void pw_proxy_remove(struct pw_proxy *proxy);
 
 int pw_context_recalc_graph(struct pw_context *context, const char *reason);
 
+void pw_context_add_node_groups(struct pw_context *context, struct pw_impl_node *node);
+void pw_context_remove_node_groups(struct pw_context *context, struct pw_impl_node *node);
+
+const uint32_t *pw_context_get_loop_nodes(struct pw_context *context, struct pw_loop *loop);
+
 void pw_impl_port_update_info(struct pw_impl_port *port, const struct spa_port_info *info);
 
 int pw_impl_port_register(struct pw_impl_port *port,
@@ -1350,11 +1465,29 @@ int pw_impl_node_set_driver(struct pw_impl_node *node, struct pw_impl_node *driv
 
 int pw_impl_node_trigger(struct pw_impl_node *node);
 
+/** Process a triggered node, called from the worker threads */
+int pw_impl_node_process(struct pw_impl_node *node);
+
+/** Update the peers of the node that are processed directly from the node */
+void pw_impl_node_update_fused(struct pw_impl_node *node);
+
 int pw_impl_node_set_io(struct pw_impl_node *node, uint32_t id, void *data, size_t size);
 
 int pw_impl_node_add_target(struct pw_impl_node *node, struct pw_node_target *t);
 int pw_impl_node_remove_target(struct pw_impl_node *node, struct pw_node_target *t);
 
+int pw_impl_node_set_param_ring(struct pw_impl_node *node, struct pw_node_param_ring *ring,
+		size_t size);
+
+struct pw_worker_pool *pw_worker_pool_new(struct pw_context *context,
+		const struct spa_dict *props, uint32_t n_workers);
+void pw_worker_pool_destroy(struct pw_worker_pool *pool);
+struct pw_loop *pw_worker_pool_get_loop(struct pw_worker_pool *pool);
+int pw_worker_pool_start(struct pw_worker_pool *pool);
+void pw_worker_pool_stop(struct pw_worker_pool *pool);
+int pw_worker_pool_set_rt(struct pw_worker_pool *pool, bool rt);
+int pw_worker_pool_queue(struct pw_worker_pool *pool, struct pw_impl_node *node);
+
 /** Prepare a link
   * Starts the negotiation of formats and buffers on \a link */
 int pw_impl_link_prepare(struct pw_impl_link *link);
@@ -1409,6 +1542,20 @@ void pw_settings_clean(struct pw_context *context);
 
 bool pw_should_dlclose(void);
 
+int pw_find_spa_lib(const char *factory_name, char *lib, size_t size);
+
+struct pw_properties *pw_context_get_mempool_props(struct pw_context *context);
+
+/** set on the core of clients that map memory aligned to the huge page size */
+#define PW_MEMPOOL_KEY_MAP_HUGEPAGES	"mem.map-hugepages"
+
+int pw_context_get_registry_snapshot(struct pw_context *context,
+		struct pw_memblock **mem, uint32_t *size);
+
+bool pw_registry_resource_filter_show(struct pw_resource *registry, struct pw_global *global);
+bool pw_registry_resource_filter_hide(struct pw_resource *registry, struct pw_global *global);
+void pw_registry_resource_filter_update(struct pw_resource *registry, struct pw_global *global);
+
 void pw_log_topic_register_enum(const struct spa_log_topic_enum *e);
 void pw_log_topic_unregister_enum(const struct spa_log_topic_enum *e);
 
@@ -288,6 +288,7 @@ void pw_proxy_unref(struct pw_proxy *proxy)
 		}
 	}
 #endif
+	pw_properties_free(proxy->info_props);
 	free(proxy);
 }
 
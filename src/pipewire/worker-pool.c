@@ -0,0 +1,535 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+
+#include <spa/utils/atomic.h>
+#include <spa/utils/result.h>
+
+#include <pipewire/log.h>
+
+#include "pipewire/private.h"
+#include "pipewire/thread.h"
+
+PW_LOG_TOPIC_EXTERN(log_worker_pool);
+#define PW_LOG_TOPIC_DEFAULT log_worker_pool
+
+#define MAX_WORKERS	64u
+#define QUEUE_SIZE	1024u
+#define QUEUE_MASK	(QUEUE_SIZE - 1)
+
+/** \cond */
+
+/* A bounded multi-producer multi-consumer queue. Every slot has a sequence
+ * number that tells producers and consumers if the slot is ready for them. */
+struct slot {
+	uint32_t seq;
+	struct pw_impl_node *node;
+};
+
+struct worker {
+	struct pw_worker_pool *pool;
+	struct spa_thread *thread;
+	pthread_t tid;		/* valid when ready is set */
+	int ready;
+	uint32_t index;
+};
+
+/* The worker pool runs nodes on any of its worker threads.
+ *
+ * The pool has one loop that is handed to the nodes as their data loop. The
+ * thread of this loop handles the sources, timers and invoke queue. Because
+ * the nodes can now be processed by any worker, we need to make sure that
+ * the processing of a node does not run concurrently with the invoke and
+ * locked functions of its loop. For this, the workers take a shared lock
+ * while processing a node and the loop thread takes the exclusive lock
+ * while it dispatches events. The spa_loop we hand out to the nodes takes
+ * the exclusive lock for the locked function. */
+struct pw_worker_pool {
+	struct pw_context *context;
+
+	struct pw_loop *base;
+	struct spa_hook hook;
+	pthread_t loop_thread;
+	struct spa_thread *thread;
+	bool write_locked;
+
+	struct pw_loop this;
+	struct spa_loop loop;
+
+	pthread_rwlock_t lock;
+	sem_t sem;
+	sem_t started;
+
+	uint32_t head;
+	uint32_t tail;
+	struct slot slots[QUEUE_SIZE];
+
+	uint32_t n_workers;
+	struct worker workers[MAX_WORKERS];
+
+	bool running;
+};
+/** \endcond */
+
+static int loop_add_source(void *object, struct spa_source *source)
+{
+	struct pw_worker_pool *pool = object;
+	return spa_loop_add_source(pool->base->loop, source);
+}
+
+static int loop_update_source(void *object, struct spa_source *source)
+{
+	struct pw_worker_pool *pool = object;
+	return spa_loop_update_source(pool->base->loop, source);
+}
+
+static int loop_remove_source(void *object, struct spa_source *source)
+{
+	struct pw_worker_pool *pool = object;
+	return spa_loop_remove_source(pool->base->loop, source);
+}
+
+static bool in_worker(struct pw_worker_pool *pool)
+{
+	pthread_t self = pthread_self();
+	uint32_t i;
+
+	for (i = 0; i < pool->n_workers; i++) {
+		struct worker *w = &pool->workers[i];
+		if (SPA_ATOMIC_LOAD(w->ready) && pthread_equal(w->tid, self))
+			return true;
+	}
+	return false;
+}
+
+static int loop_invoke(void *object, spa_invoke_func_t func, uint32_t seq,
+		const void *data, size_t size, bool block, void *user_data)
+{
+	struct pw_worker_pool *pool = object;
+	bool worker = block && in_worker(pool);
+	int res;
+
+	/* invoke functions are dispatched from the loop thread, which holds the
+	 * exclusive lock while it dispatches. A worker that blocks on it must
+	 * release its shared lock or the loop thread can never get there. */
+	if (worker)
+		pthread_rwlock_unlock(&pool->lock);
+	res = spa_loop_invoke(pool->base->loop, func, seq, data, size, block, user_data);
+	if (worker)
+		pthread_rwlock_rdlock(&pool->lock);
+	return res;
+}
+
+struct locked_data {
+	struct pw_worker_pool *pool;
+	spa_invoke_func_t func;
+	void *user_data;
+};
+
+static int do_locked(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct locked_data *d = user_data;
+	struct pw_worker_pool *pool = d->pool;
+	bool in_thread = pool->running && pthread_equal(pool->loop_thread, pthread_self());
+	int res;
+
+	/* we now hold the loop lock, also make sure no worker is processing */
+	if (!in_thread)
+		pthread_rwlock_wrlock(&pool->lock);
+	res = d->func(&pool->loop, async, seq, data, size, d->user_data);
+	if (!in_thread)
+		pthread_rwlock_unlock(&pool->lock);
+	return res;
+}
+
+static int loop_locked(void *object, spa_invoke_func_t func, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct pw_worker_pool *pool = object;
+	struct locked_data d = { pool, func, user_data };
+	bool worker = in_worker(pool);
+	int res;
+
+	/* a worker holds the shared lock while it processes a node, it can't
+	 * upgrade that to the exclusive lock so release it first */
+	if (worker)
+		pthread_rwlock_unlock(&pool->lock);
+	/* always take the loop lock first and then our exclusive lock, this is
+	 * the same order as the loop thread uses */
+	res = spa_loop_locked(pool->base->loop, do_locked, seq, data, size, &d);
+	if (worker)
+		pthread_rwlock_rdlock(&pool->lock);
+	return res;
+}
+
+static const struct spa_loop_methods loop_methods = {
+	SPA_VERSION_LOOP_METHODS,
+	.add_source = loop_add_source,
+	.update_source = loop_update_source,
+	.remove_source = loop_remove_source,
+	.invoke = loop_invoke,
+	.locked = loop_locked,
+};
+
+static void loop_before(void *data)
+{
+	struct pw_worker_pool *pool = data;
+	if (pool->write_locked) {
+		pool->write_locked = false;
+		pthread_rwlock_unlock(&pool->lock);
+	}
+}
+
+static void loop_after(void *data)
+{
+	struct pw_worker_pool *pool = data;
+	if (!pool->write_locked) {
+		pthread_rwlock_wrlock(&pool->lock);
+		pool->write_locked = true;
+	}
+}
+
+static const struct spa_loop_control_hooks loop_hooks = {
+	SPA_VERSION_LOOP_CONTROL_HOOKS,
+	.before = loop_before,
+	.after = loop_after,
+};
+
+static inline bool queue_push(struct pw_worker_pool *pool, struct pw_impl_node *node)
+{
+	uint32_t pos = SPA_ATOMIC_LOAD(pool->tail);
+
+	while (true) {
+		struct slot *s = &pool->slots[pos & QUEUE_MASK];
+		uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		int32_t diff = (int32_t)(seq - pos);
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&pool->tail, &pos, pos + 1,
+						true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				s->node = node;
+				__atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+				return true;
+			}
+		} else if (diff < 0) {
+			/* queue is full */
+			return false;
+		} else {
+			pos = SPA_ATOMIC_LOAD(pool->tail);
+		}
+	}
+}
+
+static inline struct pw_impl_node *queue_pop(struct pw_worker_pool *pool)
+{
+	uint32_t pos = SPA_ATOMIC_LOAD(pool->head);
+
+	while (true) {
+		struct slot *s = &pool->slots[pos & QUEUE_MASK];
+		uint32_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+		int32_t diff = (int32_t)(seq - (pos + 1));
+
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&pool->head, &pos, pos + 1,
+						true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				struct pw_impl_node *node = s->node;
+				__atomic_store_n(&s->seq, pos + QUEUE_SIZE, __ATOMIC_RELEASE);
+				return node;
+			}
+		} else if (diff < 0) {
+			/* queue is empty */
+			return NULL;
+		} else {
+			pos = SPA_ATOMIC_LOAD(pool->head);
+		}
+	}
+}
+
+/** Queue a node for processing on one of the workers.
+ *
+ * Called from the realtime threads when the node is triggered.
+ * Returns 0 when the node was queued and -ENOSPC when the queue is full. */
+int pw_worker_pool_queue(struct pw_worker_pool *pool, struct pw_impl_node *node)
+{
+	if (SPA_UNLIKELY(!queue_push(pool, node)))
+		return -ENOSPC;
+	sem_post(&pool->sem);
+	return 0;
+}
+
+static void *do_work(void *user_data)
+{
+	struct worker *w = user_data;
+	struct pw_worker_pool *pool = w->pool;
+	struct pw_impl_node *node;
+	uint32_t count;
+
+	pw_log_debug("%p: worker %d enter", pool, w->index);
+	w->tid = pthread_self();
+	SPA_ATOMIC_STORE(w->ready, 1);
+	sem_post(&pool->started);
+
+	while (true) {
+		if (sem_wait(&pool->sem) < 0) {
+			if (errno == EINTR)
+				continue;
+			pw_log_error("%p: worker %d wait error: %m", pool, w->index);
+			break;
+		}
+		if (SPA_UNLIKELY(!SPA_ATOMIC_LOAD(pool->running)))
+			break;
+
+		/* every token belongs to a queued node. We can still find the head
+		 * slot empty when a producer claimed it but did not publish the node
+		 * yet while a later producer already posted. Keep the token and
+		 * wait for the slot, the producer is only a few instructions away
+		 * from publishing it. */
+		for (count = 0; (node = queue_pop(pool)) == NULL; count++) {
+			if (count < 64)
+				pw_cpu_relax();
+			else
+				sched_yield();
+		}
+
+		pthread_rwlock_rdlock(&pool->lock);
+		pw_impl_node_process(node);
+		pthread_rwlock_unlock(&pool->lock);
+	}
+	pw_log_debug("%p: worker %d leave", pool, w->index);
+	return NULL;
+}
+
+static void *do_loop(void *user_data)
+{
+	struct pw_worker_pool *pool = user_data;
+	int res;
+
+	pw_log_debug("%p: enter loop thread", pool);
+	pool->loop_thread = pthread_self();
+	pw_loop_enter(pool->base);
+	while (SPA_ATOMIC_LOAD(pool->running)) {
+		if ((res = pw_loop_iterate(pool->base, -1)) < 0) {
+			if (res == -EINTR)
+				continue;
+			pw_log_error("%p: iterate error %d (%s)",
+					pool, res, spa_strerror(res));
+		}
+	}
+	if (pool->write_locked) {
+		pool->write_locked = false;
+		pthread_rwlock_unlock(&pool->lock);
+	}
+	pw_loop_leave(pool->base);
+	pw_log_debug("%p: leave loop thread", pool);
+	return NULL;
+}
+
+static int do_stop(struct spa_loop *loop, bool async, uint32_t seq,
+		const void *data, size_t size, void *user_data)
+{
+	struct pw_worker_pool *pool = user_data;
+	SPA_ATOMIC_STORE(pool->running, false);
+	return 0;
+}
+
+static struct spa_thread_utils *get_thread_utils(struct pw_worker_pool *pool)
+{
+	struct spa_thread_utils *utils = pool->context->thread_utils;
+	return utils ? utils : pw_thread_utils_get();
+}
+
+struct pw_worker_pool *pw_worker_pool_new(struct pw_context *context,
+		const struct spa_dict *props, uint32_t n_workers)
+{
+	struct pw_worker_pool *pool;
+	pthread_rwlockattr_t attr;
+	uint32_t i;
+	int res;
+
+	pool = calloc(1, sizeof(*pool));
+	if (pool == NULL)
+		return NULL;
+
+	pool->context = context;
+	pool->n_workers = SPA_MIN(n_workers, MAX_WORKERS);
+
+	pool->base = pw_loop_new(props);
+	if (pool->base == NULL) {
+		res = -errno;
+		goto error_free;
+	}
+
+	pthread_rwlockattr_init(&attr);
+#ifdef PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP
+	/* don't let the workers starve the loop thread */
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+	res = -pthread_rwlock_init(&pool->lock, &attr);
+	pthread_rwlockattr_destroy(&attr);
+	if (res < 0)
+		goto error_loop;
+
+	if (sem_init(&pool->sem, 0, 0) < 0) {
+		res = -errno;
+		goto error_lock;
+	}
+	if (sem_init(&pool->started, 0, 0) < 0) {
+		res = -errno;
+		goto error_sem;
+	}
+	for (i = 0; i < QUEUE_SIZE; i++)
+		pool->slots[i].seq = i;
+
+	pool->loop.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Loop,
+			SPA_VERSION_LOOP, &loop_methods, pool);
+
+	pool->this.system = pool->base->system;
+	pool->this.loop = &pool->loop;
+	pool->this.control = pool->base->control;
+	pool->this.utils = pool->base->utils;
+	pool->this.name = pool->base->name;
+
+	pw_loop_add_hook(pool->base, &pool->hook, &loop_hooks, pool);
+
+	pw_log_info("%p: new worker pool '%s' with %d workers", pool,
+			pool->this.name, pool->n_workers);
+
+	return pool;
+
+error_sem:
+	sem_destroy(&pool->sem);
+error_lock:
+	pthread_rwlock_destroy(&pool->lock);
+error_loop:
+	pw_loop_destroy(pool->base);
+error_free:
+	free(pool);
+	errno = -res;
+	return NULL;
+}
+
+struct pw_loop *pw_worker_pool_get_loop(struct pw_worker_pool *pool)
+{
+	return &pool->this;
+}
+
+int pw_worker_pool_start(struct pw_worker_pool *pool)
+{
+	struct spa_thread_utils *utils = get_thread_utils(pool);
+	struct spa_dict_item items[1];
+	char name[64];
+	uint32_t i;
+	int res;
+
+	if (pool->running)
+		return 0;
+
+	SPA_ATOMIC_STORE(pool->running, true);
+
+	items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_THREAD_NAME, pool->this.name);
+	pool->thread = spa_thread_utils_create(utils, &SPA_DICT_INIT(items, 1), do_loop, pool);
+	if (pool->thread == NULL) {
+		res = -errno;
+		pw_log_error("%p: can't create loop thread: %m", pool);
+		SPA_ATOMIC_STORE(pool->running, false);
+		return res;
+	}
+	spa_thread_utils_acquire_rt(utils, pool->thread, -1);
+
+	for (i = 0; i < pool->n_workers; i++) {
+		struct worker *w = &pool->workers[i];
+
+		w->pool = pool;
+		w->index = i;
+
+		snprintf(name, sizeof(name), "%s.%d", pool->this.name, i);
+		items[0] = SPA_DICT_ITEM_INIT(SPA_KEY_THREAD_NAME, name);
+		w->thread = spa_thread_utils_create(utils, &SPA_DICT_INIT(items, 1), do_work, w);
+		if (w->thread == NULL) {
+			res = -errno;
+			pw_log_error("%p: can't create worker %d: %m", pool, i);
+			pw_worker_pool_stop(pool);
+			return res;
+		}
+		/* wait until the worker published its thread id */
+		while (sem_wait(&pool->started) < 0 && errno == EINTR);
+
+		spa_thread_utils_acquire_rt(utils, w->thread, -1);
+	}
+	pw_log_info("%p: started %d workers", pool, i);
+	return 0;
+}
+
+void pw_worker_pool_stop(struct pw_worker_pool *pool)
+{
+	struct spa_thread_utils *utils = get_thread_utils(pool);
+	uint32_t i;
+
+	if (!pool->running)
+		return;
+
+	pw_loop_invoke(pool->base, do_stop, 1, NULL, 0, false, pool);
+	spa_thread_utils_join(utils, pool->thread, NULL);
+
+	for (i = 0; i < pool->n_workers; i++)
+		sem_post(&pool->sem);
+	for (i = 0; i < pool->n_workers; i++) {
+		struct worker *w = &pool->workers[i];
+		if (w->thread == NULL)
+			continue;
+		spa_thread_utils_join(utils, w->thread, NULL);
+		SPA_ATOMIC_STORE(w->ready, 0);
+		w->thread = NULL;
+	}
+	/* drop the tokens that no worker consumed */
+	while (sem_trywait(&pool->sem) == 0);
+
+	pool->thread = NULL;
+	pw_log_info("%p: stopped", pool);
+}
+
+int pw_worker_pool_set_rt(struct pw_worker_pool *pool, bool rt)
+{
+	struct spa_thread_utils *utils = get_thread_utils(pool);
+	uint32_t i;
+	int r, res = 0;
+
+	if (!pool->running)
+		return 0;
+
+	for (i = 0; i < pool->n_workers; i++) {
+		struct worker *w = &pool->workers[i];
+		if (w->thread == NULL)
+			continue;
+		if (rt)
+			r = spa_thread_utils_acquire_rt(utils, w->thread, -1);
+		else
+			r = spa_thread_utils_drop_rt(utils, w->thread);
+		if (r < 0 && res == 0) {
+			pw_log_warn("%p: can't %s rt for worker %d: %s", pool,
+					rt ? "acquire" : "drop", i, spa_strerror(r));
+			res = r;
+		}
+	}
+	return res;
+}
+
+void pw_worker_pool_destroy(struct pw_worker_pool *pool)
+{
+	pw_log_debug("%p: destroy", pool);
+
+	pw_worker_pool_stop(pool);
+
+	spa_hook_remove(&pool->hook);
+	pw_loop_destroy(pool->base);
+	sem_destroy(&pool->started);
+	sem_destroy(&pool->sem);
+	pthread_rwlock_destroy(&pool->lock);
+	free(pool);
+}
@@ -31,6 +31,9 @@ static void test_core_abi(void)
 				       const struct spa_dict *props,
 				       size_t user_data_size);
 		int (*destroy) (void *object, void *proxy);
+		struct pw_registry * (*get_registry_filtered) (void *object,
+				uint32_t version, const struct spa_dict *filter,
+				size_t user_data_size);
 	} methods = { PW_VERSION_CORE_METHODS, };
 	static const struct {
 		uint32_t version;
@@ -57,7 +60,8 @@ static void test_core_abi(void)
 	TEST_FUNC(m, methods, get_registry);
 	TEST_FUNC(m, methods, create_object);
 	TEST_FUNC(m, methods, destroy);
-	spa_assert_se(PW_VERSION_CORE_METHODS == 0);
+	TEST_FUNC(m, methods, get_registry_filtered);
+	spa_assert_se(PW_VERSION_CORE_METHODS == 1);
 	spa_assert_se(sizeof(m) == sizeof(methods));
 
 	TEST_FUNC(e, events, version);
@@ -94,6 +98,8 @@ static void test_registry_abi(void)
 			uint32_t permissions, const char *type, uint32_t version,
 			const struct spa_dict *props);
 		void (*global_remove) (void *data, uint32_t id);
+		void (*snapshot) (void *data, uint32_t mem_id, uint32_t offset, uint32_t size,
+				uint64_t serial, uint32_t permissions);
 	} events = { PW_VERSION_REGISTRY_EVENTS, };
 
 	TEST_FUNC(m, methods, version);
@@ -106,7 +112,8 @@ static void test_registry_abi(void)
 	TEST_FUNC(e, events, version);
 	TEST_FUNC(e, events, global);
 	TEST_FUNC(e, events, global_remove);
-	spa_assert_se(PW_VERSION_REGISTRY_EVENTS == 0);
+	TEST_FUNC(e, events, snapshot);
+	spa_assert_se(PW_VERSION_REGISTRY_EVENTS == 1);
 	spa_assert_se(sizeof(e) == sizeof(events));
 }
 
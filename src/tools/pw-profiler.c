@@ -64,6 +64,7 @@ struct measurement {
 	int32_t status;
 	struct spa_fraction latency;
 	int32_t xrun_count;
+	int64_t slack;
 };
 
 struct point {
@@ -305,6 +306,32 @@ static int process_follower_clock(struct data *d, const struct spa_pod *pod, str
 	return res;
 }
 
+static int process_follower_slack(struct data *d, const struct spa_pod *pod, struct point *point)
+{
+	uint32_t id = 0, trigger = 0;
+	int64_t slack = 0;
+	int res, i;
+
+	if ((res = spa_pod_parse_struct(pod,
+			SPA_POD_Int(&id),
+			SPA_POD_Int(&trigger),
+			SPA_POD_Long(&slack))) < 0)
+		return res;
+
+	if (d->json_dump) {
+		fprintf(stdout, "{ \"type\": \"followerSlack\", \"id\": %u, "
+				"\"trigger\": %u, \"slack\": %"PRIi64", \"critical\": %s },\n",
+				id, trigger, slack, slack == 0 ? "true" : "false");
+	}
+	for (i = 0; i < d->n_followers; i++) {
+		if (d->followers[i].id == id) {
+			point->follower[i].slack = slack;
+			break;
+		}
+	}
+	return 0;
+}
+
 static void dump_point(struct data *d, struct point *point)
 {
 	int i;
@@ -337,14 +364,15 @@ static void dump_point(struct data *d, struct point *point)
 			double d5 = (point->follower[i].awake - point->driver.signal) / 1000.0;
 			double d6 = (point->follower[i].finish - point->driver.signal) / 1000.0;
 
-			fprintf(d->output, "%u\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%d\t0\t",
+			fprintf(d->output, "%u\t%.3f\t%.3f\t%.3f\t%.3f\t%.3f\t%d\t%.3f\t",
 					d->followers[i].id,
 					d4 > 0 ? d4 : 0,
 					d5 > 0 ? d5 : 0,
 					d6 > 0 ? d6 : 0,
 					(d5 > 0 && d4 >= 0 && d5 > d4) ? d5 - d4 : 0,
 					(d6 > 0 && d5 > 0 && d6 > d5) ? d6 - d5 : 0,
-					point->follower[i].status);
+					point->follower[i].status,
+					point->follower[i].slack > 0 ? point->follower[i].slack / 1000.0 : 0);
 		}
 	}
 	fprintf(d->output, "\n");
@@ -493,6 +521,33 @@ static void dump_scripts(struct data *d)
 			"unset output\n");
 		fclose(out);
 	}
+	out = fopen("Timing6.plot", "we");
+	if (out == NULL) {
+		pw_log_error("Can't open Timing6.plot: %m");
+	} else {
+		fprintf(out,
+			"set output 'Timing6.svg\n"
+			"set terminal svg\n"
+			"set multiplot\n"
+			"set grid\n"
+			"set key tmargin\n"
+			"set title \"Clients slack (0 is on the critical path)\"\n"
+			"set xlabel \"audio cycles\"\n"
+			"set ylabel \"usec\"\n"
+			"plot ");
+
+		for (i = 0; i < d->n_followers; i++) {
+			fprintf(out,
+				"\"%s\" using %d title \"%s/%u\" with lines%s",
+					d->filename, 4 + (i * 8) + 8,
+					d->followers[i].name, d->followers[i].id,
+					i+1 < d->n_followers ? ", " : "");
+		}
+		fprintf(out,
+			"\nunset multiplot\n"
+			"unset output\n");
+		fclose(out);
+	}
 	out = fopen("Timings.html", "we");
 	if (out == NULL) {
 		pw_log_error("Can't open Timings.html: %m");
@@ -516,6 +571,7 @@ static void dump_scripts(struct data *d)
 			"    <div class='center'><object class='center' type='image/svg+xml' data='Timing3.svg'>Timing3</object></div>"
 			"    <div class='center'><object class='center' type='image/svg+xml' data='Timing4.svg'>Timing4</object></div>"
 			"    <div class='center'><object class='center' type='image/svg+xml' data='Timing5.svg'>Timing5</object></div>"
+			"    <div class='center'><object class='center' type='image/svg+xml' data='Timing6.svg'>Timing6</object></div>"
 			"  </body>\n"
 			"</html>\n");
 		fclose(out);
@@ -530,7 +586,8 @@ static void dump_scripts(struct data *d)
 			"gnuplot Timing2.plot\n"
 			"gnuplot Timing3.plot\n"
 			"gnuplot Timing4.plot\n"
-			"gnuplot Timing5.plot\n");
+			"gnuplot Timing5.plot\n"
+			"gnuplot Timing6.plot\n");
 		fclose(out);
 	}
 	printf("run 'sh generate_timings.sh' and load Timings.html in a browser\n");
@@ -566,6 +623,9 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 			case SPA_PROFILER_followerClock:
 				process_follower_clock(d, &p->value, &point);
 				break;
+			case SPA_PROFILER_followerSlack:
+				process_follower_slack(d, &p->value, &point);
+				break;
 			default:
 				break;
 			}
@@ -45,6 +45,7 @@ struct measurement {
 	struct spa_fraction latency;
 	uint32_t xrun_count;
 	bool async;
+	int64_t slack;
 };
 
 struct node {
@@ -334,6 +335,7 @@ static struct node *add_node(struct data *d, uint32_t id, const char *name)
 	n->data = d;
 	n->id = id;
 	n->driver = n;
+	n->measurement.slack = -1;
 
 	n->proxy = pw_registry_bind(d->registry, id, PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, 0);
 	if (n->proxy) {
@@ -378,6 +380,7 @@ static int process_driver_block(struct data *d, const struct spa_pod *pod, struc
 
 	spa_zero(m);
 	m.xrun_count = XRUN_INVALID;
+	m.slack = -1;
 	if ((res = spa_pod_parse_struct(pod,
 			SPA_POD_Int(&id),
 			SPA_POD_String(&name),
@@ -411,6 +414,7 @@ static int process_follower_block(struct data *d, const struct spa_pod *pod, str
 
 	spa_zero(m);
 	m.xrun_count = XRUN_INVALID;
+	m.slack = -1;
 	if ((res = spa_pod_parse_struct(pod,
 			SPA_POD_Int(&id),
 			SPA_POD_String(&name),
@@ -436,6 +440,26 @@ static int process_follower_block(struct data *d, const struct spa_pod *pod, str
 	return 0;
 }
 
+static int process_follower_slack(struct data *d, const struct spa_pod *pod, struct point *point)
+{
+	uint32_t id = 0, trigger = 0;
+	int64_t slack = 0;
+	struct node *n;
+	int res;
+
+	if ((res = spa_pod_parse_struct(pod,
+			SPA_POD_Int(&id),
+			SPA_POD_Int(&trigger),
+			SPA_POD_Long(&slack))) < 0)
+		return res;
+
+	if ((n = find_node(d, id)) == NULL)
+		return -ENOENT;
+
+	n->measurement.slack = slack;
+	return 0;
+}
+
 static const char *print_time(char *buf, bool active, size_t len, uint64_t val)
 {
 	if (val == (uint64_t)-1 || !active)
@@ -497,6 +521,7 @@ static void print_node(struct data *d, struct node *dr, struct node *n, int y)
 	char buf2[64];
 	char buf3[64];
 	char buf4[64];
+	char buf5[64];
 	uint64_t waiting, busy;
 	float quantum;
 	struct spa_fraction frac;
@@ -530,7 +555,7 @@ static void print_node(struct data *d, struct node *dr, struct node *n, int y)
 	else
 		busy = -1;
 
-	print_mode_dependent(d, y, 0, "%s %4.1u %6.1u %6.1u %s %s %s %s  %3.1u %16.16s %s%s",
+	print_mode_dependent(d, y, 0, "%s %4.1u %6.1u %6.1u %s %s %s %s %s  %3.1u %16.16s %s%s",
 			state_as_string(n->state, i->transport_state),
 			n->id,
 			frac.num, frac.denom,
@@ -538,11 +563,13 @@ static void print_node(struct data *d, struct node *dr, struct node *n, int y)
 			print_time(buf2, active, 64, busy),
 			print_perc(buf3, active, 64, waiting, quantum),
 			print_perc(buf4, active, 64, busy, quantum),
+			print_time(buf5, active, 64, n->measurement.slack),
 			n->measurement.xrun_count == XRUN_INVALID ?
 					i->xrun_count - dr->info_base :
 					n->measurement.xrun_count - n->measurement_base,
 			active ? n->format : "",
-			n->driver == n ? "" : n->measurement.async ? " = " : " + ",
+			n->driver == n ? "" : n->measurement.async ? " = " :
+				n->measurement.slack == 0 ? " * " : " + ",
 			n->name);
 }
 
@@ -550,10 +577,11 @@ static void clear_node(struct node *n)
 {
 	n->driver = n;
 	spa_zero(n->measurement);
+	n->measurement.slack = -1;
 	spa_zero(n->info);
 }
 
-#define HEADER	"S   ID  QUANT   RATE    WAIT    BUSY   W/Q   B/Q  ERR FORMAT           NAME "
+#define HEADER	"S   ID  QUANT   RATE    WAIT    BUSY   W/Q   B/Q   SLACK  ERR FORMAT           NAME "
 
 static void do_refresh(struct data *d, bool force_refresh)
 {
@@ -655,6 +683,9 @@ static void profiler_profile(void *data, const struct spa_pod *pod)
 			case SPA_PROFILER_followerBlock:
 				process_follower_block(d, &p->value, &point);
 				break;
+			case SPA_PROFILER_followerSlack:
+				process_follower_slack(d, &p->value, &point);
+				break;
 			default:
 				break;
 			}
@@ -0,0 +1,157 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+#include <spa/node/node.h>
+#include <spa/node/utils.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/impl.h>
+
+#define MAX_COUNT 200
+#define MAX_NODES 4096
+#define N_DRIVERS 4
+
+struct bench_node {
+	struct spa_node node;
+	struct spa_hook_list hooks;
+};
+
+static struct pw_impl_node *nodes[MAX_NODES];
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static int node_add_listener(void *object, struct spa_hook *listener,
+		const struct spa_node_events *events, void *data)
+{
+	struct bench_node *n = object;
+	spa_hook_list_append(&n->hooks, listener, events, data);
+	return 0;
+}
+
+static int node_set_callbacks(void *object, const struct spa_node_callbacks *callbacks,
+		void *data)
+{
+	return 0;
+}
+
+static int node_set_io(void *object, uint32_t id, void *data, size_t size)
+{
+	return 0;
+}
+
+static int node_send_command(void *object, const struct spa_command *command)
+{
+	return 0;
+}
+
+static const struct spa_node_methods node_methods = {
+	SPA_VERSION_NODE_METHODS,
+	.add_listener = node_add_listener,
+	.set_callbacks = node_set_callbacks,
+	.set_io = node_set_io,
+	.send_command = node_send_command,
+};
+
+static struct bench_node bench_node;
+
+static struct pw_impl_node *make_node(struct pw_context *context, struct pw_properties *props)
+{
+	struct pw_impl_node *node;
+
+	node = pw_context_create_node(context, props, 0);
+	assert(node != NULL);
+	pw_impl_node_set_implementation(node, &bench_node.node);
+	pw_impl_node_register(node, NULL);
+	pw_impl_node_set_active(node, true);
+	return node;
+}
+
+/* Make n_nodes streams that want a driver. Like with loopbacks and filter-chains,
+ * half of them are in pairs that share a link group. */
+static void test_recalc(struct pw_context *context, uint32_t n_nodes)
+{
+	struct pw_impl_node *node;
+	struct pw_properties *props;
+	uint64_t t1, t2;
+	uint32_t i;
+	char group[64];
+
+	t1 = get_time();
+	for (i = 0; i < N_DRIVERS; i++) {
+		props = pw_properties_new(
+				PW_KEY_NODE_NAME, "benchmark-driver",
+				PW_KEY_NODE_DRIVER, "true",
+				PW_KEY_MEDIA_CLASS, "Audio/Sink",
+				NULL);
+		pw_properties_setf(props, PW_KEY_PRIORITY_DRIVER, "%u", 1000 + i);
+		nodes[i] = make_node(context, props);
+	}
+	for (; i < n_nodes; i++) {
+		snprintf(group, sizeof(group), "benchmark-group-%u", i / 2);
+		nodes[i] = make_node(context, pw_properties_new(
+				PW_KEY_NODE_NAME, "benchmark-stream",
+				PW_KEY_NODE_WANT_DRIVER, "true",
+				PW_KEY_NODE_LINK_GROUP, i & 2 ? group : NULL,
+				NULL));
+	}
+	t2 = get_time();
+	fprintf(stderr, "add %u nodes: elapsed %"PRIu64"\n", n_nodes, t2 - t1);
+
+	/* a short-lived stream, like a notification sound */
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++) {
+		node = make_node(context, pw_properties_new(
+				PW_KEY_NODE_NAME, "benchmark-short",
+				PW_KEY_NODE_WANT_DRIVER, "true",
+				NULL));
+		pw_impl_node_destroy(node);
+	}
+	t2 = get_time();
+	fprintf(stderr, "short-lived stream %u nodes: elapsed %"PRIu64" count %u = %"PRIu64"/sec\n",
+			n_nodes, t2 - t1, MAX_COUNT,
+			MAX_COUNT * (uint64_t)SPA_NSEC_PER_SEC / SPA_MAX(t2 - t1, 1u));
+
+	for (i = 0; i < n_nodes; i++)
+		pw_impl_node_destroy(nodes[i]);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+
+	pw_init(&argc, &argv);
+
+	bench_node.node.iface = SPA_INTERFACE_INIT(SPA_TYPE_INTERFACE_Node,
+			SPA_VERSION_NODE, &node_methods, &bench_node);
+	spa_hook_list_init(&bench_node.hooks);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				NULL), 0);
+	assert(context != NULL);
+
+	test_recalc(context, 256);
+	test_recalc(context, 1024);
+	test_recalc(context, MAX_NODES);
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+
+	pw_deinit();
+
+	return 0;
+}
@@ -0,0 +1,96 @@
+/* PipeWire */
+/* SPDX-FileCopyrightText: Copyright © 2026 PipeWire authors */
+/* SPDX-License-Identifier: MIT */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+
+#include <spa/buffer/buffer.h>
+
+#include <pipewire/pipewire.h>
+#include <pipewire/mem.h>
+
+#define MAX_COUNT 1000000
+#define MAX_BLOCKS 512
+
+static struct pw_memblock *blocks[MAX_BLOCKS];
+
+static uint64_t get_time(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return SPA_TIMESPEC_TO_NSEC(&ts);
+}
+
+static void report(const char *what, uint32_t n_blocks, uint64_t t1, uint64_t t2)
+{
+	fprintf(stderr, "%s %u blocks: elapsed %"PRIu64" count %u = %"PRIu64"/sec\n",
+			what, n_blocks, t2 - t1, MAX_COUNT,
+			MAX_COUNT * (uint64_t)SPA_NSEC_PER_SEC / SPA_MAX(t2 - t1, 1u));
+}
+
+static void test_lookup(uint32_t n_blocks)
+{
+	struct pw_mempool *pool;
+	struct pw_memblock *b;
+	uint64_t t1, t2;
+	uint32_t i, idx;
+
+	pool = pw_mempool_new(NULL);
+	assert(pool != NULL);
+
+	t1 = get_time();
+	for (i = 0; i < n_blocks; i++) {
+		blocks[i] = pw_mempool_alloc(pool, PW_MEMBLOCK_FLAG_READWRITE |
+				PW_MEMBLOCK_FLAG_MAP, SPA_DATA_MemFd, 4096);
+		assert(blocks[i] != NULL);
+	}
+	t2 = get_time();
+	fprintf(stderr, "alloc %u blocks: elapsed %"PRIu64"\n", n_blocks, t2 - t1);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_blocks;
+		b = pw_mempool_find_ptr(pool,
+				SPA_PTROFF(blocks[idx]->map->ptr, idx % 4096, void));
+		assert(b == blocks[idx]);
+	}
+	t2 = get_time();
+	report("find_ptr", n_blocks, t1, t2);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_blocks;
+		b = pw_mempool_find_fd(pool, blocks[idx]->fd);
+		assert(b == blocks[idx]);
+	}
+	t2 = get_time();
+	report("find_fd", n_blocks, t1, t2);
+
+	t1 = get_time();
+	for (i = 0; i < MAX_COUNT; i++) {
+		idx = random() % n_blocks;
+		b = pw_mempool_find_id(pool, blocks[idx]->id);
+		assert(b == blocks[idx]);
+	}
+	t2 = get_time();
+	report("find_id", n_blocks, t1, t2);
+
+	pw_mempool_destroy(pool);
+}
+
+int main(int argc, char *argv[])
+{
+	pw_init(&argc, &argv);
+
+	test_lookup(16);
+	test_lookup(64);
+	test_lookup(256);
+	test_lookup(MAX_BLOCKS);
+
+	pw_deinit();
+
+	return 0;
+}
@@ -777,6 +777,7 @@ static void set_test_env(struct pwtest_context *ctx, struct pwtest_test *t)
 	make_xdg_runtime_test_dir(xdg_runtime_dir, ctx->xdg_dir);
 	replace_env(t, "XDG_RUNTIME_DIR", xdg_runtime_dir);
 	replace_env(t, "TMPDIR", xdg_runtime_dir);
+	replace_env(t, "XDG_CACHE_HOME", xdg_runtime_dir);
 
 	replace_env(t, "SPA_PLUGIN_DIR", BUILD_ROOT "/spa/plugins");
 	replace_env(t, "SPA_DATA_DIR", SOURCE_ROOT "/spa/plugins");
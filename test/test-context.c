@@ -4,12 +4,17 @@
 
 #include "pwtest.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <spa/utils/names.h>
 #include <spa/utils/string.h>
 #include <spa/support/dbus.h>
 #include <spa/support/cpu.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/global.h>
+#include <pipewire/impl.h>
 
 #define TEST_FUNC(a,b,func)	\
 do {				\
@@ -259,12 +264,473 @@ PWTEST(context_support)
 	return PWTEST_PASS;
 }
 
+PWTEST(context_spa_cache)
+{
+	struct pw_main_loop *loop;
+	struct pw_context *context;
+	struct spa_handle *handle;
+	char path[PATH_MAX];
+	const char *dir;
+
+	pw_init(0, NULL);
+
+	loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				NULL), 0);
+	pwtest_ptr_notnull(context);
+
+	/* the null config has no context.spa-libs, the library is
+	 * found with the factory cache */
+	handle = pw_context_load_spa_handle(context, SPA_NAME_SUPPORT_NODE_DRIVER, NULL);
+	pwtest_ptr_notnull(handle);
+	pw_unload_spa_handle(handle);
+
+	dir = getenv("XDG_CACHE_HOME");
+	pwtest_ptr_notnull(dir);
+	spa_scnprintf(path, sizeof(path), "%s/pipewire/spa-factories.conf", dir);
+	pwtest_errno_ok(access(path, R_OK));
+
+	handle = pw_context_load_spa_handle(context, "support.does-not-exist", NULL);
+	pwtest_ptr_null(handle);
+	pwtest_int_eq(errno, ENOENT);
+
+	pw_context_destroy(context);
+	pw_main_loop_destroy(loop);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+struct snapshot_data {
+	struct pw_main_loop *loop;
+	int pending;
+	uint32_t n_globals;
+	uint32_t added;
+	uint32_t removed;
+	uint32_t n_mem;
+};
+
+static void snapshot_check_access(void *data, struct pw_impl_client *client)
+{
+	struct pw_permission permissions[1] = {
+		PW_PERMISSION_INIT(PW_ID_ANY, PW_PERM_ALL),
+	};
+	pw_impl_client_update_permissions(client, 1, permissions);
+}
+
+static const struct pw_context_events snapshot_context_events = {
+	PW_VERSION_CONTEXT_EVENTS,
+	.check_access = snapshot_check_access,
+};
+
+static void snapshot_core_done(void *data, uint32_t id, int seq)
+{
+	struct snapshot_data *d = data;
+	if (id == PW_ID_CORE && seq == d->pending)
+		pw_main_loop_quit(d->loop);
+}
+
+static void snapshot_core_add_mem(void *data, uint32_t id, uint32_t type, int fd, uint32_t flags)
+{
+	struct snapshot_data *d = data;
+	int seals = fcntl(fd, F_GET_SEALS);
+
+	/* the snapshot can't be changed after it was sent */
+	pwtest_int_ne(seals, -1);
+	pwtest_int_eq(seals & F_SEAL_WRITE, F_SEAL_WRITE);
+	pwtest_int_eq(seals & F_SEAL_SHRINK, F_SEAL_SHRINK);
+	pwtest_int_eq(write(fd, "x", 1), -1);
+	d->n_mem++;
+}
+
+static const struct pw_core_events snapshot_core_events = {
+	PW_VERSION_CORE_EVENTS,
+	.done = snapshot_core_done,
+	.add_mem = snapshot_core_add_mem,
+};
+
+static void snapshot_global(void *data, uint32_t id,
+		uint32_t permissions, const char *type, uint32_t version,
+		const struct spa_dict *props)
+{
+	struct snapshot_data *d = data;
+	d->n_globals++;
+	if (spa_streq(spa_dict_lookup(props, PW_KEY_FACTORY_NAME), "snapshot-added"))
+		d->added++;
+	pwtest_bool_true(PW_PERM_IS_R(permissions));
+	pwtest_ptr_notnull(spa_dict_lookup(props, PW_KEY_OBJECT_SERIAL));
+}
+
+static void snapshot_global_remove(void *data, uint32_t id)
+{
+	struct snapshot_data *d = data;
+	d->removed++;
+}
+
+static const struct pw_registry_events snapshot_registry_events = {
+	PW_VERSION_REGISTRY_EVENTS,
+	.global = snapshot_global,
+	.global_remove = snapshot_global_remove,
+};
+
+static int count_global(void *data, struct pw_global *global)
+{
+	uint32_t *count = data;
+	(*count)++;
+	return 0;
+}
+
+static void snapshot_roundtrip(struct pw_core *core, struct snapshot_data *d)
+{
+	d->pending = pw_core_sync(core, PW_ID_CORE, 0);
+	pw_main_loop_run(d->loop);
+}
+
+PWTEST(context_registry_snapshot)
+{
+	struct pw_context *context;
+	struct pw_core *core;
+	struct pw_registry *r1, *r2;
+	struct pw_impl_factory *factories[64];
+	struct spa_hook context_listener, core_listener, l1, l2;
+	struct snapshot_data d1, d2;
+	uint32_t i, n_globals = 0;
+
+	pw_init(0, NULL);
+
+	spa_zero(d1);
+	spa_zero(d2);
+	d1.loop = d2.loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(d1.loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				NULL), 0);
+	pwtest_ptr_notnull(context);
+	pw_context_add_listener(context, &context_listener, &snapshot_context_events, NULL);
+	pwtest_ptr_notnull(pw_context_load_module(context,
+				"libpipewire-module-protocol-native", NULL, NULL));
+
+	for (i = 0; i < SPA_N_ELEMENTS(factories); i++) {
+		factories[i] = pw_context_create_factory(context, "snapshot-test",
+				PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, NULL, 0);
+		pwtest_ptr_notnull(factories[i]);
+		pwtest_neg_errno_ok(pw_impl_factory_register(factories[i], NULL));
+	}
+
+	core = pw_context_connect(context,
+			pw_properties_new(
+				PW_KEY_REMOTE_NAME, "internal",
+				NULL), 0);
+	pwtest_ptr_notnull(core);
+	pw_core_add_listener(core, &core_listener, &snapshot_core_events, &d1);
+
+	/* all globals are in the first registry */
+	r1 = pw_core_get_registry(core, PW_VERSION_REGISTRY, 0);
+	pwtest_ptr_notnull(r1);
+	pw_registry_add_listener(r1, &l1, &snapshot_registry_events, &d1);
+	snapshot_roundtrip(core, &d1);
+
+	pw_context_for_each_global(context, count_global, &n_globals);
+	pwtest_int_eq(d1.n_globals, n_globals);
+	pwtest_int_eq(d1.n_mem, 1u);
+
+	/* changes are sent to the first registry as events and are part
+	 * of the snapshot of the second registry */
+	for (i = 0; i < SPA_N_ELEMENTS(factories); i += 2)
+		pw_impl_factory_destroy(factories[i]);
+	factories[0] = pw_context_create_factory(context, "snapshot-added",
+			PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, NULL, 0);
+	pwtest_neg_errno_ok(pw_impl_factory_register(factories[0], NULL));
+
+	r2 = pw_core_get_registry(core, PW_VERSION_REGISTRY, 0);
+	pwtest_ptr_notnull(r2);
+	pw_registry_add_listener(r2, &l2, &snapshot_registry_events, &d2);
+	snapshot_roundtrip(core, &d1);
+
+	n_globals = 0;
+	pw_context_for_each_global(context, count_global, &n_globals);
+	pwtest_int_eq(d1.n_globals - d1.removed, n_globals);
+	pwtest_int_eq(d1.removed, SPA_N_ELEMENTS(factories) / 2);
+	pwtest_int_eq(d1.added, 1u);
+	pwtest_int_eq(d2.n_globals, n_globals);
+	pwtest_int_eq(d2.removed, 0u);
+	pwtest_int_eq(d2.added, 1u);
+	/* the second registry gets a new snapshot */
+	pwtest_int_eq(d1.n_mem, 2u);
+
+	pw_proxy_destroy((struct pw_proxy*)r1);
+	pw_proxy_destroy((struct pw_proxy*)r2);
+	pw_core_disconnect(core);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(d1.loop);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+PWTEST(context_registry_filter)
+{
+	struct pw_context *context;
+	struct pw_core *core;
+	struct pw_registry *r1, *r2;
+	struct pw_impl_factory *factories[16];
+	struct spa_hook context_listener, core_listener, l1, l2;
+	struct snapshot_data d1, d2;
+	struct spa_dict_item items[2];
+	uint32_t i;
+
+	pw_init(0, NULL);
+
+	spa_zero(d1);
+	spa_zero(d2);
+	d1.loop = d2.loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(d1.loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				NULL), 0);
+	pwtest_ptr_notnull(context);
+	pw_context_add_listener(context, &context_listener, &snapshot_context_events, NULL);
+	pwtest_ptr_notnull(pw_context_load_module(context,
+				"libpipewire-module-protocol-native", NULL, NULL));
+
+	for (i = 0; i < SPA_N_ELEMENTS(factories); i++) {
+		factories[i] = pw_context_create_factory(context,
+				i & 1 ? "filter-b" : "filter-a",
+				PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, NULL, 0);
+		pwtest_ptr_notnull(factories[i]);
+		pwtest_neg_errno_ok(pw_impl_factory_register(factories[i], NULL));
+	}
+
+	core = pw_context_connect(context,
+			pw_properties_new(
+				PW_KEY_REMOTE_NAME, "internal",
+				NULL), 0);
+	pwtest_ptr_notnull(core);
+	pw_core_add_listener(core, &core_listener, &snapshot_core_events, &d1);
+
+	/* only the filter-a factories */
+	items[0] = SPA_DICT_ITEM_INIT(PW_REGISTRY_FILTER_TYPES, PW_TYPE_INTERFACE_Factory);
+	items[1] = SPA_DICT_ITEM_INIT(PW_KEY_FACTORY_NAME, "[ filter-a snapshot-added ]");
+	r1 = pw_core_get_registry_filtered(core, PW_VERSION_REGISTRY,
+			&SPA_DICT_INIT(items, 2), 0);
+	pwtest_ptr_notnull(r1);
+	pw_registry_add_listener(r1, &l1, &snapshot_registry_events, &d1);
+
+	/* no global has the Link type */
+	items[0] = SPA_DICT_ITEM_INIT(PW_REGISTRY_FILTER_TYPES, PW_TYPE_INTERFACE_Link);
+	r2 = pw_core_get_registry_filtered(core, PW_VERSION_REGISTRY,
+			&SPA_DICT_INIT(items, 1), 0);
+	pwtest_ptr_notnull(r2);
+	pw_registry_add_listener(r2, &l2, &snapshot_registry_events, &d2);
+	snapshot_roundtrip(core, &d1);
+
+	pwtest_int_eq(d1.n_globals, SPA_N_ELEMENTS(factories) / 2);
+	pwtest_int_eq(d2.n_globals, 0u);
+
+	/* only the removal of announced globals is sent */
+	for (i = 0; i < 4; i++)
+		pw_impl_factory_destroy(factories[i]);
+	factories[0] = pw_context_create_factory(context, "snapshot-added",
+			PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, NULL, 0);
+	pwtest_neg_errno_ok(pw_impl_factory_register(factories[0], NULL));
+	factories[1] = pw_context_create_factory(context, "filter-b",
+			PW_TYPE_INTERFACE_Node, PW_VERSION_NODE, NULL, 0);
+	pwtest_neg_errno_ok(pw_impl_factory_register(factories[1], NULL));
+	snapshot_roundtrip(core, &d1);
+
+	pwtest_int_eq(d1.removed, 2u);
+	pwtest_int_eq(d1.added, 1u);
+	pwtest_int_eq(d1.n_globals, SPA_N_ELEMENTS(factories) / 2 + 1);
+
+	/* globals that start or stop matching are added or removed */
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_FACTORY_NAME, "filter-a");
+	pw_global_update_keys(pw_impl_factory_get_global(factories[1]),
+			&SPA_DICT_INIT(items, 1), (const char *[]) { PW_KEY_FACTORY_NAME, NULL });
+	items[0] = SPA_DICT_ITEM_INIT(PW_KEY_FACTORY_NAME, "filter-b");
+	pw_global_update_keys(pw_impl_factory_get_global(factories[4]),
+			&SPA_DICT_INIT(items, 1), (const char *[]) { PW_KEY_FACTORY_NAME, NULL });
+	snapshot_roundtrip(core, &d1);
+
+	pwtest_int_eq(d1.n_globals, SPA_N_ELEMENTS(factories) / 2 + 2);
+	pwtest_int_eq(d1.removed, 3u);
+	pwtest_int_eq(d2.n_globals, 0u);
+	pwtest_int_eq(d2.removed, 0u);
+
+	pw_proxy_destroy((struct pw_proxy*)r1);
+	pw_proxy_destroy((struct pw_proxy*)r2);
+	pw_core_disconnect(core);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(d1.loop);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+struct delta_data {
+	struct pw_node_info *info;
+	uint32_t n_info;
+};
+
+static void delta_node_info(void *data, const struct pw_node_info *info)
+{
+	struct delta_data *d = data;
+	d->info = pw_node_info_update(d->info, info);
+	d->n_info++;
+}
+
+static const struct pw_node_events delta_node_events = {
+	PW_VERSION_NODE_EVENTS,
+	.info = delta_node_info,
+};
+
+static void delta_check_props(struct pw_impl_node *node, struct delta_data *d)
+{
+	const struct pw_properties *props = pw_impl_node_get_properties(node);
+	const struct spa_dict_item *it;
+
+	pwtest_ptr_notnull(d->info);
+	pwtest_int_eq(d->info->props->n_items, props->dict.n_items);
+	spa_dict_for_each(it, &props->dict)
+		pwtest_str_eq(spa_dict_lookup(d->info->props, it->key), it->value);
+}
+
+PWTEST(context_node_props_delta)
+{
+	struct pw_context *context;
+	struct pw_core *core;
+	struct pw_registry *registry;
+	struct pw_impl_node *node;
+	struct pw_proxy *n3, *n4, *n5;
+	struct spa_hook context_listener, core_listener, l3, l4, l5;
+	struct snapshot_data d;
+	struct delta_data d3, d4, d5;
+	struct spa_dict_item items[2];
+	uint32_t id;
+
+	pw_init(0, NULL);
+
+	spa_zero(d);
+	spa_zero(d3);
+	spa_zero(d4);
+	spa_zero(d5);
+	d.loop = pw_main_loop_new(NULL);
+	context = pw_context_new(pw_main_loop_get_loop(d.loop),
+			pw_properties_new(
+				PW_KEY_CONFIG_NAME, "null",
+				NULL), 0);
+	pwtest_ptr_notnull(context);
+	pw_context_add_listener(context, &context_listener, &snapshot_context_events, NULL);
+	pwtest_ptr_notnull(pw_context_load_module(context,
+				"libpipewire-module-protocol-native", NULL, NULL));
+
+	node = pw_context_create_node(context,
+			pw_properties_new(
+				PW_KEY_NODE_NAME, "delta-node",
+				"delta.removed", "yes",
+				"delta.changed", "0",
+				NULL), 0);
+	pwtest_ptr_notnull(node);
+	pwtest_neg_errno_ok(pw_impl_node_register(node, NULL));
+	id = pw_global_get_id(pw_impl_node_get_global(node));
+
+	core = pw_context_connect(context,
+			pw_properties_new(
+				PW_KEY_REMOTE_NAME, "internal",
+				NULL), 0);
+	pwtest_ptr_notnull(core);
+	pw_core_add_listener(core, &core_listener, &snapshot_core_events, &d);
+
+	/* version 3 gets all properties, version 4 only the changes */
+	registry = pw_core_get_registry(core, PW_VERSION_REGISTRY, 0);
+	pwtest_ptr_notnull(registry);
+	n3 = pw_registry_bind(registry, id, PW_TYPE_INTERFACE_Node, 3, 0);
+	pwtest_ptr_notnull(n3);
+	n4 = pw_registry_bind(registry, id, PW_TYPE_INTERFACE_Node, 4, 0);
+	pwtest_ptr_notnull(n4);
+	pw_proxy_add_object_listener(n3, &l3, &delta_node_events, &d3);
+	pw_proxy_add_object_listener(n4, &l4, &delta_node_events, &d4);
+	snapshot_roundtrip(core, &d);
+
+	pwtest_int_eq(d3.n_info, 1u);
+	pwtest_int_eq(d4.n_info, 1u);
+	delta_check_props(node, &d3);
+	delta_check_props(node, &d4);
+
+	items[0] = SPA_DICT_ITEM_INIT("delta.changed", "1");
+	items[1] = SPA_DICT_ITEM_INIT("delta.added", "yes");
+	pw_impl_node_update_properties(node, &SPA_DICT_INIT(items, 2));
+	snapshot_roundtrip(core, &d);
+
+	pwtest_int_eq(d4.n_info, 2u);
+	delta_check_props(node, &d3);
+	delta_check_props(node, &d4);
+
+	items[0] = SPA_DICT_ITEM_INIT("delta.removed", NULL);
+	pw_impl_node_update_properties(node, &SPA_DICT_INIT(items, 1));
+	snapshot_roundtrip(core, &d);
+
+	pwtest_int_eq(d4.n_info, 3u);
+	pwtest_ptr_null(spa_dict_lookup(d4.info->props, "delta.removed"));
+	delta_check_props(node, &d3);
+	delta_check_props(node, &d4);
+
+	/* changes without a version 4 resource are not lost for the
+	 * next one */
+	spa_hook_remove(&l4);
+	pw_proxy_destroy(n4);
+	snapshot_roundtrip(core, &d);
+	items[0] = SPA_DICT_ITEM_INIT("delta.changed", "2");
+	pw_impl_node_update_properties(node, &SPA_DICT_INIT(items, 1));
+	snapshot_roundtrip(core, &d);
+
+	n5 = pw_registry_bind(registry, id, PW_TYPE_INTERFACE_Node, 4, 0);
+	pwtest_ptr_notnull(n5);
+	pw_proxy_add_object_listener(n5, &l5, &delta_node_events, &d5);
+	snapshot_roundtrip(core, &d);
+	pwtest_int_eq(d5.n_info, 1u);
+
+	items[0] = SPA_DICT_ITEM_INIT("delta.changed", "1");
+	pw_impl_node_update_properties(node, &SPA_DICT_INIT(items, 1));
+	snapshot_roundtrip(core, &d);
+
+	pwtest_int_eq(d5.n_info, 2u);
+	pwtest_str_eq(spa_dict_lookup(d5.info->props, "delta.changed"), "1");
+	delta_check_props(node, &d3);
+	delta_check_props(node, &d5);
+
+	pw_node_info_free(d3.info);
+	pw_node_info_free(d4.info);
+	pw_node_info_free(d5.info);
+	spa_hook_remove(&l3);
+	spa_hook_remove(&l5);
+	pw_proxy_destroy(n3);
+	pw_proxy_destroy(n5);
+	pw_proxy_destroy((struct pw_proxy*)registry);
+	pw_core_disconnect(core);
+	pw_impl_node_destroy(node);
+	pw_context_destroy(context);
+	pw_main_loop_destroy(d.loop);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(context)
 {
 	pwtest_add(context_abi, PWTEST_NOARG);
 	pwtest_add(context_create, PWTEST_NOARG);
 	pwtest_add(context_properties, PWTEST_NOARG);
 	pwtest_add(context_support, PWTEST_NOARG);
+	pwtest_add(context_spa_cache, PWTEST_NOARG);
+	pwtest_add(context_registry_snapshot, PWTEST_NOARG);
+	pwtest_add(context_registry_filter, PWTEST_NOARG);
+	pwtest_add(context_node_props_delta, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
@@ -435,6 +435,218 @@ PWTEST(cancel_thread_while_dispatching)
 	return PWTEST_PASS;
 }
 
+struct timers_data;
+
+struct timer_obj {
+	struct timers_data *d;
+	struct spa_source *source;
+	int idx;
+};
+
+struct timers_data {
+	struct pw_main_loop *ml;
+	struct pw_loop *l;
+	struct timer_obj timers[8];
+	struct spa_source *repeat;
+	struct spa_source *removed;
+	int order[8];
+	int count;
+	int repeat_count;
+};
+
+static void timers_maybe_quit(struct timers_data *d)
+{
+	if (d->count == (int)SPA_N_ELEMENTS(d->timers) && d->repeat_count == 3)
+		pw_main_loop_quit(d->ml);
+}
+
+static void on_timer(void *data, uint64_t expirations)
+{
+	struct timer_obj *t = data;
+	struct timers_data *d = t->d;
+
+	pwtest_int_eq(expirations, 1u);
+
+	/* the first timer removes a pending timer */
+	if (d->removed != NULL) {
+		pw_loop_destroy_source(d->l, d->removed);
+		d->removed = NULL;
+	}
+	d->order[d->count++] = t->idx;
+	timers_maybe_quit(d);
+}
+
+static void on_timer_removed(void *data, uint64_t expirations)
+{
+	pwtest_fail_if_reached();
+}
+
+static void on_timer_repeat(void *data, uint64_t expirations)
+{
+	struct timers_data *d = data;
+
+	d->repeat_count += expirations;
+	if (d->repeat_count >= 3)
+		pw_loop_update_timer(d->l, d->repeat, NULL, NULL, false);
+	timers_maybe_quit(d);
+}
+
+PWTEST(timers_order)
+{
+	struct timers_data data = {0};
+	struct timespec value;
+	uint32_t i;
+
+	pw_init(NULL, NULL);
+
+	data.ml = pw_main_loop_new(NULL);
+	pwtest_ptr_notnull(data.ml);
+	data.l = pw_main_loop_get_loop(data.ml);
+
+	/* arm the timers in reverse order of expiration */
+	for (i = 0; i < SPA_N_ELEMENTS(data.timers); i++) {
+		data.timers[i].d = &data;
+		data.timers[i].idx = i;
+		data.timers[i].source = pw_loop_add_timer(data.l, on_timer, &data.timers[i]);
+		pwtest_ptr_notnull(data.timers[i].source);
+	}
+	for (i = SPA_N_ELEMENTS(data.timers); i > 0; i--) {
+		value.tv_sec = 0;
+		value.tv_nsec = (i - 1) * 2 * SPA_NSEC_PER_MSEC + SPA_NSEC_PER_MSEC;
+		pwtest_neg_errno_ok(pw_loop_update_timer(data.l, data.timers[i - 1].source,
+					&value, NULL, false));
+	}
+
+	data.removed = pw_loop_add_timer(data.l, on_timer_removed, &data);
+	pwtest_ptr_notnull(data.removed);
+	value.tv_sec = 0;
+	value.tv_nsec = 10 * SPA_NSEC_PER_MSEC;
+	pwtest_neg_errno_ok(pw_loop_update_timer(data.l, data.removed, &value, NULL, false));
+
+	data.repeat = pw_loop_add_timer(data.l, on_timer_repeat, &data);
+	pwtest_ptr_notnull(data.repeat);
+	value.tv_sec = 0;
+	value.tv_nsec = 5 * SPA_NSEC_PER_MSEC;
+	pwtest_neg_errno_ok(pw_loop_update_timer(data.l, data.repeat, NULL, &value, false));
+
+	pw_main_loop_run(data.ml);
+
+	for (i = 0; i < SPA_N_ELEMENTS(data.timers); i++)
+		pwtest_int_eq(data.order[i], (int)i);
+	pwtest_int_eq(data.repeat_count, 3);
+
+	for (i = 0; i < SPA_N_ELEMENTS(data.timers); i++)
+		pw_loop_destroy_source(data.l, data.timers[i].source);
+	pw_loop_destroy_source(data.l, data.repeat);
+	pw_main_loop_destroy(data.ml);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
+struct uring_data {
+	struct pw_loop *l;
+	struct spa_source *event;
+	struct spa_source *timer;
+	struct spa_source *io;
+	int event_count;
+	int timer_count;
+	int io_count;
+};
+
+static void uring_on_event(void *data, uint64_t count)
+{
+	struct uring_data *d = data;
+	d->event_count++;
+}
+
+static void uring_on_timer(void *data, uint64_t expirations)
+{
+	struct uring_data *d = data;
+	d->timer_count += expirations;
+}
+
+static void uring_on_io(void *data, int fd, uint32_t mask)
+{
+	struct uring_data *d = data;
+	pwtest_int_eq(mask & SPA_IO_IN, (uint32_t)SPA_IO_IN);
+	read_eventfd(fd);
+	d->io_count++;
+}
+
+PWTEST(uring_system)
+{
+	struct uring_data data = {0};
+	struct timespec value;
+	struct pw_properties *props;
+	int evfd, i;
+
+	pw_init(NULL, NULL);
+
+	props = pw_properties_new("library.name.system", "support/libspa-uring", NULL);
+	data.l = pw_loop_new(&props->dict);
+	pw_properties_free(props);
+	if (data.l == NULL) {
+		pw_deinit();
+		return PWTEST_SKIP;
+	}
+
+	evfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	pwtest_errno_ok(evfd);
+
+	data.event = pw_loop_add_event(data.l, uring_on_event, &data);
+	pwtest_ptr_notnull(data.event);
+	data.timer = pw_loop_add_timer(data.l, uring_on_timer, &data);
+	pwtest_ptr_notnull(data.timer);
+	data.io = pw_loop_add_io(data.l, evfd, SPA_IO_IN, false, uring_on_io, &data);
+	pwtest_ptr_notnull(data.io);
+
+	pw_loop_enter(data.l);
+
+	value.tv_sec = 0;
+	value.tv_nsec = SPA_NSEC_PER_MSEC;
+	pwtest_neg_errno_ok(pw_loop_update_timer(data.l, data.timer, &value, NULL, false));
+	pwtest_neg_errno_ok(pw_loop_signal_event(data.l, data.event));
+	write_eventfd(evfd);
+
+	for (i = 0; i < 100; i++) {
+		if (data.event_count > 0 && data.timer_count > 0 && data.io_count > 0)
+			break;
+		pwtest_neg_errno_ok(pw_loop_iterate(data.l, 100));
+	}
+	pwtest_int_eq(data.event_count, 1);
+	pwtest_int_eq(data.timer_count, 1);
+	pwtest_int_eq(data.io_count, 1);
+
+	/* nothing is pending anymore */
+	pwtest_int_eq(pw_loop_iterate(data.l, 10), 0);
+
+	/* the sources are armed again */
+	pwtest_neg_errno_ok(pw_loop_signal_event(data.l, data.event));
+	write_eventfd(evfd);
+	for (i = 0; i < 100; i++) {
+		if (data.event_count > 1 && data.io_count > 1)
+			break;
+		pwtest_neg_errno_ok(pw_loop_iterate(data.l, 100));
+	}
+	pwtest_int_eq(data.event_count, 2);
+	pwtest_int_eq(data.io_count, 2);
+	pwtest_int_eq(data.timer_count, 1);
+
+	pw_loop_leave(data.l);
+
+	pw_loop_destroy_source(data.l, data.io);
+	pw_loop_destroy_source(data.l, data.timer);
+	pw_loop_destroy_source(data.l, data.event);
+	pw_loop_destroy(data.l);
+	close(evfd);
+
+	pw_deinit();
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(support)
 {
 	pwtest_add(pwtest_loop_destroy2, PWTEST_NOARG);
@@ -443,6 +655,8 @@ PWTEST_SUITE(support)
 	pwtest_add(destroy_managed_source_before_dispatch, PWTEST_NOARG);
 	pwtest_add(destroy_managed_source_before_dispatch_recurse, PWTEST_NOARG);
 	pwtest_add(cancel_thread_while_dispatching, PWTEST_NOARG);
+	pwtest_add(timers_order, PWTEST_NOARG);
+	pwtest_add(uring_system, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }
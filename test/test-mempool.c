@@ -3,8 +3,11 @@
 /* SPDX-License-Identifier: MIT */
 
 #include <unistd.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include <pipewire/mem.h>
+#include <pipewire/properties.h>
 #include <spa/buffer/buffer.h>
 
 #include "pwtest.h"
@@ -105,10 +108,208 @@ PWTEST(map_range_overflow)
 	return PWTEST_PASS;
 }
 
+PWTEST(mempool_hugepages_prefault)
+{
+	/*
+	 * A pool with huge pages and prefaulting falls back to normal
+	 * memory when there are no huge pages. Mapping parts of the block
+	 * in another pool must work in both cases.
+	 */
+	long page_size = sysconf(_SC_PAGESIZE);
+	pwtest_errno_ok(page_size);
+
+	struct pw_mempool *p = pw_mempool_new(pw_properties_new(
+				"mem.hugepages", "true",
+				"mem.prefault", "true",
+				NULL));
+	pwtest_ptr_notnull(p);
+	struct pw_mempool *o = pw_mempool_new(pw_properties_new(
+				"mem.prefault", "true",
+				NULL));
+	pwtest_ptr_notnull(o);
+
+	struct pw_memblock *b = pw_mempool_alloc(p, PW_MEMBLOCK_FLAG_READWRITE |
+			PW_MEMBLOCK_FLAG_MAP | PW_MEMBLOCK_FLAG_SEAL | PW_MEMBLOCK_FLAG_HUGEPAGES,
+			SPA_DATA_MemFd, 3 * page_size);
+	pwtest_ptr_notnull(b);
+	pwtest_ptr_notnull(b->map);
+	memset(b->map->ptr, 0x5a, 3 * page_size);
+
+	struct pw_memblock *i = pw_mempool_import_block(o, b);
+	pwtest_ptr_notnull(i);
+
+	struct pw_memmap *m = pw_mempool_map_id(o, i->id, PW_MEMMAP_FLAG_READWRITE,
+			page_size + 16, page_size, NULL);
+	pwtest_ptr_notnull(m);
+	pwtest_int_eq(((uint8_t*)m->ptr)[0], 0x5a);
+	pwtest_int_eq(((uint8_t*)m->ptr)[page_size - 1], 0x5a);
+
+	((uint8_t*)m->ptr)[0] = 0xa5;
+	pwtest_int_eq(SPA_PTROFF(b->map->ptr, page_size + 16, uint8_t)[0], 0xa5);
+
+	pw_memmap_free(m);
+	pw_mempool_destroy(o);
+	pw_mempool_destroy(p);
+
+	return PWTEST_PASS;
+}
+
+PWTEST(mempool_cache)
+{
+	/*
+	 * Freed blocks are kept in the cache and used again for a block of
+	 * the same size, the memory is cleared.
+	 */
+	long page_size = sysconf(_SC_PAGESIZE);
+	pwtest_errno_ok(page_size);
+
+	struct pw_mempool *p = pw_mempool_new(pw_properties_new(
+				"mem.cache-size", "1048576",
+				NULL));
+	pwtest_ptr_notnull(p);
+
+	enum pw_memblock_flags flags = PW_MEMBLOCK_FLAG_READWRITE |
+		PW_MEMBLOCK_FLAG_MAP | PW_MEMBLOCK_FLAG_SEAL;
+	struct stat st1, st2;
+
+	struct pw_memblock *b = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, 2 * page_size);
+	pwtest_ptr_notnull(b);
+	pwtest_errno_ok(fstat(b->fd, &st1));
+	memset(b->map->ptr, 0x5a, 2 * page_size);
+	pw_memblock_unref(b);
+
+	/* a different size makes a new block */
+	b = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, 4 * page_size);
+	pwtest_ptr_notnull(b);
+	pwtest_errno_ok(fstat(b->fd, &st2));
+	pwtest_bool_false(st1.st_ino == st2.st_ino);
+	pw_memblock_unref(b);
+
+	/* the same size class reuses the first block */
+	b = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, 2 * page_size - 16);
+	pwtest_ptr_notnull(b);
+	pwtest_int_eq(b->size, 2 * page_size - 16);
+	pwtest_errno_ok(fstat(b->fd, &st2));
+	pwtest_bool_true(st1.st_ino == st2.st_ino);
+	pwtest_int_eq(((uint8_t*)b->map->ptr)[0], 0);
+	pwtest_int_eq(((uint8_t*)b->map->ptr)[page_size], 0);
+
+	struct pw_memmap *m = pw_mempool_map_id(p, b->id, PW_MEMMAP_FLAG_READWRITE,
+			page_size, 16, NULL);
+	pwtest_ptr_notnull(m);
+	pwtest_ptr_eq(m->ptr, SPA_PTROFF(b->map->ptr, page_size, void));
+
+	/* blocks with other maps are not cached */
+	pw_memblock_unref(b);
+	b = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, 2 * page_size);
+	pwtest_ptr_notnull(b);
+	pwtest_errno_ok(fstat(b->fd, &st2));
+	pwtest_bool_false(st1.st_ino == st2.st_ino);
+
+	/* blocks that were shared with another pool are not cached, the
+	 * users of that pool could still have the fd */
+	struct pw_mempool *other = pw_mempool_new(NULL);
+	pwtest_ptr_notnull(other);
+	struct pw_memblock *ib = pw_mempool_import_block(other, b);
+	pwtest_ptr_notnull(ib);
+	pw_memblock_unref(ib);
+	pwtest_errno_ok(fstat(b->fd, &st1));
+	pw_memblock_unref(b);
+	b = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, 2 * page_size);
+	pwtest_ptr_notnull(b);
+	pwtest_errno_ok(fstat(b->fd, &st2));
+	pwtest_bool_false(st1.st_ino == st2.st_ino);
+	pw_memblock_unref(b);
+
+	/* the fd of a smaller block of the same size class is too small for
+	 * a larger block and can't grow, it is not used again */
+	b = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, page_size - 96);
+	pwtest_ptr_notnull(b);
+	pwtest_errno_ok(fstat(b->fd, &st1));
+	pw_memblock_unref(b);
+	b = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, page_size - 6);
+	pwtest_ptr_notnull(b);
+	pwtest_ptr_notnull(b->map);
+	pwtest_errno_ok(fstat(b->fd, &st2));
+	pwtest_bool_false(st1.st_ino == st2.st_ino);
+	pwtest_int_eq(st2.st_size, page_size - 6);
+
+	/* the larger fd is used again for a smaller block */
+	pw_memblock_unref(b);
+	b = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, page_size - 64);
+	pwtest_ptr_notnull(b);
+	pwtest_ptr_notnull(b->map);
+	pwtest_errno_ok(fstat(b->fd, &st1));
+	pwtest_bool_true(st1.st_ino == st2.st_ino);
+
+	pw_mempool_destroy(other);
+	pw_mempool_destroy(p);
+
+	return PWTEST_PASS;
+}
+
+PWTEST(mempool_find)
+{
+	/*
+	 * Blocks are found by any address inside their mappings and by
+	 * their fd, also after other blocks were freed.
+	 */
+	struct pw_mempool *p = pw_mempool_new(NULL);
+	pwtest_ptr_notnull(p);
+
+	enum pw_memblock_flags flags = PW_MEMBLOCK_FLAG_READWRITE |
+		PW_MEMBLOCK_FLAG_MAP | PW_MEMBLOCK_FLAG_SEAL;
+	struct pw_memblock *b[32];
+	size_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(b); i++) {
+		b[i] = pw_mempool_alloc(p, flags, SPA_DATA_MemFd, 1024 + i * 512);
+		pwtest_ptr_notnull(b[i]);
+	}
+	for (i = 0; i < SPA_N_ELEMENTS(b); i += 2) {
+		pw_memblock_unref(b[i]);
+		b[i] = NULL;
+	}
+	for (i = 0; i < SPA_N_ELEMENTS(b); i++) {
+		if (b[i] == NULL)
+			continue;
+		pwtest_ptr_eq(pw_mempool_find_ptr(p, b[i]->map->ptr), b[i]);
+		pwtest_ptr_eq(pw_mempool_find_ptr(p,
+				SPA_PTROFF(b[i]->map->ptr, b[i]->size - 1, void)), b[i]);
+		pwtest_ptr_eq(pw_mempool_find_fd(p, b[i]->fd), b[i]);
+		pwtest_ptr_eq(pw_mempool_find_id(p, b[i]->id), b[i]);
+	}
+	pwtest_ptr_null(pw_mempool_find_ptr(p, &i));
+	pwtest_ptr_null(pw_mempool_find_fd(p, -1));
+	pwtest_ptr_null(pw_mempool_find_fd(p, 100000));
+
+	/* imported blocks share the fd and the address of the original */
+	struct pw_mempool *o = pw_mempool_new(NULL);
+	pwtest_ptr_notnull(o);
+
+	struct pw_memmap *m = pw_mempool_import_map(o, p,
+			SPA_PTROFF(b[1]->map->ptr, 16, void), 16, NULL);
+	pwtest_ptr_notnull(m);
+	pwtest_ptr_eq(pw_mempool_find_fd(o, b[1]->fd), m->block);
+	pwtest_ptr_eq(pw_mempool_find_ptr(o, m->ptr), m->block);
+
+	pw_memmap_free(m);
+	pwtest_ptr_null(pw_mempool_find_fd(o, b[1]->fd));
+	pwtest_ptr_eq(pw_mempool_find_fd(p, b[1]->fd), b[1]);
+
+	pw_mempool_destroy(o);
+	pw_mempool_destroy(p);
+
+	return PWTEST_PASS;
+}
+
 PWTEST_SUITE(pw_mempool)
 {
 	pwtest_add(mempool_issue4884, PWTEST_NOARG);
 	pwtest_add(map_range_overflow, PWTEST_NOARG);
+	pwtest_add(mempool_hugepages_prefault, PWTEST_NOARG);
+	pwtest_add(mempool_cache, PWTEST_NOARG);
+	pwtest_add(mempool_find, PWTEST_NOARG);
 
 	return PWTEST_PASS;
 }